@@ -0,0 +1,26 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cstdint>
+
+// Counter-based random numbers: the value for (seed, stream, counter) is a
+// pure function of its inputs, so results don't depend on thread count or
+// iteration order and any element can be generated independently.
+// Mixing is the SplitMix64 finalizer applied to a combined key.
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t counterRandom(uint64_t seed, uint64_t stream, uint64_t counter) {
+    return mix64(mix64(mix64(seed) ^ stream) ^ counter);
+}
+
+// Uniform double in [0, 1)
+inline double counterUniform(uint64_t seed, uint64_t stream, uint64_t counter) {
+    return (counterRandom(seed, stream, counter) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif
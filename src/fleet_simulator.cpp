@@ -0,0 +1,302 @@
+#include "fleet_simulator.h"
+#include "counter_rng.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+
+namespace {
+
+// Independent random streams per simulator component
+enum Stream : uint64_t { ORIGIN_STREAM = 1, DESTINATION_STREAM, DEPARTURE_STREAM, REROUTE_STREAM };
+
+int roadTypeLanes(const std::string& road_type) {
+    if (road_type == "motorway") return 3;
+    if (road_type == "trunk" || road_type == "primary") return 2;
+    return 1;
+}
+
+}  // namespace
+
+FleetSimulator::FleetSimulator(const Graph& graph, FleetSimOptions options)
+    : graph(graph), options(options) {
+    size_t edge_count = graph.edgeCount();
+    size_t node_count = graph.nodeIndexCount();
+
+    {
+        auto current = graph.currentMetric();
+        base_multipliers.resize(edge_count);
+        for (size_t id = 0; id < edge_count; id++) {
+            base_multipliers[id] = current->crowdMultiplier(id);
+        }
+    }
+    metric = {0, base_multipliers};
+    occupancy.assign(edge_count, 0);
+    lane_capacity.resize(edge_count);
+    for (size_t id = 0; id < edge_count; id++) {
+        const Edge& edge = *graph.getEdge(id);
+        lane_capacity[id] = std::max(1.0, options.jam_density * edge.segment->distance / 1000.0 * roadTypeLanes(edge.segment->road_type));
+    }
+
+    // Trips start where a road leaves and end where one arrives
+    std::vector<uint32_t> sources, sinks;
+    for (uint32_t index = 0; index < node_count; index++) {
+        if (graph.getEdgesByIndex(index)) {
+            sources.push_back(index);
+        }
+        if (!graph.getIncomingEdges(index).empty()) {
+            sinks.push_back(index);
+        }
+    }
+
+    size_t n = (sources.empty() || sinks.empty()) ? 0 : options.vehicles;
+    origin.resize(n);
+    destination.resize(n);
+    depart_time.resize(n);
+    expected_time.assign(n, 0.0);
+    state.assign(n, WAITING);
+    current_edge.assign(n, 0);
+    route_pos.assign(n, 0);
+    route_end.assign(n, 0);
+    for (size_t v = 0; v < n; v++) {
+        origin[v] = sources[counterRandom(options.seed, ORIGIN_STREAM, v) % sources.size()];
+        size_t pick = counterRandom(options.seed, DESTINATION_STREAM, v) % sinks.size();
+        destination[v] = sinks[pick];
+        if (destination[v] == origin[v] && sinks.size() > 1) {
+            destination[v] = sinks[(pick + 1) % sinks.size()];
+        }
+        depart_time[v] = (float)(counterUniform(options.seed, DEPARTURE_STREAM, v) * options.departure_window_s);
+    }
+
+    departure_order.resize(n);
+    for (size_t v = 0; v < n; v++) {
+        departure_order[v] = (uint32_t)v;
+    }
+    std::sort(departure_order.begin(), departure_order.end(),
+              [&](uint32_t a, uint32_t b) { return depart_time[a] < depart_time[b]; });
+}
+
+// What the routing policy believes an edge costs
+double FleetSimulator::routeCost(const Edge& edge) const {
+    return graph.edgeWeight(edge, options.policy, options.hour_of_day, metric);
+}
+
+// What driving the edge actually takes right now: the hour's speed, the
+// traffic the run started with, and Greenshields slowdown from the vehicles
+// already on it
+double FleetSimulator::physicalTime(const Edge& edge) const {
+    double congestion = std::max(options.min_multiplier, 1.0 - occupancy[edge.id] / lane_capacity[edge.id]);
+    double speed = graph.getTimeAdjustedSpeed(edge, options.hour_of_day) * base_multipliers[edge.id] * congestion;
+    return edge.segment->distance / (speed * 1000.0 / 3600.0);
+}
+
+// Route every vehicle in the batch in parallel, then splice the results into
+// the route pool in batch order so runs are deterministic for any thread count.
+// from_current routes from the end of the vehicle's current edge and keeps
+// that edge at the head of the new route.
+void FleetSimulator::routeBatch(const std::vector<uint32_t>& batch, bool from_current, FleetSimStats& stats) {
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<SearchWorkspace> workspaces(num_threads);
+    std::vector<std::vector<size_t>> paths(batch.size());
+    std::vector<uint8_t> found(batch.size(), 0);
+
+    parallelForEach(batch.size(), [&](size_t i, unsigned worker) {
+        uint32_t v = batch[i];
+        uint32_t start = from_current ? graph.getEdge(current_edge[v])->to_index : origin[v];
+        if (start == destination[v]) {
+            found[i] = 1;
+            return;
+        }
+        double cost = graph.shortestPath(graph.getNodeId(start), graph.getNodeId(destination[v]), workspaces[worker],
+                                         [&](const Edge& edge) { return routeCost(edge); }, paths[i]);
+        found[i] = cost != std::numeric_limits<double>::infinity();
+    }, num_threads);
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        uint32_t v = batch[i];
+        const std::vector<size_t>& path = paths[i];
+        if (from_current) {
+            // Keep the old plan when the detour search fails or finds the same roads
+            uint32_t remaining = route_end[v] - route_pos[v] - 1;
+            bool same = found[i] && path.size() == remaining &&
+                        std::equal(path.begin(), path.end(), route_pool.begin() + route_pos[v] + 1);
+            if (!found[i] || same) {
+                continue;
+            }
+            stats.routes_changed++;
+            uint32_t begin = (uint32_t)route_pool.size();
+            route_pool.push_back(current_edge[v]);
+            route_pool.insert(route_pool.end(), path.begin(), path.end());
+            route_pos[v] = begin;
+            route_end[v] = (uint32_t)route_pool.size();
+        } else if (!found[i] || path.empty()) {
+            state[v] = UNROUTABLE;
+        } else {
+            route_pos[v] = (uint32_t)route_pool.size();
+            route_pool.insert(route_pool.end(), path.begin(), path.end());
+            route_end[v] = (uint32_t)route_pool.size();
+            double free_flow = 0.0;
+            for (size_t edge_id : path) {
+                const Edge& edge = *graph.getEdge(edge_id);
+                free_flow += edge.segment->distance / (graph.getTimeAdjustedSpeed(edge, options.hour_of_day) *
+                                              base_multipliers[edge_id] * 1000.0 / 3600.0);
+            }
+            expected_time[v] = free_flow;
+        }
+    }
+}
+
+// Greenshields: speed falls linearly with density, reaching zero at jam density
+void FleetSimulator::refreshMetric(FleetSimStats& stats) {
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<double>& multipliers = metric.crowd_multipliers;
+    parallelFor(multipliers.size(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t id = begin; id < end; id++) {
+            double congestion = std::max(options.min_multiplier, 1.0 - occupancy[id] / lane_capacity[id]);
+            multipliers[id] = base_multipliers[id] * congestion;
+        }
+    }, num_threads);
+    metric.version++;
+    for (uint32_t count : occupancy) {
+        stats.peak_occupancy = std::max(stats.peak_occupancy, (double)count);
+    }
+}
+
+// Drop route pool entries no driving vehicle can reach any more
+void FleetSimulator::compactRoutes() {
+    std::vector<uint32_t> compacted;
+    for (size_t v = 0; v < state.size(); v++) {
+        if (state[v] != DRIVING) {
+            continue;
+        }
+        uint32_t begin = (uint32_t)compacted.size();
+        compacted.insert(compacted.end(), route_pool.begin() + route_pos[v], route_pool.begin() + route_end[v]);
+        route_pos[v] = begin;
+        route_end[v] = (uint32_t)compacted.size();
+    }
+    route_pool.swap(compacted);
+}
+
+FleetSimStats FleetSimulator::run() {
+    auto start = std::chrono::steady_clock::now();
+    FleetSimStats stats;
+    size_t n = origin.size();
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    std::vector<double> arrival_time(n, 0.0);
+    size_t next_departure = 0;
+    size_t reroute_round = 0;
+    size_t active = n;   // vehicles not yet arrived or dropped
+
+    events.push({0.0, 0, DEPARTURE_BATCH});
+    events.push({options.metric_interval_s, 0, METRIC_REFRESH});
+    if (options.policy == RouteMode::LEARNED) {
+        // Congestion-blind policies would only find the routes they already have
+        events.push({options.reroute_interval_s, 0, REROUTE});
+    }
+
+    double now = 0.0;
+    while (!events.empty() && active > 0) {
+        Event event = events.top();
+        if (event.time > options.duration_s) {
+            break;
+        }
+        events.pop();
+        now = event.time;
+        stats.events++;
+
+        switch (event.type) {
+            case EDGE_EXIT: {
+                uint32_t v = event.vehicle;
+                occupancy[current_edge[v]]--;
+                if (++route_pos[v] == route_end[v]) {
+                    state[v] = ARRIVED;
+                    arrival_time[v] = now;
+                    stats.arrived++;
+                    active--;
+                    break;
+                }
+                current_edge[v] = route_pool[route_pos[v]];
+                const Edge& edge = *graph.getEdge(current_edge[v]);
+                events.push({now + physicalTime(edge), v, EDGE_EXIT});
+                occupancy[edge.id]++;
+                break;
+            }
+
+            case DEPARTURE_BATCH: {
+                double batch_end = now + options.batch_interval_s;
+                std::vector<uint32_t> batch;
+                while (next_departure < n && depart_time[departure_order[next_departure]] < batch_end) {
+                    batch.push_back(departure_order[next_departure++]);
+                }
+                routeBatch(batch, false, stats);
+                for (uint32_t v : batch) {
+                    if (state[v] == UNROUTABLE) {
+                        stats.unroutable++;
+                        active--;
+                        continue;
+                    }
+                    state[v] = DRIVING;
+                    stats.departed++;
+                    current_edge[v] = route_pool[route_pos[v]];
+                    const Edge& edge = *graph.getEdge(current_edge[v]);
+                    events.push({depart_time[v] + physicalTime(edge), v, EDGE_EXIT});
+                    occupancy[edge.id]++;
+                }
+                if (next_departure < n) {
+                    events.push({batch_end, event.vehicle + 1, DEPARTURE_BATCH});
+                }
+                break;
+            }
+
+            case METRIC_REFRESH:
+                refreshMetric(stats);
+                events.push({now + options.metric_interval_s, 0, METRIC_REFRESH});
+                break;
+
+            case REROUTE: {
+                std::vector<uint32_t> batch;
+                size_t live = 0;
+                for (uint32_t v = 0; v < n; v++) {
+                    if (state[v] != DRIVING) {
+                        continue;
+                    }
+                    live += route_end[v] - route_pos[v];
+                    if (counterUniform(options.seed, REROUTE_STREAM, reroute_round * n + v) < options.reroute_fraction) {
+                        batch.push_back(v);
+                    }
+                }
+                // Replaced routes leave dead entries behind; reclaim them once they dominate
+                if (route_pool.size() > 2 * live + 4096) {
+                    compactRoutes();
+                }
+                routeBatch(batch, true, stats);
+                stats.reroutes += batch.size();
+                reroute_round++;
+                events.push({now + options.reroute_interval_s, 0, REROUTE});
+                break;
+            }
+        }
+    }
+
+    double trip_sum = 0.0, delay_sum = 0.0;
+    for (size_t v = 0; v < n; v++) {
+        if (state[v] == ARRIVED) {
+            double trip = arrival_time[v] - depart_time[v];
+            trip_sum += trip;
+            delay_sum += trip - expected_time[v];
+            stats.vehicle_hours += trip / 3600.0;
+        } else if (state[v] == DRIVING) {
+            stats.still_driving++;
+            stats.vehicle_hours += std::max(0.0, now - depart_time[v]) / 3600.0;
+        }
+    }
+    if (stats.arrived > 0) {
+        stats.mean_trip_s = trip_sum / stats.arrived;
+        stats.mean_delay_s = delay_sum / stats.arrived;
+    }
+    stats.simulated_s = now;
+    stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,95 @@
+#ifndef FLEET_SIMULATOR_H
+#define FLEET_SIMULATOR_H
+
+#include "graph.h"
+#include <cstdint>
+#include <vector>
+
+struct FleetSimOptions {
+    size_t vehicles = 100000;
+    RouteMode policy = RouteMode::LEARNED;
+    uint64_t seed = 42;                // origins, destinations and departure times
+    int hour_of_day = 17;
+    double departure_window_s = 1800.0; // departures spread uniformly over this window
+    double duration_s = 7200.0;        // simulated time limit
+    double batch_interval_s = 10.0;    // departures are routed together in batches this long
+    double metric_interval_s = 60.0;   // occupancy -> multipliers refresh
+    double reroute_interval_s = 300.0;
+    double reroute_fraction = 0.25;    // share of driving vehicles rerouted per reroute round
+    double jam_density = 120.0;        // vehicles per km per lane at standstill
+    double min_multiplier = 0.05;
+    unsigned threads = 0;              // 0 = all hardware threads
+};
+
+struct FleetSimStats {
+    size_t departed = 0;
+    size_t arrived = 0;
+    size_t unroutable = 0;
+    size_t still_driving = 0;          // when the time limit was hit
+    size_t reroutes = 0;
+    size_t routes_changed = 0;
+    size_t events = 0;
+    double mean_trip_s = 0.0;          // over arrived vehicles
+    double mean_delay_s = 0.0;         // trip time minus the uncongested estimate at departure
+    double vehicle_hours = 0.0;
+    double peak_occupancy = 0.0;       // most vehicles on one edge at a metric refresh
+    double simulated_s = 0.0;
+    double wall_seconds = 0.0;
+};
+
+// Discrete-event simulation of a fleet that congests the roads it uses.
+//
+// Vehicles drive their routes edge by edge; each edge exit is an event in a
+// time-ordered queue. Edge occupancy feeds a Greenshields speed-density
+// model whose multipliers are refreshed periodically and routed against by
+// LEARNED vehicles, so the routing policy's own load comes back as
+// congestion. Departures and periodic reroutes are routed in parallel
+// batches with per-worker workspaces. Vehicle state lives in flat arrays
+// (one entry per vehicle) and routes in one shared edge pool, so the event
+// loop touches a few cache lines per event.
+class FleetSimulator {
+public:
+    FleetSimulator(const Graph& graph, FleetSimOptions options = {});
+
+    FleetSimStats run();
+
+    // Congestion multipliers at the end of the run, by edge id
+    const std::vector<double>& multipliers() const { return metric.crowd_multipliers; }
+
+private:
+    enum EventType : uint8_t { EDGE_EXIT, DEPARTURE_BATCH, METRIC_REFRESH, REROUTE };
+    enum VehicleState : uint8_t { WAITING, DRIVING, ARRIVED, UNROUTABLE };
+
+    struct Event {
+        double time;
+        uint32_t vehicle;   // or batch number
+        EventType type;
+        bool operator>(const Event& other) const { return time > other.time; }
+    };
+
+    const Graph& graph;
+    FleetSimOptions options;
+
+    // Vehicle state, structure of arrays
+    std::vector<uint32_t> origin, destination;
+    std::vector<float> depart_time;
+    std::vector<double> expected_time;     // uncongested trip estimate
+    std::vector<uint8_t> state;
+    std::vector<uint32_t> current_edge;
+    std::vector<uint32_t> route_pos, route_end;   // into route_pool
+    std::vector<uint32_t> route_pool;             // edge ids of all planned routes
+
+    std::vector<uint32_t> departure_order;        // vehicles sorted by departure time
+    std::vector<uint32_t> occupancy;              // vehicles on each edge
+    std::vector<double> base_multipliers;         // graph traffic when the run started
+    std::vector<double> lane_capacity;            // jam capacity of each edge, vehicles
+    MetricSnapshot metric;                        // base traffic x simulated congestion
+
+    double routeCost(const Edge& edge) const;
+    double physicalTime(const Edge& edge) const;
+    void routeBatch(const std::vector<uint32_t>& batch, bool from_current, FleetSimStats& stats);
+    void refreshMetric(FleetSimStats& stats);
+    void compactRoutes();
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef GEO_H
+#define GEO_H
+
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Great-circle distance between two lat/lon points in meters
+inline double haversineDistance(double lat1, double lon1, double lat2, double lon2) {
+    const double R = 6371000.0; // Earth radius in meters
+    double dLat = (lat2 - lat1) * M_PI / 180.0;
+    double dLon = (lon2 - lon1) * M_PI / 180.0;
+    
+    double a = sin(dLat/2) * sin(dLat/2) +
+               cos(lat1 * M_PI / 180.0) * cos(lat2 * M_PI / 180.0) *
+               sin(dLon/2) * sin(dLon/2);
+    double c = 2 * atan2(sqrt(a), sqrt(1-a));
+    
+    return R * c;
+}
+
+#endif
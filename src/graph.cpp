@@ -1,34 +1,156 @@
 #include "graph.h"
+#include "counter_rng.h"
+#include "parallel.h"
+#include "speed_profile.h"
 #include <iostream>
 #include <queue>
 #include <cmath>
 #include <algorithm>
-#include <random>
+#include <atomic>
+#include <unordered_set>
 
 void Graph::addNode(long long id, double lat, double lon) {
     nodes[id] = {id, lat, lon};
+    uint32_t index = internNode(id);
+    node_coords[2 * index] = lat;
+    node_coords[2 * index + 1] = lon;
 }
 
-void Graph::addEdge(long long from, long long to, double distance, 
-                    const std::string& road_type) {
-    // Default speed limits by road type (km/h)
-    double speed_limit = 50.0; // default
-    
+uint32_t Graph::internNode(long long id) {
+    auto it = node_indices.find(id);
+    if (it != node_indices.end()) {
+        return it->second;
+    }
+    uint32_t index = (uint32_t)node_ids.size();
+    node_indices.emplace(id, index);
+    node_ids.push_back(id);
+    node_coords.resize(node_coords.size() + 2, std::numeric_limits<double>::quiet_NaN());
+    adjacency_by_index.push_back(nullptr);
+    incoming_by_index.emplace_back();
+    return index;
+}
+
+namespace {
+
+// Highway values no avoidance option applies to; they would only use up bits
+bool isNonDrivableRoadType(const std::string& road_type) {
+    return road_type == "footway" || road_type == "path" || road_type == "cycleway" ||
+           road_type == "pedestrian" || road_type == "steps" || road_type == "bridleway" ||
+           road_type == "corridor";
+}
+
+}  // namespace
+
+uint8_t Graph::internRoadClass(const std::string& road_type, bool toll) {
+    std::string key = toll ? road_type + "|toll" : road_type;
+    auto it = road_class_ids.find(key);
+    if (it != road_class_ids.end()) {
+        return it->second;
+    }
+    if (isNonDrivableRoadType(road_type)) {
+        road_class_ids.emplace(key, kSharedRoadClass);
+        return kSharedRoadClass;
+    }
+    // Real extracts have a few dozen drivable classes; count any that don't fit
+    if (road_class_types.size() == kSharedRoadClass) {
+        road_class_overflow++;
+        road_class_ids.emplace(key, kSharedRoadClass);
+        return kSharedRoadClass;
+    }
+    uint8_t road_class = (uint8_t)road_class_types.size();
+    road_class_ids.emplace(key, road_class);
+    road_class_types.push_back(road_type);
+    road_class_tolls.push_back(toll);
+    return road_class;
+}
+
+uint64_t Graph::roadTypeMask(const std::string& road_type) const {
+    uint64_t mask = 0;
+    for (size_t c = 0; c < road_class_types.size(); c++) {
+        if (road_class_types[c] == road_type) {
+            mask |= 1ULL << c;
+        }
+    }
+    return mask;
+}
+
+uint64_t Graph::avoidMask(unsigned avoid_flags) const {
+    uint64_t mask = 0;
+    for (size_t c = 0; c < road_class_types.size(); c++) {
+        const std::string& type = road_class_types[c];
+        bool avoided = false;
+        if (avoid_flags & AVOID_MOTORWAYS) {
+            avoided |= type == "motorway" || type == "motorway_link" ||
+                       type == "trunk" || type == "trunk_link";
+        }
+        if (avoid_flags & AVOID_TOLLS) {
+            avoided |= road_class_tolls[c];
+        }
+        if (avoid_flags & AVOID_RESIDENTIAL) {
+            avoided |= type == "residential" || type == "living_street" || type == "service";
+        }
+        if (avoided) {
+            mask |= 1ULL << c;
+        }
+    }
+    return mask;
+}
+
+bool Graph::getNodeIndex(long long id, uint32_t& index) const {
+    auto it = node_indices.find(id);
+    if (it == node_indices.end()) {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+double Graph::defaultSpeedLimit(const std::string& road_type) {
     if (road_type == "motorway" || road_type == "motorway_link") {
-        speed_limit = 100.0;
+        return 100.0;
     } else if (road_type == "trunk" || road_type == "trunk_link") {
-        speed_limit = 80.0;
+        return 80.0;
     } else if (road_type == "primary" || road_type == "primary_link") {
-        speed_limit = 65.0;
+        return 65.0;
     } else if (road_type == "secondary") {
-        speed_limit = 55.0;
+        return 55.0;
     } else if (road_type == "tertiary" || road_type == "residential") {
-        speed_limit = 40.0;
+        return 40.0;
     } else if (road_type == "living_street") {
-        speed_limit = 20.0;
+        return 20.0;
     }
+    return 50.0;
+}
+
+void Graph::addEdge(long long from, long long to, double distance, 
+                    const std::string& road_type, const EdgeOrigin& origin, bool toll) {
+    segments.push_back({distance, defaultSpeedLimit(road_type), road_type});
+    addDirectedEdge(from, to, &segments.back(), origin, internRoadClass(road_type, toll));
+}
+
+void Graph::addRoad(long long a, long long b, double distance, const std::string& road_type,
+                    long long way_id, int segment, bool toll) {
+    segments.push_back({distance, defaultSpeedLimit(road_type), road_type});
+    uint8_t road_class = internRoadClass(road_type, toll);
+    addDirectedEdge(a, b, &segments.back(), {way_id, segment, true}, road_class);
+    addDirectedEdge(b, a, &segments.back(), {way_id, segment, false}, road_class);
+}
+
+void Graph::addDirectedEdge(long long from, long long to, const RoadSegment* segment,
+                            const EdgeOrigin& origin, uint8_t road_class) {
+    uint32_t from_index = internNode(from);
+    uint32_t to_index = internNode(to);
     
-    adjacency_list[from].push_back({to, distance, speed_limit, road_type, 1.0});
+    auto& edges = adjacency_list[from];
+    adjacency_by_index[from_index] = &edges;
+    edge_slots.push_back({from, edges.size()});
+    edge_origins.push_back(origin);
+    edge_source_indices.push_back(from_index);
+    incoming_by_index[to_index].push_back(next_edge_id);
+    if ((next_edge_id & 63) == 0) {
+        closed_words.emplace_back(0);
+    }
+    edges.push_back({to, segment, next_edge_id++, to_index, road_class});
 }
 
 const Node* Graph::getNode(long long id) const {
@@ -41,59 +163,136 @@ const std::vector<Edge>* Graph::getEdges(long long id) const {
     return (it != adjacency_list.end()) ? &(it->second) : nullptr;
 }
 
-size_t Graph::edgeCount() const {
-    size_t count = 0;
-    for (const auto& pair : adjacency_list) {
-        count += pair.second.size();
+const Edge* Graph::getEdge(size_t edge_id) const {
+    if (edge_id >= edge_slots.size()) {
+        return nullptr;
+    }
+    const auto& slot = edge_slots[edge_id];
+    return &adjacency_list.at(slot.first)[slot.second];
+}
+
+uint64_t Graph::publishMetric(std::vector<double> crowd_multipliers) {
+    crowd_multipliers.resize(next_edge_id, 1.0);
+    return metric_store.publish(std::move(crowd_multipliers));
+}
+
+bool Graph::closeEdge(size_t edge_id) {
+    uint64_t bit = 1ULL << (edge_id & 63);
+    if (closed_words[edge_id >> 6].fetch_or(bit) & bit) {
+        return false;
+    }
+    closed_count.fetch_add(1);
+    closure_version.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool Graph::reopenEdge(size_t edge_id) {
+    uint64_t bit = 1ULL << (edge_id & 63);
+    if (!(closed_words[edge_id >> 6].fetch_and(~bit) & bit)) {
+        return false;
+    }
+    closed_count.fetch_sub(1);
+    closure_version.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void Graph::reopenAllEdges() {
+    for (auto& word : closed_words) {
+        word.store(0);
     }
-    return count;
+    closed_count.store(0);
+    closure_version.fetch_add(1, std::memory_order_release);
 }
 
 void Graph::printStats() const {
     std::cout << "Graph Statistics:\n";
     std::cout << "  Nodes: " << nodeCount() << "\n";
     std::cout << "  Edges: " << edgeCount() << "\n";
+    if (road_class_overflow > 0) {
+        std::cout << "  Road classes: " << roadClassCount() << " (" << road_class_overflow
+                  << " more share one bit and can't be avoided)\n";
+    }
 }
 
 // Simulate learned patterns from crowd-sourced data
-void Graph::applyLearnedPatterns() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
+void Graph::applyLearnedPatterns(uint64_t seed) {
+    // Each roll is keyed by (seed, edge id, roll), so the outcome is the same
+    // on every run and for any number of threads
+    enum Roll : uint64_t { CONGESTION, SHORTCUT, PARALLEL_ROUTE };
+    
+    std::atomic<int> shortcuts_found{0};
+    std::atomic<int> congestion_points{0};
     
-    int shortcuts_found = 0;
-    int congestion_points = 0;
+    // Build the next snapshot from a copy; the published one stays untouched
+    std::vector<double> multipliers;
+    {
+        auto metric = currentMetric();
+        multipliers = metric->crowd_multipliers;
+    }
+    multipliers.resize(next_edge_id, 1.0);
     
-    for (auto& node_pair : adjacency_list) {
-        for (auto& edge : node_pair.second) {
+    parallelFor(next_edge_id, [&](size_t begin, size_t end, unsigned) {
+        int shortcuts = 0;
+        int congestion = 0;
+        for (size_t id = begin; id < end; id++) {
+            const Edge& edge = *getEdge(id);
+            
             // Motorways and trunks sometimes have hidden congestion
-            if ((edge.road_type == "motorway" || edge.road_type == "trunk") && dis(gen) < 0.05) {
-                edge.crowd_multiplier = 0.6;  // 40% slower than expected (congestion)
-                congestion_points++;
+            if ((edge.segment->road_type == "motorway" || edge.segment->road_type == "trunk") &&
+                counterUniform(seed, id, CONGESTION) < 0.05) {
+                multipliers[id] = 0.6;  // 40% slower than expected (congestion)
+                congestion++;
             }
             
             // Some primary/secondary roads are "local shortcuts" - faster than expected
-            if ((edge.road_type == "primary" || edge.road_type == "secondary") && dis(gen) < 0.03) {
-                edge.crowd_multiplier = 1.4;  // 40% faster (local knowledge)
-                shortcuts_found++;
+            if ((edge.segment->road_type == "primary" || edge.segment->road_type == "secondary") &&
+                counterUniform(seed, id, SHORTCUT) < 0.03) {
+                multipliers[id] = 1.4;  // 40% faster (local knowledge)
+                shortcuts++;
             }
             
             // Residential streets near motorways might be shortcuts
-            if (edge.road_type == "residential" && dis(gen) < 0.02) {
-                edge.crowd_multiplier = 1.2;  // 20% faster (parallel route)
-                shortcuts_found++;
+            if (edge.segment->road_type == "residential" && counterUniform(seed, id, PARALLEL_ROUTE) < 0.02) {
+                multipliers[id] = 1.2;  // 20% faster (parallel route)
+                shortcuts++;
             }
         }
-    }
+        shortcuts_found += shortcuts;
+        congestion_points += congestion;
+    });
+    
+    publishMetric(std::move(multipliers));
     
     std::cout << "\nApplied crowd-sourced learning patterns:\n";
     std::cout << "  Hidden shortcuts discovered: " << shortcuts_found << "\n";
     std::cout << "  Congestion points identified: " << congestion_points << "\n";
 }
 
-// Calculate time-adjusted speed based on hour of day
+void Graph::setSpeedProfiles(std::shared_ptr<const SpeedProfileStore> profiles) {
+    speed_profiles = std::move(profiles);
+}
+
 double Graph::getTimeAdjustedSpeed(const Edge& edge, int hour_of_day) const {
-    double base_speed = edge.speed_limit;
+    // Edges added after the store was built fall back to the built-in model
+    if (speed_profiles && edge.id < speed_profiles->edgeCount()) {
+        // Wrap any hour, negative ones included, into the day's slots
+        int slot = ((hour_of_day % 24) + 24) % 24 * (kSlotsPerDay / 24);
+        return edge.segment->speed_limit * speed_profiles->hourFactor(edge.id, slot);
+    }
+    return getRushHourSpeed(edge, hour_of_day);
+}
+
+double Graph::getSlotSpeed(const Edge& edge, int slot) const {
+    slot = ((slot % kSlotsPerDay) + kSlotsPerDay) % kSlotsPerDay;
+    if (speed_profiles && edge.id < speed_profiles->edgeCount()) {
+        return edge.segment->speed_limit * speed_profiles->factor(edge.id, slot);
+    }
+    return getRushHourSpeed(edge, slot * 24 / kSlotsPerDay);
+}
+
+// Calculate time-adjusted speed based on hour of day
+double Graph::getRushHourSpeed(const Edge& edge, int hour_of_day) const {
+    double base_speed = edge.segment->speed_limit;
     
     // Morning rush hour (7-9 AM)
     bool morning_rush = (hour_of_day >= 7 && hour_of_day <= 9);
@@ -101,11 +300,11 @@ double Graph::getTimeAdjustedSpeed(const Edge& edge, int hour_of_day) const {
     bool evening_rush = (hour_of_day >= 17 && hour_of_day <= 19);
     
     if (morning_rush || evening_rush) {
-        if (edge.road_type == "motorway" || edge.road_type == "trunk") {
+        if (edge.segment->road_type == "motorway" || edge.segment->road_type == "trunk") {
             base_speed *= 0.4;  // Highways 60% slower in rush hour
-        } else if (edge.road_type == "primary") {
+        } else if (edge.segment->road_type == "primary") {
             base_speed *= 0.6;  // Major roads 40% slower
-        } else if (edge.road_type == "secondary" || edge.road_type == "tertiary") {
+        } else if (edge.segment->road_type == "secondary" || edge.segment->road_type == "tertiary") {
             base_speed *= 0.8;  // Minor roads only 20% slower
         }
         // Residential streets mostly unaffected
@@ -115,29 +314,37 @@ double Graph::getTimeAdjustedSpeed(const Edge& edge, int hour_of_day) const {
 }
 
 // Calculate edge weight based on routing mode
-double Graph::calculateEdgeWeight(const Edge& edge, RouteMode mode, int hour_of_day) const {
+double Graph::calculateEdgeWeight(const Edge& edge, RouteMode mode, int hour_of_day,
+                                  const MetricSnapshot& metric) const {
     switch (mode) {
         case RouteMode::DISTANCE:
             // Pure distance - no speed consideration
-            return edge.distance;
+            return edge.segment->distance;
             
         case RouteMode::SPEED_LIMIT:
             // Traditional GPS: distance / speed limit (in m/s)
-            return edge.distance / (edge.speed_limit * 1000.0 / 3600.0);
+            return edge.segment->distance / (edge.segment->speed_limit * 1000.0 / 3600.0);
             
         case RouteMode::LEARNED: {
             // Advanced: time-aware + crowd-sourced data
             double adjusted_speed = getTimeAdjustedSpeed(edge, hour_of_day);
-            adjusted_speed *= edge.crowd_multiplier;  // Apply learned patterns
-            return edge.distance / (adjusted_speed * 1000.0 / 3600.0);
+            adjusted_speed *= metric.crowdMultiplier(edge.id);  // Apply learned patterns
+            return edge.segment->distance / (adjusted_speed * 1000.0 / 3600.0);
         }
     }
-    return edge.distance;
+    return edge.segment->distance;
 }
 
 // Enhanced Dijkstra with routing modes
 RouteResult Graph::dijkstra(long long start_id, long long end_id, 
-                            RouteMode mode, int hour_of_day) const {
+                            RouteMode mode, int hour_of_day, uint64_t avoided_classes) const {
+    // Hold the snapshot for the whole query so a concurrent publish can't
+    // change weights halfway through the search
+    auto metric = currentMetric();
+    return dijkstra(start_id, end_id, *metric, mode, hour_of_day, avoided_classes);
+}
+
+RouteResult Graph::emptyRoute(RouteMode mode) {
     RouteResult result;
     result.mode = mode;
     result.total_distance = 0.0;
@@ -155,75 +362,188 @@ RouteResult Graph::dijkstra(long long start_id, long long end_id,
             result.mode_name = "Learned Patterns (Advanced)";
             break;
     }
+    return result;
+}
+
+void Graph::completeRoute(long long start_id, RouteResult& result, int hour_of_day,
+                          const MetricSnapshot& metric) const {
+    result.path = pathNodes(start_id, result.edge_path);
     
-    std::unordered_map<long long, double> distances;
-    std::unordered_map<long long, long long> previous;
+    // Calculate actual distance and time
+    for (size_t edge_id : result.edge_path) {
+        const Edge& edge = *getEdge(edge_id);
+        result.total_distance += edge.segment->distance;
+        
+        // Calculate time based on learned speed
+        double speed = getTimeAdjustedSpeed(edge, hour_of_day) * metric.crowdMultiplier(edge.id);
+        result.estimated_time += edge.segment->distance / (speed * 1000.0 / 3600.0);
+    }
+}
+
+RouteResult Graph::dijkstra(long long start_id, long long end_id,
+                            const MetricSnapshot& metric,
+                            RouteMode mode, int hour_of_day, uint64_t avoided_classes) const {
+    RouteResult result = emptyRoute(mode);
     
-    for (const auto& node_pair : nodes) {
-        distances[node_pair.first] = std::numeric_limits<double>::infinity();
+    // Array-based search in a per-thread workspace that is reused across queries
+    static thread_local SearchWorkspace workspace;
+    auto weight = [&](const Edge& edge) {
+        return calculateEdgeWeight(edge, mode, hour_of_day, metric);
+    };
+    double cost = avoided_classes == 0
+        ? shortestPath(start_id, end_id, workspace, weight, result.edge_path)
+        : shortestPath(start_id, end_id, workspace, weight, result.edge_path,
+                       RoadClassFilter{avoided_classes});
+    
+    if (cost == std::numeric_limits<double>::infinity()) {
+        return result;  // No path found
+    }
+    completeRoute(start_id, result, hour_of_day, metric);
+    return result;
+}
+
+std::vector<RouteResult> Graph::dijkstraMany(long long start_id, const std::vector<long long>& end_ids,
+                                             const MetricSnapshot& metric,
+                                             RouteMode mode, int hour_of_day,
+                                             uint64_t avoided_classes) const {
+    static thread_local SearchWorkspace workspace;
+    auto weight = [&](const Edge& edge) {
+        return calculateEdgeWeight(edge, mode, hour_of_day, metric);
+    };
+    std::vector<double> costs;
+    if (avoided_classes == 0) {
+        oneToMany(start_id, end_ids, workspace, weight, costs);
+    } else {
+        oneToMany(start_id, end_ids, workspace, weight, costs, RoadClassFilter{avoided_classes});
     }
-    distances[start_id] = 0.0;
+    
+    // Settled nodes keep their final tree edge, so every reached end's path
+    // can be read back from the one search
+    std::vector<RouteResult> results(end_ids.size(), emptyRoute(mode));
+    uint32_t source = 0;
+    getNodeIndex(start_id, source);
+    for (size_t i = 0; i < end_ids.size(); i++) {
+        uint32_t target;
+        if (costs[i] == std::numeric_limits<double>::infinity() || !getNodeIndex(end_ids[i], target)) {
+            continue;
+        }
+        RouteResult& result = results[i];
+        for (uint32_t node = target; node != source;) {
+            size_t edge_id = workspace.parentEdge(node);
+            result.edge_path.push_back(edge_id);
+            node = edge_source_indices[edge_id];
+        }
+        std::reverse(result.edge_path.begin(), result.edge_path.end());
+        completeRoute(start_id, result, hour_of_day, metric);
+    }
+    return results;
+}
+
+std::vector<long long> Graph::pathNodes(long long start_id, const std::vector<size_t>& edge_path) const {
+    std::vector<long long> path;
+    path.reserve(edge_path.size() + 1);
+    path.push_back(start_id);
+    for (size_t edge_id : edge_path) {
+        path.push_back(getEdge(edge_id)->to);
+    }
+    return path;
+}
+
+std::vector<double> Graph::boundedDistances(long long source, const std::vector<long long>& targets,
+                                            double max_distance) const {
+    const double inf = std::numeric_limits<double>::infinity();
+    std::unordered_map<long long, double> distances;
+    std::unordered_set<long long> remaining(targets.begin(), targets.end());
     
     using PQElement = std::pair<double, long long>;
     std::priority_queue<PQElement, std::vector<PQElement>, std::greater<PQElement>> pq;
-    pq.push({0.0, start_id});
+    distances[source] = 0.0;
+    pq.push({0.0, source});
     
-    while (!pq.empty()) {
+    while (!pq.empty() && !remaining.empty()) {
         auto [current_dist, current_id] = pq.top();
         pq.pop();
         
-        if (current_id == end_id) {
-            break;
-        }
-        
         if (current_dist > distances[current_id]) {
             continue;
         }
+        remaining.erase(current_id);
         
         const auto* edges = getEdges(current_id);
         if (edges) {
             for (const auto& edge : *edges) {
-                double weight = calculateEdgeWeight(edge, mode, hour_of_day);
-                double new_dist = current_dist + weight;
-                
-                if (new_dist < distances[edge.to]) {
+                double new_dist = current_dist + edge.segment->distance;
+                if (new_dist > max_distance) {
+                    continue;
+                }
+                auto it = distances.find(edge.to);
+                if (it == distances.end() || new_dist < it->second) {
                     distances[edge.to] = new_dist;
-                    previous[edge.to] = current_id;
                     pq.push({new_dist, edge.to});
                 }
             }
         }
     }
     
-    // Reconstruct path
-    if (distances[end_id] == std::numeric_limits<double>::infinity()) {
-        return result;  // No path found
+    std::vector<double> result;
+    result.reserve(targets.size());
+    for (long long target : targets) {
+        auto it = distances.find(target);
+        result.push_back(it != distances.end() && !remaining.count(target) ? it->second : inf);
     }
+    return result;
+}
+
+bool Graph::boundedEdgePath(long long source, long long target, double max_distance,
+                            std::vector<size_t>& edge_path) const {
+    edge_path.clear();
+    std::unordered_map<long long, double> distances;
+    std::unordered_map<long long, size_t> previous_edge;
     
-    long long current = end_id;
-    while (current != start_id) {
-        result.path.push_back(current);
-        current = previous[current];
-    }
-    result.path.push_back(start_id);
-    std::reverse(result.path.begin(), result.path.end());
+    using PQElement = std::pair<double, long long>;
+    std::priority_queue<PQElement, std::vector<PQElement>, std::greater<PQElement>> pq;
+    distances[source] = 0.0;
+    pq.push({0.0, source});
     
-    // Calculate actual distance and time
-    for (size_t i = 0; i < result.path.size() - 1; i++) {
-        const auto* edges = getEdges(result.path[i]);
+    bool found = false;
+    while (!pq.empty()) {
+        auto [current_dist, current_id] = pq.top();
+        pq.pop();
+        
+        if (current_id == target) {
+            found = true;
+            break;
+        }
+        if (current_dist > distances[current_id]) {
+            continue;
+        }
+        
+        const auto* edges = getEdges(current_id);
         if (edges) {
             for (const auto& edge : *edges) {
-                if (edge.to == result.path[i + 1]) {
-                    result.total_distance += edge.distance;
-                    
-                    // Calculate time based on learned speed
-                    double speed = getTimeAdjustedSpeed(edge, hour_of_day) * edge.crowd_multiplier;
-                    result.estimated_time += edge.distance / (speed * 1000.0 / 3600.0);
-                    break;
+                double new_dist = current_dist + edge.segment->distance;
+                if (new_dist > max_distance) {
+                    continue;
+                }
+                auto it = distances.find(edge.to);
+                if (it == distances.end() || new_dist < it->second) {
+                    distances[edge.to] = new_dist;
+                    previous_edge[edge.to] = edge.id;
+                    pq.push({new_dist, edge.to});
                 }
             }
         }
     }
+    if (!found) {
+        return false;
+    }
     
-    return result;
-}
\ No newline at end of file
+    long long current = target;
+    while (current != source) {
+        size_t edge_id = previous_edge[current];
+        edge_path.push_back(edge_id);
+        current = getEdgeSource(edge_id);
+    }
+    std::reverse(edge_path.begin(), edge_path.end());
+    return true;
+}
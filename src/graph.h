@@ -1,10 +1,23 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include "metric_snapshot.h"
+#include "search_workspace.h"
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+// Historical traffic is tracked in fifteen-minute slots
+constexpr int kSlotsPerDay = 96;
+constexpr int kSecondsPerSlot = 24 * 3600 / kSlotsPerDay;
+
+class SpeedProfileStore;
 
 struct Node {
     long long id;
@@ -12,12 +25,64 @@ struct Node {
     double lon;
 };
 
-struct Edge {
-    long long to;
+// Attributes of a road segment, stored once and shared by both of its
+// directed edges
+struct RoadSegment {
     double distance;           // meters
     double speed_limit;        // km/h
     std::string road_type;     // motorway, primary, residential, etc.
-    double crowd_multiplier;   // learned speed adjustment (1.0 = normal, 1.3 = 30% faster)
+};
+
+// One direction of a segment as it appears in an adjacency list. Only what
+// the search kernel needs besides the weight lives here; the attributes are
+// one pointer away and shared with the reverse direction.
+struct Edge {
+    long long to;
+    const RoadSegment* segment;
+    size_t id;                 // dense edge index into MetricSnapshot arrays
+    uint32_t to_index;         // dense index of the target node
+    uint8_t road_class;        // interned (road_type, toll) pair, bit index for avoidance masks
+};
+
+// Road class of footpaths, cycleways and steps, and of any (road_type, toll)
+// pair past the first 63: never avoided, and its road type has to be read
+// from the edge's segment
+constexpr uint8_t kSharedRoadClass = 63;
+
+// Avoidance options, turned into a road-class mask by Graph::avoidMask
+enum AvoidFlags : unsigned {
+    AVOID_NONE = 0,
+    AVOID_MOTORWAYS = 1 << 0,     // motorway, trunk and their links
+    AVOID_TOLLS = 1 << 1,
+    AVOID_RESIDENTIAL = 1 << 2,   // residential, living_street, service
+};
+
+// Edge filters for the search kernel. NoRoadFilter compiles away, so the
+// default path pays nothing; RoadClassFilter is a single bit test.
+struct NoRoadFilter {
+    bool allows(const Edge&) const { return true; }
+};
+
+struct RoadClassFilter {
+    uint64_t avoided_classes;
+    bool allows(const Edge& edge) const { return !((avoided_classes >> edge.road_class) & 1); }
+};
+
+// Where an edge came from in the OSM data: segment i of a way joins its
+// i-th and (i+1)-th node refs. Stable across re-parses of the same extract.
+struct EdgeOrigin {
+    long long way_id = 0;      // 0 = not from a way
+    int segment = -1;
+    bool forward = true;       // false for the reverse direction of a two-way segment
+};
+
+// OSM turn restriction relation (from way, via node, to way). "no_*"
+// forbids that turn; "only_*" forbids every other exit from the from way.
+struct TurnRestriction {
+    long long from_way;
+    long long via_node;
+    long long to_way;
+    bool only;
 };
 
 enum class RouteMode {
@@ -28,6 +93,7 @@ enum class RouteMode {
 
 struct RouteResult {
     std::vector<long long> path;
+    std::vector<size_t> edge_path;   // edge ids between consecutive path nodes
     double total_distance;     // meters
     double estimated_time;     // seconds
     RouteMode mode;
@@ -38,30 +104,353 @@ class Graph {
 private:
     std::unordered_map<long long, Node> nodes;
     std::unordered_map<long long, std::vector<Edge>> adjacency_list;
+    std::deque<RoadSegment> segments;                      // deque: edges point into it as it grows
+    std::vector<std::pair<long long, size_t>> edge_slots;  // edge id -> (source node, position)
+    std::vector<EdgeOrigin> edge_origins;                  // by edge id
+    std::vector<TurnRestriction> turn_restrictions;        // as parsed; resolved to edges by TurnRouter
+    std::vector<uint32_t> edge_source_indices;             // by edge id
+    size_t next_edge_id = 0;
     
-    double calculateEdgeWeight(const Edge& edge, RouteMode mode, int hour_of_day) const;
-    double getTimeAdjustedSpeed(const Edge& edge, int hour_of_day) const;
+    // Dense node indices for array-based searches. unordered_map never moves
+    // its elements, so the adjacency pointers stay valid as the graph grows.
+    std::unordered_map<long long, uint32_t> node_indices;
+    std::vector<long long> node_ids;                       // by node index
+    std::vector<double> node_coords;                       // lat, lon pairs by node index (NaN until addNode)
+    std::vector<const std::vector<Edge>*> adjacency_by_index;
+    std::vector<std::vector<size_t>> incoming_by_index;    // edge ids ending at each node
+    
+    // Learned crowd multipliers live outside the edges so they can be
+    // republished while queries are running
+    MetricStore metric_store;
+    
+    // Closed edges, one bit per edge id. Toggled with atomic bit operations so
+    // incidents can be applied while queries run; deque because atomics can't
+    // be moved when the container grows.
+    std::deque<std::atomic<uint64_t>> closed_words;
+    std::atomic<size_t> closed_count{0};
+    std::atomic<uint64_t> closure_version{0};              // bumped on every change
+    
+    // Road classes: each distinct drivable (road_type, toll) pair gets a bit,
+    // up to 63; the rest share kSharedRoadClass
+    std::vector<std::string> road_class_types;
+    std::vector<bool> road_class_tolls;
+    std::unordered_map<std::string, uint8_t> road_class_ids;
+    size_t road_class_overflow = 0;   // drivable pairs that found no free bit
+    
+    // Historical per-slot speeds; replaces the built-in rush-hour model when set
+    std::shared_ptr<const SpeedProfileStore> speed_profiles;
+    
+    double calculateEdgeWeight(const Edge& edge, RouteMode mode, int hour_of_day,
+                               const MetricSnapshot& metric) const;
+    
+    // Empty result for a mode, and the node path, distance and time of a found one
+    static RouteResult emptyRoute(RouteMode mode);
+    void completeRoute(long long start_id, RouteResult& result, int hour_of_day,
+                       const MetricSnapshot& metric) const;
+    
+    uint32_t internNode(long long id);
+    void addDirectedEdge(long long from, long long to, const RoadSegment* segment,
+                         const EdgeOrigin& origin, uint8_t road_class);
+    uint8_t internRoadClass(const std::string& road_type, bool toll);
 
 public:
     void addNode(long long id, double lat, double lon);
+    
+    // A single directed edge with a segment of its own
     void addEdge(long long from, long long to, double distance, 
-                 const std::string& road_type = "unclassified");
+                 const std::string& road_type = "unclassified",
+                 const EdgeOrigin& origin = EdgeOrigin(), bool toll = false);
+    
+    // Two-way segment i of a way (a = its i-th node ref): one shared
+    // RoadSegment, a forward edge a -> b and a backward edge b -> a
+    void addRoad(long long a, long long b, double distance, const std::string& road_type,
+                 long long way_id, int segment, bool toll = false);
+    
+    // Default speed limit (km/h) of a road type
+    static double defaultSpeedLimit(const std::string& road_type);
+    
+    size_t segmentCount() const { return segments.size(); }
+    void addTurnRestriction(const TurnRestriction& restriction) { turn_restrictions.push_back(restriction); }
+    const std::vector<TurnRestriction>& getTurnRestrictions() const { return turn_restrictions; }
     
     const Node* getNode(long long id) const;
     const std::vector<Edge>* getEdges(long long id) const;
     
+    // Lookup by dense edge id (valid until more edges are added)
+    const Edge* getEdge(size_t edge_id) const;
+    long long getEdgeSource(size_t edge_id) const { return edge_slots[edge_id].first; }
+    const EdgeOrigin& getEdgeOrigin(size_t edge_id) const { return edge_origins[edge_id]; }
+    
+    // Dense node indices in [0, nodeIndexCount()), for per-node arrays
+    bool getNodeIndex(long long id, uint32_t& index) const;
+    long long getNodeId(uint32_t index) const { return node_ids[index]; }
+    double getNodeLat(uint32_t index) const { return node_coords[2 * index]; }
+    double getNodeLon(uint32_t index) const { return node_coords[2 * index + 1]; }
+    uint32_t getEdgeSourceIndex(size_t edge_id) const { return edge_source_indices[edge_id]; }
+    size_t nodeIndexCount() const { return node_ids.size(); }
+    const std::vector<Edge>* getEdgesByIndex(uint32_t index) const { return adjacency_by_index[index]; }
+    const std::vector<size_t>& getIncomingEdges(uint32_t index) const { return incoming_by_index[index]; }
+    
+    // Expected speed (km/h) on an edge at a given hour, before crowd data.
+    // Uses the attached speed profiles, or the built-in rush-hour model.
+    // Queries are hour-based, so with profiles this is the average speed
+    // over the hour's four 15-minute slots; getSlotSpeed reads one slot.
+    double getTimeAdjustedSpeed(const Edge& edge, int hour_of_day) const;
+    double getSlotSpeed(const Edge& edge, int slot) const;
+    double getRushHourSpeed(const Edge& edge, int hour_of_day) const;
+    
+    // Attach before serving queries; pass nullptr to go back to the built-in model
+    void setSpeedProfiles(std::shared_ptr<const SpeedProfileStore> profiles);
+    const SpeedProfileStore* getSpeedProfiles() const { return speed_profiles.get(); }
+    
+    // Road classes, for query-time avoidance. Classes below roadClassCount()
+    // have one road type each; edges in kSharedRoadClass don't.
+    size_t roadClassCount() const { return road_class_types.size(); }
+    const std::string& roadClassType(uint8_t road_class) const { return road_class_types[road_class]; }
+    bool roadClassIsToll(uint8_t road_class) const { return road_class_tolls[road_class]; }
+    uint64_t avoidMask(unsigned avoid_flags) const;
+    uint64_t roadTypeMask(const std::string& road_type) const;
+    
+    // Road closures: O(1) per edge, visible to queries that start afterwards.
+    // Return true if the edge changed state.
+    bool closeEdge(size_t edge_id);
+    bool reopenEdge(size_t edge_id);
+    void reopenAllEdges();
+    bool isEdgeClosed(size_t edge_id) const {
+        return (closed_words[edge_id >> 6].load(std::memory_order_relaxed) >> (edge_id & 63)) & 1;
+    }
+    size_t closedEdgeCount() const { return closed_count.load(std::memory_order_relaxed); }
+    uint64_t closureVersion() const { return closure_version.load(std::memory_order_acquire); }
+    
     // Enhanced routing with different modes
+    // avoided_classes is a road-class mask (see avoidMask); 0 allows every road
     RouteResult dijkstra(long long start_id, long long end_id, 
                         RouteMode mode = RouteMode::SPEED_LIMIT,
-                        int hour_of_day = 12) const;
+                        int hour_of_day = 12,
+                        uint64_t avoided_classes = 0) const;
+    
+    // Route against an explicitly pinned metric snapshot
+    RouteResult dijkstra(long long start_id, long long end_id,
+                        const MetricSnapshot& metric,
+                        RouteMode mode = RouteMode::SPEED_LIMIT,
+                        int hour_of_day = 12,
+                        uint64_t avoided_classes = 0) const;
+    
+    // Routes from one start to several ends out of a single one-to-many
+    // search; each result is the one dijkstra would return for its pair
+    std::vector<RouteResult> dijkstraMany(long long start_id, const std::vector<long long>& end_ids,
+                                          const MetricSnapshot& metric,
+                                          RouteMode mode = RouteMode::SPEED_LIMIT,
+                                          int hour_of_day = 12,
+                                          uint64_t avoided_classes = 0) const;
+    
+    // Point-to-point search with any per-edge weight (return infinity to skip
+    // an edge); closed edges and edges the filter rejects are never used.
+    // Fills edge_path and returns the path cost, or infinity if the
+    // target is unreachable. Reuses the caller's workspace, so running many
+    // searches on one thread allocates nothing.
+    template <typename WeightFn, typename Filter = NoRoadFilter>
+    double shortestPath(long long start_id, long long end_id, SearchWorkspace& workspace,
+                        WeightFn&& weight, std::vector<size_t>& edge_path,
+                        const Filter& filter = Filter()) const;
+    
+    // Costs from one source to many targets in a single search that stops once
+    // every target is settled; unreachable targets get infinity
+    template <typename WeightFn, typename Filter = NoRoadFilter>
+    void oneToMany(long long start_id, const std::vector<long long>& targets, SearchWorkspace& workspace,
+                   WeightFn&& weight, std::vector<double>& costs, const Filter& filter = Filter()) const;
+    
+    // Full search from one node, leaving every node's cost and tree edge in the
+    // workspace. backward follows edges in reverse (costs *to* the node).
+    template <typename WeightFn, typename Filter = NoRoadFilter>
+    void shortestPathTree(uint32_t root, SearchWorkspace& workspace, WeightFn&& weight,
+                          bool backward = false, const Filter& filter = Filter()) const;
+    
+    // Edge cost under a routing mode, exactly as dijkstra weighs it
+    double edgeWeight(const Edge& edge, RouteMode mode, int hour_of_day, const MetricSnapshot& metric) const {
+        return calculateEdgeWeight(edge, mode, hour_of_day, metric);
+    }
+    
+    // Travel time (s) on an edge as LEARNED routing sees it
+    double learnedTravelTime(const Edge& edge, int hour_of_day, const MetricSnapshot& metric) const {
+        return calculateEdgeWeight(edge, RouteMode::LEARNED, hour_of_day, metric);
+    }
+    
+    // Node sequence (including start) of an edge path that begins at start_id
+    std::vector<long long> pathNodes(long long start_id, const std::vector<size_t>& edge_path) const;
+    
+    // Local network-distance searches (meters, ignoring traffic) that give up
+    // beyond max_distance; unreachable targets report infinity. Cheap for
+    // short ranges because only visited nodes are touched.
+    std::vector<double> boundedDistances(long long source, const std::vector<long long>& targets,
+                                         double max_distance) const;
+    bool boundedEdgePath(long long source, long long target, double max_distance,
+                         std::vector<size_t>& edge_path) const;
+    
+    // Live traffic: pin the current snapshot, or atomically replace it.
+    // Queries already running keep the snapshot they started with.
+    MetricStore::ReadGuard currentMetric() const { return metric_store.acquire(); }
+    uint64_t publishMetric(std::vector<double> crowd_multipliers);
     
-    // Simulate crowd-sourced learning on certain edges
-    void applyLearnedPatterns();
+    // Simulate crowd-sourced learning on certain edges (deterministic per seed)
+    void applyLearnedPatterns(uint64_t seed = 42);
     
     size_t nodeCount() const { return nodes.size(); }
-    size_t edgeCount() const;
+    size_t edgeCount() const { return next_edge_id; }
     
     void printStats() const;
 };
 
+template <typename WeightFn, typename Filter>
+double Graph::shortestPath(long long start_id, long long end_id, SearchWorkspace& workspace,
+                           WeightFn&& weight, std::vector<size_t>& edge_path,
+                           const Filter& filter) const {
+    const double inf = std::numeric_limits<double>::infinity();
+    edge_path.clear();
+    
+    uint32_t source, target;
+    if (!getNodeIndex(start_id, source) || !getNodeIndex(end_id, target)) {
+        return inf;
+    }
+    
+    // The closure check is skipped entirely while no road is closed
+    const bool check_closures = closedEdgeCount() > 0;
+    
+    workspace.begin(node_ids.size());
+    workspace.update(source, 0.0, SearchWorkspace::kNoEdge);
+    workspace.push(0.0, source);
+    
+    while (!workspace.empty()) {
+        auto [current_dist, current] = workspace.pop();
+        
+        if (current == target) {
+            break;
+        }
+        if (current_dist > workspace.distance(current)) {
+            continue;
+        }
+        
+        const auto* edges = adjacency_by_index[current];
+        if (!edges) {
+            continue;
+        }
+        for (const auto& edge : *edges) {
+            if (!filter.allows(edge) || (check_closures && isEdgeClosed(edge.id))) {
+                continue;
+            }
+            double new_dist = current_dist + weight(edge);
+            if (new_dist < workspace.distance(edge.to_index)) {
+                workspace.update(edge.to_index, new_dist, edge.id);
+                workspace.push(new_dist, edge.to_index);
+            }
+        }
+    }
+    
+    if (!workspace.reached(target)) {
+        return inf;
+    }
+    for (uint32_t node = target; node != source;) {
+        size_t edge_id = workspace.parentEdge(node);
+        edge_path.push_back(edge_id);
+        node = edge_source_indices[edge_id];
+    }
+    std::reverse(edge_path.begin(), edge_path.end());
+    return workspace.distance(target);
+}
+
+template <typename WeightFn, typename Filter>
+void Graph::shortestPathTree(uint32_t root, SearchWorkspace& workspace, WeightFn&& weight,
+                             bool backward, const Filter& filter) const {
+    const bool check_closures = closedEdgeCount() > 0;
+    workspace.begin(node_ids.size());
+    workspace.update(root, 0.0, SearchWorkspace::kNoEdge);
+    workspace.push(0.0, root);
+    
+    auto relax = [&](const Edge& edge, uint32_t next, double current_dist) {
+        if (!filter.allows(edge) || (check_closures && isEdgeClosed(edge.id))) {
+            return;
+        }
+        double new_dist = current_dist + weight(edge);
+        if (new_dist < workspace.distance(next)) {
+            workspace.update(next, new_dist, edge.id);
+            workspace.push(new_dist, next);
+        }
+    };
+    
+    while (!workspace.empty()) {
+        auto [current_dist, current] = workspace.pop();
+        if (current_dist > workspace.distance(current)) {
+            continue;
+        }
+        if (backward) {
+            for (size_t edge_id : incoming_by_index[current]) {
+                relax(*getEdge(edge_id), edge_source_indices[edge_id], current_dist);
+            }
+        } else if (adjacency_by_index[current]) {
+            for (const auto& edge : *adjacency_by_index[current]) {
+                relax(edge, edge.to_index, current_dist);
+            }
+        }
+    }
+}
+
+template <typename WeightFn, typename Filter>
+void Graph::oneToMany(long long start_id, const std::vector<long long>& targets, SearchWorkspace& workspace,
+                      WeightFn&& weight, std::vector<double>& costs, const Filter& filter) const {
+    const double inf = std::numeric_limits<double>::infinity();
+    costs.assign(targets.size(), inf);
+    
+    uint32_t source;
+    if (!getNodeIndex(start_id, source)) {
+        return;
+    }
+    
+    const bool check_closures = closedEdgeCount() > 0;
+    workspace.begin(node_ids.size());
+    
+    std::vector<uint32_t> target_indices(targets.size(), UINT32_MAX);
+    size_t remaining = 0;
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (getNodeIndex(targets[i], target_indices[i]) && !workspace.marked(target_indices[i])) {
+            workspace.mark(target_indices[i]);
+            remaining++;
+        }
+    }
+    
+    workspace.update(source, 0.0, SearchWorkspace::kNoEdge);
+    workspace.push(0.0, source);
+    
+    while (!workspace.empty() && remaining > 0) {
+        auto [current_dist, current] = workspace.pop();
+        if (current_dist > workspace.distance(current)) {
+            continue;
+        }
+        if (workspace.marked(current)) {
+            workspace.unmark(current);
+            remaining--;
+        }
+        
+        const auto* edges = adjacency_by_index[current];
+        if (!edges) {
+            continue;
+        }
+        for (const auto& edge : *edges) {
+            if (!filter.allows(edge) || (check_closures && isEdgeClosed(edge.id))) {
+                continue;
+            }
+            double new_dist = current_dist + weight(edge);
+            if (new_dist < workspace.distance(edge.to_index)) {
+                workspace.update(edge.to_index, new_dist, edge.id);
+                workspace.push(new_dist, edge.to_index);
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (target_indices[i] != UINT32_MAX) {
+            costs[i] = workspace.distance(target_indices[i]);
+        }
+    }
+}
+
 #endif
\ No newline at end of file
@@ -4,67 +4,56 @@
 #include <vector>
 #include <random>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <csignal>
+#include <thread>
+#include <memory>
 #include "graph.h"
+#include "map_matcher.h"
+#include "multiplier_import.h"
 #include "osm_parser.h"
+#include "parallel.h"
+#include "pareto_router.h"
+#include "poi_index.h"
+#include "probe_ingest.h"
+#include "route_server.h"
+#include "route_writer.h"
+#include "road_closures.h"
+#include "spatial_index.h"
+#include "speed_profile.h"
+#include "stochastic_router.h"
+#include "tour_optimizer.h"
+#include "traffic_assignment.h"
+#include "traffic_generator.h"
+#include "trip_fitting.h"
+#include "vehicle_profile.h"
+#include "vulnerability.h"
+#include "fleet_simulator.h"
+#include "scenario_runner.h"
+#include "turn_router.h"
 
-void exportRouteToJSON(const Graph& graph, const std::vector<RouteResult>& routes, 
-                       const std::string& filename) {
-    std::ofstream file(filename);
+void exportRoutes(const Graph& graph, const std::vector<RouteResult>& routes,
+                  const std::string& filename, RouteFormat format) {
+    std::ofstream file(filename, std::ios::binary);
     if (!file.is_open()) {
-        std::cerr << "Could not create JSON file\n";
+        std::cerr << "Could not create " << filename << "\n";
         return;
     }
-    
-    file << "{\n";
-    file << "  \"routes\": [\n";
-    
-    for (size_t r = 0; r < routes.size(); r++) {
-        const auto& route = routes[r];
-        
-        file << "    {\n";
-        file << "      \"mode\": \"" << route.mode_name << "\",\n";
-        file << "      \"color\": \"";
-        
-        // Assign colors
-        if (route.mode == RouteMode::DISTANCE) {
-            file << "#FF6B6B";  // Red
-        } else if (route.mode == RouteMode::SPEED_LIMIT) {
-            file << "#4ECDC4";  // Cyan
-        } else {
-            file << "#95E1D3";  // Green
-        }
-        file << "\",\n";
-        
-        file << "      \"total_distance_km\": " << std::fixed << std::setprecision(3) 
-             << (route.total_distance / 1000.0) << ",\n";
-        file << "      \"estimated_time_min\": " << std::fixed << std::setprecision(1) 
-             << (route.estimated_time / 60.0) << ",\n";
-        file << "      \"waypoints\": [\n";
-        
-        for (size_t i = 0; i < route.path.size(); i++) {
-            const Node* node = graph.getNode(route.path[i]);
-            file << "        {\n";
-            file << "          \"id\": " << route.path[i] << ",\n";
-            file << "          \"lat\": " << std::fixed << std::setprecision(7) << node->lat << ",\n";
-            file << "          \"lon\": " << node->lon << "\n";
-            file << "        }";
-            if (i < route.path.size() - 1) file << ",";
-            file << "\n";
-        }
-        
-        file << "      ]\n";
-        file << "    }";
-        if (r < routes.size() - 1) file << ",";
-        file << "\n";
-    }
-    
-    file << "  ]\n";
-    file << "}\n";
-    
-    file.close();
+    writeRoutes(graph, routes, file, format);
     std::cout << "\nRoutes exported to " << filename << "\n";
 }
 
+// Send one query's routes to the live viewers
+void pushRoutes(RouteServer& server, const std::vector<RouteResult>& routes) {
+    uint64_t query = server.newQuery();
+    for (size_t i = 0; i < routes.size(); i++) {
+        server.pushRoute(query, i, routes.size(), routes[i]);
+    }
+}
+
 void printRouteComparison(const std::vector<RouteResult>& routes) {
     std::cout << "\n================================================================\n";
     std::cout << "           ROUTE COMPARISON: 3 OPTIMIZATION METHODS            \n";
@@ -149,7 +138,7 @@ void printRouteComparison(const std::vector<RouteResult>& routes) {
     std::cout << "\n";
 }
 
-std::vector<long long> getRandomConnectedNodes(const Graph& graph, int count = 10) {
+std::vector<long long> getRandomConnectedNodes(const Graph& graph, int count = 10, uint64_t seed = 42) {
     std::vector<long long> candidates;
     
     int samples = 0;
@@ -167,15 +156,559 @@ std::vector<long long> getRandomConnectedNodes(const Graph& graph, int count = 1
         return {};
     }
     
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937_64 gen(seed);
     std::shuffle(candidates.begin(), candidates.end(), gen);
     
     int returnCount = std::min(count, (int)candidates.size());
     return std::vector<long long>(candidates.begin(), candidates.begin() + returnCount);
 }
 
-int main() {
+// Save per-slot speed profiles learned by an ingestor
+bool saveLearnedProfiles(const Graph& graph, const ProbeIngestor& ingestor, const std::string& profile_file) {
+    SpeedProfileStore profiles = SpeedProfileStore::fromProbes(graph, ingestor);
+    if (!profiles.save(profile_file)) {
+        return false;
+    }
+    std::cout << "  Speed profiles:     " << profiles.shapeCount() << " shapes, "
+              << profiles.deviationCount() << " corrected edges, "
+              << profiles.memoryBytes() / 1024 << " KB -> " << profile_file << "\n";
+    return true;
+}
+
+// Learn crowd multipliers from a recorded probe stream (.csv or .bin)
+// Optionally keeps per-slot speed profiles learned along the way
+bool learnFromProbes(Graph& graph, const std::string& filename, const std::string& profile_file) {
+    bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+    std::ifstream file(filename, binary ? std::ios::binary : std::ios::in);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open probe file " << filename << std::endl;
+        return false;
+    }
+    
+    std::cout << "\nIngesting GPS probes from " << filename << "...\n";
+    SpatialIndex index(graph);
+    ProbeIngestor ingestor(graph, index);
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t count = binary ? ingestor.ingestBinary(file) : ingestor.ingestCSV(file);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    ProbeIngestStats stats = ingestor.stats();
+    std::cout << "  Probes read:        " << count << "\n";
+    std::cout << "  Matched to roads:   " << stats.probes_matched << "\n";
+    std::cout << "  Rejected:           " << stats.probes_rejected << "\n";
+    std::cout << "  Snapshots published: " << stats.snapshots_published << "\n";
+    std::cout << "  Throughput:         " << std::fixed << std::setprecision(0)
+              << (seconds > 0 ? count / seconds : 0.0) << " probes/s\n";
+    
+    return profile_file.empty() || saveLearnedProfiles(graph, ingestor, profile_file);
+}
+
+// Map-match raw GPS traces and learn crowd multipliers from the speeds
+// driven between matched points
+bool learnFromTraces(Graph& graph, const std::string& filename, const std::string& profile_file) {
+    std::vector<GpsTrace> traces = MapMatcher::loadTracesCSV(filename);
+    if (traces.empty()) {
+        std::cerr << "Error: No GPS traces in " << filename << std::endl;
+        return false;
+    }
+    
+    size_t points = 0;
+    for (const GpsTrace& trace : traces) {
+        points += trace.points.size();
+    }
+    std::cout << "\nMap-matching " << traces.size() << " GPS traces (" << points << " points) from "
+              << filename << "...\n";
+    SpatialIndex index(graph);
+    MapMatcher matcher(graph, index);
+    ProbeIngestor ingestor(graph, index);
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<MatchResult> results = matcher.matchAll(traces);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    size_t matched = 0, traversals = 0;
+    int breaks = 0;
+    for (const MatchResult& result : results) {
+        for (const MatchedPoint& point : result.points) {
+            matched += point.matched ? 1 : 0;
+        }
+        for (const EdgeTraversal& traversal : result.traversals) {
+            ingestor.addObservation(traversal.edge_id, traversal.timestamp, traversal.speed_kmh);
+        }
+        traversals += result.traversals.size();
+        breaks += result.breaks;
+    }
+    ingestor.publish();
+    
+    MatchCacheStats cache = matcher.cacheStats();
+    std::cout << "  Points matched:     " << matched << " of " << points << " (" << breaks << " breaks)\n";
+    std::cout << "  Edge traversals:    " << traversals << "\n";
+    std::cout << "  Distance cache:     " << cache.hits << " hits, " << cache.searches << " searches\n";
+    std::cout << "  Throughput:         " << std::fixed << std::setprecision(0)
+              << (seconds > 0 ? points / seconds : 0.0) << " points/s\n";
+    
+    return profile_file.empty() || saveLearnedProfiles(graph, ingestor, profile_file);
+}
+
+// Load multipliers computed by an external analytics job (.csv or .bin)
+bool importMultipliers(Graph& graph, const std::string& filename) {
+    bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+    
+    std::cout << "\nImporting crowd multipliers from " << filename << "...\n";
+    EdgeKeyIndex index(graph);
+    MultiplierImporter importer(graph, index);
+    MultiplierImportReport report = binary ? importer.importBinary(filename)
+                                           : importer.importCSV(filename);
+    
+    std::cout << "  Records:    " << report.records << "\n";
+    std::cout << "  Matched:    " << report.matched << "\n";
+    std::cout << "  Unmatched:  " << report.unmatched << "\n";
+    std::cout << "  Malformed:  " << report.malformed << "\n";
+    std::cout << "  Time:       " << std::fixed << std::setprecision(2) << report.seconds << " s\n";
+    for (const auto& key : report.unmatched_samples) {
+        std::cout << "    unmatched: " << key << "\n";
+    }
+    return report.version != 0;
+}
+
+// Fit multipliers so routed times reproduce observed trip durations
+bool fitToTrips(Graph& graph, const std::string& filename) {
+    std::vector<Trip> trips = TripFitter::loadTripsCSV(filename);
+    if (trips.empty()) {
+        return false;
+    }
+    
+    std::cout << "\nFitting crowd multipliers to " << trips.size() << " observed trips...\n";
+    TripFitter fitter(graph);
+    TripFitReport report = fitter.fit(trips);
+    std::cout << "  " << (report.converged ? "Converged" : report.regressed ? "Kept the best fit" : "Stopped")
+              << " after " << report.iterations.size() << " rounds\n";
+    return report.version != 0;
+}
+
+// Route many sampled traffic realizations and rank candidates by percentile ETA
+void printReliableRoutes(const Graph& graph, long long start, long long end, int hour,
+                         double percentile, uint64_t seed, uint64_t avoided_classes) {
+    StochasticRouteOptions options;
+    options.percentile = percentile;
+    options.seed = seed;
+    options.avoided_classes = avoided_classes;
+    
+    auto started = std::chrono::steady_clock::now();
+    StochasticResult result = StochasticRouter(graph, options).route(start, end, hour);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    
+    if (result.most_reliable < 0) {
+        std::cout << "\nNo reliable route found.\n";
+        return;
+    }
+    int pct = (int)std::lround(percentile * 100.0);
+    std::cout << "\n*** RELIABILITY (" << result.samples << " traffic samples, P" << pct << ", "
+              << std::fixed << std::setprecision(2) << seconds << " s):\n";
+    for (size_t c = 0; c < result.candidates.size() && c < 5; c++) {
+        const ReliableRoute& candidate = result.candidates[c];
+        std::cout << "   " << (c == (size_t)result.most_reliable ? "* " : "  ")
+                  << std::setprecision(2) << candidate.route.total_distance / 1000.0 << " km, mean "
+                  << std::setprecision(1) << candidate.mean_time_s / 60.0 << " min, P" << pct << " "
+                  << candidate.percentile_time_s / 60.0 << " min, fastest in "
+                  << candidate.times_optimal << "/" << result.samples << " samples\n";
+    }
+}
+
+// Route the same trip for each requested vehicle profile (built-in name or profile file)
+void printVehicleRoutes(const Graph& graph, const std::vector<std::string>& vehicles,
+                        long long start, long long end, int hour, uint64_t avoided_classes) {
+    VehicleProfiles profiles(graph);
+    for (const auto& vehicle : vehicles) {
+        VehicleProfile profile;
+        if (vehicle == "car") {
+            profile = VehicleProfile::car();
+        } else if (vehicle == "truck") {
+            profile = VehicleProfile::truck();
+        } else if (vehicle == "bike") {
+            profile = VehicleProfile::bike();
+        } else if (!VehicleProfile::load(vehicle, profile)) {
+            continue;
+        }
+        profiles.add(profile);
+    }
+    
+    std::cout << "\n*** VEHICLE PROFILES (" << profiles.count() << " compiled, "
+              << profiles.memoryBytes() / 1024 << " KB of weights):\n";
+    for (size_t p = 0; p < profiles.count(); p++) {
+        RouteResult route = profiles.route(p, start, end, hour, avoided_classes);
+        std::cout << "   " << std::left << std::setw(8) << profiles.profile(p).name << std::right;
+        if (route.path.empty()) {
+            std::cout << "no route\n";
+            continue;
+        }
+        std::cout << std::fixed << std::setprecision(2) << route.total_distance / 1000.0 << " km, "
+                  << std::setprecision(1) << route.estimated_time / 60.0 << " min\n";
+    }
+}
+
+// Every route not beaten on both time and distance
+void printParetoRoutes(const Graph& graph, long long start, long long end, int hour,
+                       uint64_t avoided_classes) {
+    ParetoRouteOptions options;
+    options.avoided_classes = avoided_classes;
+    ParetoRouter router(graph, options);
+    
+    auto started = std::chrono::steady_clock::now();
+    std::vector<RouteResult> frontier = router.route(start, end, hour);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    
+    std::cout << "\n*** TIME vs DISTANCE TRADE-OFFS (" << frontier.size() << " Pareto-optimal routes, "
+              << router.stats().labels_settled << " labels, " << std::fixed << std::setprecision(3)
+              << seconds << " s):\n";
+    for (const auto& route : frontier) {
+        std::cout << "   " << std::setprecision(2) << route.total_distance / 1000.0 << " km, "
+                  << std::setprecision(1) << route.estimated_time / 60.0 << " min\n";
+    }
+}
+
+// Visit a set of stops in the best order, starting at the first one
+void printTour(const Graph& graph, const std::vector<long long>& nodes, int hour, uint64_t avoided_classes) {
+    std::vector<TourStop> stops;
+    for (long long node : nodes) {
+        stops.push_back({node});
+    }
+    TourOptions options;
+    options.hour_of_day = hour;
+    options.avoided_classes = avoided_classes;
+    TourResult tour = TourOptimizer(graph, options).optimize(stops);
+    
+    std::cout << "\n*** MULTI-STOP TOUR (" << stops.size() << " stops):\n";
+    std::cout << "   Matrix:      " << std::fixed << std::setprecision(3) << tour.matrix_seconds << " s\n";
+    std::cout << "   Local search: " << tour.optimize_seconds << " s, " << tour.moves_applied << " moves\n";
+    std::cout << "   Tour:        " << std::setprecision(2) << tour.route.total_distance / 1000.0 << " km, "
+              << std::setprecision(1) << tour.travel_time_s / 60.0 << " min driving"
+              << (tour.feasible ? "" : " (some stops unreachable)") << "\n";
+}
+
+// Scatter points of interest over the map and find the nearest ones by travel time
+void printNearestPois(const Graph& graph, long long start, int poi_count, int hour, uint64_t seed) {
+    auto started = std::chrono::steady_clock::now();
+    PoiIndex index(graph);
+    double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    
+    auto nodes = getRandomConnectedNodes(graph, poi_count, seed + 1);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        index.insert((long long)i, nodes[i]);
+    }
+    
+    KnnStats stats;
+    started = std::chrono::steady_clock::now();
+    std::vector<PoiMatch> matches = index.nearest(start, 5, RouteMode::LEARNED, hour, &stats);
+    double query_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    
+    std::cout << "\n*** NEAREST OF " << index.size() << " POIs FROM NODE " << start << " ("
+              << index.landmarkNodes().size() << " landmarks in " << std::fixed << std::setprecision(2)
+              << build_seconds << " s; query " << std::setprecision(3) << query_ms << " ms, "
+              << stats.candidates_checked << " candidates, " << stats.nodes_settled << " nodes):\n";
+    for (const auto& match : matches) {
+        std::cout << "   POI " << match.object_id << " at node " << match.node << ": "
+                  << std::setprecision(1) << match.cost / 60.0 << " min\n";
+    }
+}
+
+// Assign an OD demand matrix to the network and publish the resulting congestion
+bool assignDemand(Graph& graph, const std::string& filename) {
+    std::vector<OdDemand> demand = TrafficAssignment::loadDemandCSV(filename);
+    if (demand.empty()) {
+        return false;
+    }
+    
+    std::cout << "\nAssigning " << demand.size() << " OD pairs (Frank-Wolfe equilibrium)...\n";
+    auto started = std::chrono::steady_clock::now();
+    AssignmentResult result = TrafficAssignment(graph).assign(demand);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    
+    const AssignmentIteration& last = result.iterations.back();
+    std::cout << "  " << (result.converged ? "Converged" : "Stopped") << " after "
+              << result.iterations.size() << " iterations, relative gap " << std::scientific
+              << std::setprecision(2) << last.relative_gap << std::fixed << ", "
+              << std::setprecision(0) << last.total_vehicle_hours << " vehicle-hours, "
+              << std::setprecision(2) << seconds << " s\n";
+    if (result.unassigned_demand > 0.0) {
+        std::cout << "  Unassigned:  " << std::setprecision(0) << result.unassigned_demand << " veh/h\n";
+    }
+    graph.publishMetric(result.multipliers);
+    return true;
+}
+
+// Which road segments would hurt most if closed, over a sample of trips
+void printVulnerability(const Graph& graph, int trip_count, int hour, uint64_t seed) {
+    auto nodes = getRandomConnectedNodes(graph, 2 * trip_count, seed + 2);
+    std::vector<std::pair<long long, long long>> trips;
+    for (size_t i = 0; i + 1 < nodes.size(); i += 2) {
+        trips.push_back({nodes[i], nodes[i + 1]});
+    }
+    
+    VulnerabilityOptions options;
+    options.hour_of_day = hour;
+    VulnerabilityReport report = VulnerabilityAnalyzer(graph, options).analyze(trips);
+    
+    std::cout << "\n*** MOST CRITICAL ROAD SEGMENTS (" << report.routed << " trips, "
+              << report.ranked.size() << " candidate edges, " << std::fixed << std::setprecision(2)
+              << report.seconds << " s):\n";
+    for (size_t i = 0; i < report.ranked.size() && i < 10; i++) {
+        const EdgeImpact& impact = report.ranked[i];
+        const Edge* edge = graph.getEdge(impact.edge_id);
+        std::cout << "   " << std::setw(2) << i + 1 << ". " << graph.getEdgeSource(impact.edge_id)
+                  << " -> " << edge->to << " (" << edge->segment->road_type << ", way "
+                  << graph.getEdgeOrigin(impact.edge_id).way_id << "): "
+                  << impact.routes_affected << " trips, +" << std::setprecision(1)
+                  << impact.total_delay_s / 60.0 << " min total";
+        if (impact.disconnected > 0) {
+            std::cout << ", " << impact.disconnected << " cut off";
+        }
+        std::cout << "\n";
+    }
+}
+
+// Simulate a congesting fleet under traffic-blind and traffic-aware routing
+void printFleetSimulation(const Graph& graph, size_t vehicles, int hour, uint64_t seed) {
+    std::cout << "\n*** FLEET SIMULATION (" << vehicles << " vehicles, hour " << hour << "):\n";
+    for (RouteMode policy : {RouteMode::SPEED_LIMIT, RouteMode::LEARNED}) {
+        FleetSimOptions options;
+        options.vehicles = vehicles;
+        options.policy = policy;
+        options.hour_of_day = hour;
+        options.seed = seed;
+        FleetSimStats stats = FleetSimulator(graph, options).run();
+        
+        std::cout << "   " << (policy == RouteMode::LEARNED ? "LEARNED    " : "SPEED_LIMIT") << ": "
+                  << stats.arrived << "/" << stats.departed << " arrived, mean trip " << std::fixed
+                  << std::setprecision(1) << stats.mean_trip_s / 60.0 << " min (+"
+                  << stats.mean_delay_s / 60.0 << " congestion), " << std::setprecision(0)
+                  << stats.vehicle_hours << " vehicle-hours";
+        if (stats.reroutes > 0) {
+            std::cout << ", " << stats.routes_changed << "/" << stats.reroutes << " reroutes changed";
+        }
+        std::cout << "\n                " << stats.events << " events, " << std::setprecision(2)
+                  << stats.wall_seconds << " s wall, " << std::setprecision(0)
+                  << stats.simulated_s / std::max(stats.wall_seconds, 1e-9) << "x realtime";
+        if (stats.unroutable > 0 || stats.still_driving > 0) {
+            std::cout << ", " << stats.unroutable << " unroutable, " << stats.still_driving << " still driving";
+        }
+        std::cout << "\n";
+    }
+}
+
+// Travel-time shift over a trip sample if the given ways were closed
+void printWhatIf(const Graph& graph, const std::vector<long long>& ways, int trip_count, int hour, uint64_t seed) {
+    EdgeKeyIndex index(graph);
+    Scenario scenario;
+    for (long long way_id : ways) {
+        std::vector<size_t> edges = index.edgesOfWay(way_id);
+        scenario.closed_edges.insert(scenario.closed_edges.end(), edges.begin(), edges.end());
+    }
+    
+    auto nodes = getRandomConnectedNodes(graph, 2 * trip_count, seed + 3);
+    std::vector<std::pair<long long, long long>> trips;
+    for (size_t i = 0; i + 1 < nodes.size(); i += 2) {
+        trips.push_back({nodes[i], nodes[i + 1]});
+    }
+    
+    ScenarioOptions options;
+    options.hour_of_day = hour;
+    ScenarioReport report = ScenarioRunner(graph, options).evaluate(scenario, trips);
+    
+    std::cout << "\n*** WHAT-IF: CLOSING " << ways.size() << " WAY(S), " << scenario.closed_edges.size()
+              << " EDGES (" << report.routed << " trips, " << report.reused << " answered from base trees, "
+              << std::fixed << std::setprecision(2) << report.seconds << " s):\n";
+    std::cout << "   Affected:     " << report.affected << " trips";
+    if (report.disconnected > 0) {
+        std::cout << ", " << report.disconnected << " cut off";
+    }
+    std::cout << "\n   Delta (min):  mean " << std::setprecision(2) << report.mean_delta_s / 60.0
+              << ", p50 " << report.p50_delta_s / 60.0 << ", p90 " << report.p90_delta_s / 60.0
+              << ", p99 " << report.p99_delta_s / 60.0 << ", max " << report.max_delta_s / 60.0 << "\n";
+}
+
+// Turn-aware route for the sample trip, and what edge-based search costs per query
+void printTurnAwareRoute(const Graph& graph, long long start, long long end, int hour,
+                         const RouteResult& node_based, uint64_t seed) {
+    TurnRouter router(graph);
+    SearchWorkspace workspace;
+    auto metric = graph.currentMetric();
+    TurnRouteResult route = router.route(start, end, workspace, *metric, RouteMode::LEARNED, hour);
+    
+    std::cout << "\n*** TURN-AWARE ROUTE (" << router.restrictedTurns() << " restricted turns, "
+              << std::fixed << std::setprecision(1) << router.memoryBytes() / 1024.0 << " KB turn data):\n";
+    if (route.edge_path.empty()) {
+        std::cout << "   No route that respects the turn restrictions.\n";
+    } else {
+        std::cout << "   Time:   " << route.cost / 60.0 << " min, of which " << route.turn_penalty_s / 60.0
+                  << " min in " << route.turns << " turns (node-based: " << node_based.estimated_time / 60.0
+                  << " min, no turn costs)\n";
+        std::cout << "   Nodes:  " << route.path.size() << " (node-based: " << node_based.path.size() << ")\n";
+    }
+    
+    // Same queries through both searches
+    auto nodes = getRandomConnectedNodes(graph, 200, seed + 4);
+    std::vector<size_t> edge_path;
+    double node_seconds = 0.0, turn_seconds = 0.0;
+    size_t queries = 0;
+    for (size_t i = 0; i + 1 < nodes.size(); i += 2, queries++) {
+        auto started = std::chrono::steady_clock::now();
+        graph.dijkstra(nodes[i], nodes[i + 1], *metric, RouteMode::LEARNED, hour);
+        auto middle = std::chrono::steady_clock::now();
+        router.route(nodes[i], nodes[i + 1], workspace, *metric, RouteMode::LEARNED, hour);
+        auto finished = std::chrono::steady_clock::now();
+        node_seconds += std::chrono::duration<double>(middle - started).count();
+        turn_seconds += std::chrono::duration<double>(finished - middle).count();
+    }
+    if (queries > 0) {
+        std::cout << "   Query:  " << std::setprecision(3) << turn_seconds * 1000.0 / queries
+                  << " ms edge-based vs " << node_seconds * 1000.0 / queries << " ms node-based ("
+                  << std::setprecision(2) << turn_seconds / std::max(node_seconds, 1e-12) << "x, "
+                  << queries << " queries)\n";
+    }
+}
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void onStopSignal(int) {
+    stop_requested = 1;
+}
+
+// Load-test the HTTP server on a free port with a mix of the sample queries
+void benchmarkServer(const Graph& graph, const std::vector<long long>& nodes, size_t requests,
+                     uint64_t avoided_classes) {
+    SpatialIndex index(graph);
+    RouteServerOptions options;
+    options.port = 0;
+    options.avoided_classes = avoided_classes;
+    RouteServer server(graph, index, options);
+    if (!server.start()) {
+        return;
+    }
+    
+    // The burst is every client asking routes out of one origin at once, as
+    // during an incident; the coalescer turns it into shared searches
+    std::vector<std::string> route_paths, burst_paths, snap_paths;
+    for (size_t i = 0; i + 1 < nodes.size(); i++) {
+        route_paths.push_back("/route?from=" + std::to_string(nodes[i]) + "&to=" + std::to_string(nodes[i + 1]));
+        burst_paths.push_back("/route?from=" + std::to_string(nodes[0]) + "&to=" + std::to_string(nodes[i + 1]) +
+                              "&hour=8");
+        const Node* node = graph.getNode(nodes[i]);
+        std::ostringstream snap;
+        snap << std::fixed << std::setprecision(6) << "/snap?lat=" << node->lat + 0.0001 << "&lon=" << node->lon;
+        snap_paths.push_back(snap.str());
+    }
+    
+    std::cout << "\n*** HTTP SERVER LOAD TEST (port " << server.port() << ", " << hardwareThreads()
+              << " worker threads, 16 keep-alive connections):\n";
+    for (const auto& test : {std::make_pair("/route", &route_paths), std::make_pair("/route burst", &burst_paths),
+                             std::make_pair("/snap", &snap_paths)}) {
+        LoadTestResult result = RouteServer::loadTest(server.port(), *test.second, 16, requests);
+        std::cout << "   " << std::left << std::setw(13) << test.first << std::right << result.requests
+                  << " requests, " << std::fixed << std::setprecision(0) << result.requests_per_second
+                  << " req/s, p50 " << std::setprecision(3) << result.p50_ms << " ms, p99 "
+                  << result.p99_ms << " ms";
+        if (result.errors > 0) {
+            std::cout << ", " << result.errors << " errors";
+        }
+        std::cout << "\n";
+    }
+    RouteCacheStats cache = server.cacheStats();
+    std::cout << "   Route cache: " << cache.entries << " entries, " << std::setprecision(1)
+              << cache.bytes / 1024.0 << " KB, hit rate " << cache.hitRate() * 100.0 << "%\n";
+    RouteCoalescerStats coalescer = server.coalescerStats();
+    std::cout << "   Coalescer: " << coalescer.searches << " searches for "
+              << coalescer.requests - coalescer.hits << " cache misses (" << coalescer.shared
+              << " shared in flight, " << coalescer.merged << " merged by origin), "
+              << std::setprecision(2) << coalescer.fanIn() << " queries per search\n";
+    server.stop();
+}
+
+int main(int argc, char* argv[]) {
+    std::string probe_file;
+    std::string trace_file;
+    std::string profile_file;
+    std::string save_profile_file;
+    std::string multiplier_file;
+    std::string trip_file;
+    std::string demand_file;
+    uint64_t seed = 42;
+    double traffic_intensity = -1.0;
+    double reliability = 0.0;
+    std::vector<long long> closed_ways;
+    unsigned avoid_flags = AVOID_NONE;
+    std::vector<std::string> vehicles;
+    bool pareto = false;
+    int tour_stops = 0;
+    int poi_count = 0;
+    int vulnerability_trips = 0;
+    size_t fleet_size = 0;
+    int what_if_trips = 0;
+    bool turn_costs = false;
+    int serve_port = -1;
+    int live_port = -1;
+    RouteFormat route_format = RouteFormat::JSON;
+    size_t serve_bench_requests = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--probes" && i + 1 < argc) {
+            probe_file = argv[++i];
+        } else if (arg == "--traces" && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (arg == "--profiles" && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (arg == "--save-profiles" && i + 1 < argc) {
+            save_profile_file = argv[++i];
+        } else if (arg == "--multipliers" && i + 1 < argc) {
+            multiplier_file = argv[++i];
+        } else if (arg == "--trips" && i + 1 < argc) {
+            trip_file = argv[++i];
+        } else if (arg == "--demand" && i + 1 < argc) {
+            demand_file = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--traffic-intensity" && i + 1 < argc) {
+            traffic_intensity = std::stod(argv[++i]);
+        } else if (arg == "--reliable" && i + 1 < argc) {
+            reliability = std::stod(argv[++i]);
+        } else if (arg == "--close-way" && i + 1 < argc) {
+            closed_ways.push_back(std::stoll(argv[++i]));
+        } else if (arg == "--stops" && i + 1 < argc) {
+            tour_stops = std::stoi(argv[++i]);
+        } else if (arg == "--pois" && i + 1 < argc) {
+            poi_count = std::stoi(argv[++i]);
+        } else if (arg == "--vulnerability" && i + 1 < argc) {
+            vulnerability_trips = std::stoi(argv[++i]);
+        } else if (arg == "--simulate" && i + 1 < argc) {
+            fleet_size = std::stoul(argv[++i]);
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serve_port = std::stoi(argv[++i]);
+        } else if (arg == "--route-format" && i + 1 < argc) {
+            if (!parseRouteFormat(argv[++i], route_format)) {
+                std::cerr << "Error: Unknown route format " << argv[i] << " (json, polyline or binary)\n";
+                return 1;
+            }
+        } else if (arg == "--live" && i + 1 < argc) {
+            live_port = std::stoi(argv[++i]);
+        } else if (arg == "--serve-bench" && i + 1 < argc) {
+            serve_bench_requests = std::stoul(argv[++i]);
+        } else if (arg == "--turn-costs") {
+            turn_costs = true;
+        } else if (arg == "--what-if" && i + 1 < argc) {
+            what_if_trips = std::stoi(argv[++i]);
+        } else if (arg == "--pareto") {
+            pareto = true;
+        } else if (arg == "--vehicle" && i + 1 < argc) {
+            vehicles.push_back(argv[++i]);
+        } else if (arg == "--avoid" && i + 1 < argc) {
+            std::string avoid = argv[++i];
+            if (avoid.find("motorways") != std::string::npos) avoid_flags |= AVOID_MOTORWAYS;
+            if (avoid.find("tolls") != std::string::npos) avoid_flags |= AVOID_TOLLS;
+            if (avoid.find("residential") != std::string::npos) avoid_flags |= AVOID_RESIDENTIAL;
+        }
+    }
+    
     std::cout << "\n";
     std::cout << "================================================================\n";
     std::cout << "       GPS ROUTE OPTIMIZER: Evidence-Based Routing Demo       \n";
@@ -194,12 +727,75 @@ int main() {
     std::cout << "\n";
     graph.printStats();
     
-    std::cout << "\nApplying crowd-sourced learning patterns...\n";
-    std::cout << "   (Simulating data from millions of real drives)\n";
-    graph.applyLearnedPatterns();
+    if (!profile_file.empty()) {
+        std::shared_ptr<SpeedProfileStore> profiles = SpeedProfileStore::load(profile_file);
+        if (!profiles || profiles->edgeCount() != graph.edgeCount()) {
+            std::cerr << "Speed profiles do not match this map" << std::endl;
+            return 1;
+        }
+        std::cout << "\nLoaded " << profiles->shapeCount() << " speed profile shapes from "
+                  << profile_file << "\n";
+        graph.setSpeedProfiles(profiles);
+    }
+    
+    if (!trip_file.empty()) {
+        if (!fitToTrips(graph, trip_file)) {
+            return 1;
+        }
+    } else if (!multiplier_file.empty()) {
+        if (!importMultipliers(graph, multiplier_file)) {
+            return 1;
+        }
+    } else if (!probe_file.empty()) {
+        if (!learnFromProbes(graph, probe_file, save_profile_file)) {
+            return 1;
+        }
+    } else if (!trace_file.empty()) {
+        if (!learnFromTraces(graph, trace_file, save_profile_file)) {
+            return 1;
+        }
+    } else if (!demand_file.empty()) {
+        if (!assignDemand(graph, demand_file)) {
+            return 1;
+        }
+    } else if (traffic_intensity >= 0.0) {
+        std::cout << "\nGenerating spatially correlated traffic (seed " << seed
+                  << ", intensity " << traffic_intensity << ")...\n";
+        TrafficGeneratorOptions options;
+        options.seed = seed;
+        options.intensity = traffic_intensity;
+        TrafficGenerator(graph, options).apply();
+    } else {
+        std::cout << "\nApplying crowd-sourced learning patterns...\n";
+        std::cout << "   (Simulating data from millions of real drives)\n";
+        graph.applyLearnedPatterns(seed);
+    }
+    
+    // With --what-if the ways stay open and are evaluated as a scenario instead
+    if (!closed_ways.empty() && what_if_trips == 0) {
+        EdgeKeyIndex index(graph);
+        RoadClosures closures(graph, index);
+        for (long long way_id : closed_ways) {
+            size_t closed = closures.closeWay(way_id);
+            std::cout << "\nClosed way " << way_id << " (" << closed << " directed edges)";
+        }
+        std::cout << "\n";
+    }
+    
+    uint64_t avoided_classes = graph.avoidMask(avoid_flags);
+    if (avoided_classes != 0) {
+        std::cout << "\nAvoiding road classes:";
+        for (size_t c = 0; c < graph.roadClassCount(); c++) {
+            if ((avoided_classes >> c) & 1) {
+                std::cout << " " << graph.roadClassType((uint8_t)c)
+                          << (graph.roadClassIsToll((uint8_t)c) ? " (toll)" : "");
+            }
+        }
+        std::cout << "\n";
+    }
     
     std::cout << "\nFinding sample routes...\n";
-    auto sampleNodes = getRandomConnectedNodes(graph, 10);
+    auto sampleNodes = getRandomConnectedNodes(graph, std::max(10, tour_stops), seed);
     
     if (sampleNodes.size() < 2) {
         std::cout << "Could not find connected nodes in the graph.\n";
@@ -217,21 +813,104 @@ int main() {
     std::vector<RouteResult> routes;
     
     std::cout << "\n   [1/3] Pure distance optimization...\n";
-    routes.push_back(graph.dijkstra(sampleNodes[0], sampleNodes[1], RouteMode::DISTANCE, hour));
+    routes.push_back(graph.dijkstra(sampleNodes[0], sampleNodes[1], RouteMode::DISTANCE, hour,
+                                    avoided_classes));
     
     std::cout << "   [2/3] Speed limit optimization (Traditional GPS)...\n";
-    routes.push_back(graph.dijkstra(sampleNodes[0], sampleNodes[1], RouteMode::SPEED_LIMIT, hour));
+    routes.push_back(graph.dijkstra(sampleNodes[0], sampleNodes[1], RouteMode::SPEED_LIMIT, hour,
+                                    avoided_classes));
     
     std::cout << "   [3/3] Learned pattern optimization (Advanced)...\n";
-    routes.push_back(graph.dijkstra(sampleNodes[0], sampleNodes[1], RouteMode::LEARNED, hour));
+    routes.push_back(graph.dijkstra(sampleNodes[0], sampleNodes[1], RouteMode::LEARNED, hour,
+                                    avoided_classes));
     
     // Print comparison
     printRouteComparison(routes);
     
-    // Export for visualization
-    exportRouteToJSON(graph, routes, "web/routes.json");
+    if (reliability > 0.0) {
+        printReliableRoutes(graph, sampleNodes[0], sampleNodes[1], hour, reliability, seed,
+                            avoided_classes);
+    }
+    
+    if (pareto) {
+        printParetoRoutes(graph, sampleNodes[0], sampleNodes[1], hour, avoided_classes);
+    }
+    
+    if (tour_stops > 1) {
+        std::vector<long long> stops(sampleNodes.begin(),
+                                     sampleNodes.begin() + std::min((size_t)tour_stops, sampleNodes.size()));
+        printTour(graph, stops, hour, avoided_classes);
+    }
+    
+    if (poi_count > 0) {
+        printNearestPois(graph, sampleNodes[0], poi_count, hour, seed);
+    }
+    
+    if (vulnerability_trips > 0) {
+        printVulnerability(graph, vulnerability_trips, hour, seed);
+    }
+    
+    if (turn_costs) {
+        printTurnAwareRoute(graph, sampleNodes[0], sampleNodes[1], hour, routes[2], seed);
+    }
+    
+    if (what_if_trips > 0) {
+        if (closed_ways.empty()) {
+            std::cerr << "Error: --what-if needs at least one --close-way" << std::endl;
+        } else {
+            printWhatIf(graph, closed_ways, what_if_trips, hour, seed);
+        }
+    }
+    
+    if (serve_bench_requests > 0) {
+        benchmarkServer(graph, sampleNodes, serve_bench_requests, avoided_classes);
+    }
+    
+    if (fleet_size > 0) {
+        printFleetSimulation(graph, fleet_size, hour, seed);
+    }
+    
+    if (!vehicles.empty()) {
+        printVehicleRoutes(graph, vehicles, sampleNodes[0], sampleNodes[1], hour, avoided_classes);
+    }
+    
+    // The router serves the viewer itself when it is serving HTTP; routes are
+    // pushed to open pages instead of being written to web/routes.json
+    std::string route_file = route_format == RouteFormat::BINARY ? "web/routes.bin" : "web/routes.json";
+    std::unique_ptr<SpatialIndex> server_index;
+    std::unique_ptr<RouteServer> server;
+    if (serve_port >= 0 || live_port >= 0) {
+        server_index = std::make_unique<SpatialIndex>(graph);
+        RouteServerOptions options;
+        options.port = serve_port >= 0 ? serve_port : live_port;
+        options.avoided_classes = avoided_classes;
+        server = std::make_unique<RouteServer>(graph, *server_index, options);
+        if (!server->start()) {
+            return 1;
+        }
+        pushRoutes(*server, routes);
+        std::cout << "Open http://" << options.bind_address << ":" << server->port()
+                  << "/ in your browser to see the routes visualized live!\n\n";
+    } else {
+        // Export for visualization
+        exportRoutes(graph, routes, route_file, route_format);
 
-    std::cout << "Open web/index.html in your browser to see the routes visualized!\n\n";
+        std::cout << "Open web/index.html in your browser to see the routes visualized!\n\n";
+    }
+
+    // Serve HTTP instead of the interactive prompt
+    if (serve_port >= 0) {
+        std::cout << "Serving on port " << server->port()
+                  << " (/route, /compare, /matrix, /snap, /stats, /events). Ctrl+C to stop.\n";
+        std::signal(SIGINT, onStopSignal);
+        std::signal(SIGTERM, onStopSignal);
+        while (!stop_requested) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        server->stop();
+        std::cout << "Served " << server->requestsServed() << " requests.\n";
+        return 0;
+    }
 
     // Interactive mode
     std::cout << "================================================================\n";
@@ -265,15 +944,24 @@ int main() {
         
         std::cout << "\nCalculating routes...\n";
         
+        // Live viewers draw each route as soon as its search finishes
         std::vector<RouteResult> custom_routes;
-        custom_routes.push_back(graph.dijkstra(start, end, RouteMode::DISTANCE, user_hour));
-        custom_routes.push_back(graph.dijkstra(start, end, RouteMode::SPEED_LIMIT, user_hour));
-        custom_routes.push_back(graph.dijkstra(start, end, RouteMode::LEARNED, user_hour));
+        uint64_t query = server ? server->newQuery() : 0;
+        for (RouteMode mode : {RouteMode::DISTANCE, RouteMode::SPEED_LIMIT, RouteMode::LEARNED}) {
+            custom_routes.push_back(graph.dijkstra(start, end, mode, user_hour, avoided_classes));
+            if (server) {
+                server->pushRoute(query, custom_routes.size() - 1, 3, custom_routes.back());
+            }
+        }
         
         printRouteComparison(custom_routes);
-        exportRouteToJSON(graph, custom_routes, "web/routes.json");
-        
-        std::cout << "Routes updated in web visualization!\n";
+        if (server) {
+            std::cout << "Routes pushed to " << server->viewerCount() << " live viewer(s)!\n";
+        } else {
+            exportRoutes(graph, custom_routes, route_file, route_format);
+            
+            std::cout << "Routes updated in web visualization!\n";
+        }
     }
     
     std::cout << "\nThanks for exploring Evidence-Based Routing!\n\n";
@@ -0,0 +1,294 @@
+#include "map_matcher.h"
+#include "geo.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+const double kImpossible = -std::numeric_limits<double>::infinity();
+
+// One Viterbi step: candidates for a GPS point plus best scores/back pointers
+struct Layer {
+    size_t point;
+    std::vector<EdgeCandidate> candidates;
+    std::vector<double> scores;   // log probability of the best path ending here
+    std::vector<int> back;        // best predecessor in the previous layer, -1 = segment start
+};
+
+size_t argmax(const std::vector<double>& values) {
+    return std::max_element(values.begin(), values.end()) - values.begin();
+}
+
+}  // namespace
+
+MapMatcher::MapMatcher(const Graph& graph, const SpatialIndex& index, MapMatchOptions options)
+    : graph(graph), index(index), options(options), cache(new CacheShard[kCacheShards]) {}
+
+std::vector<double> MapMatcher::nodeDistances(long long source,
+                                              const std::vector<long long>& targets) const {
+    std::vector<double> result(targets.size());
+    std::vector<long long> missing;
+    std::vector<size_t> missing_slots;
+
+    CacheShard& shard = cache[std::hash<long long>()(source) % kCacheShards];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (size_t i = 0; i < targets.size(); i++) {
+            auto it = shard.distances.find({source, targets[i]});
+            if (it != shard.distances.end()) {
+                result[i] = it->second;
+            } else {
+                missing.push_back(targets[i]);
+                missing_slots.push_back(i);
+            }
+        }
+    }
+    cache_hits += targets.size() - missing.size();
+    if (missing.empty()) {
+        return result;
+    }
+    cache_misses += missing.size();
+
+    // One bounded search answers every uncached target of this source
+    searches++;
+    std::vector<double> found = graph.boundedDistances(source, missing, options.max_route_distance_m);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.distances.size() > options.cache_capacity / kCacheShards) {
+        shard.distances.clear();
+    }
+    for (size_t i = 0; i < missing.size(); i++) {
+        shard.distances[{source, missing[i]}] = found[i];
+        result[missing_slots[i]] = found[i];
+    }
+    return result;
+}
+
+MatchResult MapMatcher::match(const GpsTrace& trace) const {
+    MatchResult result;
+    result.vehicle_id = trace.vehicle_id;
+    result.points.resize(trace.points.size(), {false, 0, 0.0, 0});
+    for (size_t i = 0; i < trace.points.size(); i++) {
+        result.points[i].timestamp = trace.points[i].timestamp;
+    }
+
+    std::vector<Layer> layers;
+    const double sigma = options.gps_sigma_m;
+
+    for (size_t p = 0; p < trace.points.size(); p++) {
+        const TracePoint& point = trace.points[p];
+        Layer layer;
+        layer.point = p;
+        layer.candidates = index.nearestEdges(point.lat, point.lon, options.search_radius_m,
+                                              options.max_candidates);
+        if (layer.candidates.empty()) {
+            continue;   // off-road point; bridge over it
+        }
+
+        size_t n = layer.candidates.size();
+        std::vector<double> emission(n);
+        for (size_t j = 0; j < n; j++) {
+            double z = layer.candidates[j].distance / sigma;
+            emission[j] = -0.5 * z * z;
+        }
+        layer.scores.assign(n, kImpossible);
+        layer.back.assign(n, -1);
+
+        if (!layers.empty()) {
+            const Layer& prev = layers.back();
+            const TracePoint& prev_point = trace.points[prev.point];
+            double straight = haversineDistance(prev_point.lat, prev_point.lon, point.lat, point.lon);
+            double dt = (double)(point.timestamp - prev_point.timestamp);
+            double max_travel = dt > 0 ? options.max_speed_kmh / 3.6 * dt : options.max_route_distance_m;
+
+            std::vector<long long> targets(n);
+            for (size_t j = 0; j < n; j++) {
+                targets[j] = graph.getEdgeSource(layer.candidates[j].edge_id);
+            }
+
+            // Batch: previous candidates ending at the same node share one search
+            std::unordered_map<long long, std::vector<double>> from_node;
+            for (const auto& candidate : prev.candidates) {
+                long long node = graph.getEdge(candidate.edge_id)->to;
+                if (!from_node.count(node)) {
+                    from_node[node] = nodeDistances(node, targets);
+                }
+            }
+
+            for (size_t i = 0; i < prev.candidates.size(); i++) {
+                if (prev.scores[i] == kImpossible) {
+                    continue;
+                }
+                const EdgeCandidate& a = prev.candidates[i];
+                const Edge* edge_a = graph.getEdge(a.edge_id);
+                const std::vector<double>& dists = from_node[edge_a->to];
+
+                for (size_t j = 0; j < n; j++) {
+                    const EdgeCandidate& b = layer.candidates[j];
+                    double route;
+                    if (a.edge_id == b.edge_id && b.fraction >= a.fraction) {
+                        route = (b.fraction - a.fraction) * edge_a->segment->distance;
+                    } else {
+                        const Edge* edge_b = graph.getEdge(b.edge_id);
+                        route = (1.0 - a.fraction) * edge_a->segment->distance + dists[j] +
+                                b.fraction * edge_b->segment->distance;
+                    }
+                    if (!std::isfinite(route) || route > max_travel) {
+                        continue;
+                    }
+
+                    double transition = -std::fabs(route - straight) / options.transition_beta_m;
+                    double score = prev.scores[i] + transition + emission[j];
+                    if (score > layer.scores[j]) {
+                        layer.scores[j] = score;
+                        layer.back[j] = (int)i;
+                    }
+                }
+            }
+        }
+
+        // First point, or no candidate reachable from the previous step:
+        // start a new matched segment
+        if (layer.scores[argmax(layer.scores)] == kImpossible) {
+            if (!layers.empty()) {
+                result.breaks++;
+            }
+            layer.scores = emission;
+            std::fill(layer.back.begin(), layer.back.end(), -1);
+        }
+        layers.push_back(std::move(layer));
+    }
+
+    if (layers.empty()) {
+        return result;
+    }
+
+    // Backtrack, jumping to the best end state of the previous segment at breaks
+    std::vector<bool> segment_start(trace.points.size(), false);
+    size_t choice = argmax(layers.back().scores);
+    for (size_t l = layers.size(); l-- > 0;) {
+        const Layer& layer = layers[l];
+        const EdgeCandidate& candidate = layer.candidates[choice];
+        result.points[layer.point] = {true, candidate.edge_id, candidate.fraction,
+                                      trace.points[layer.point].timestamp};
+
+        if (l == 0) {
+            segment_start[layer.point] = true;
+        } else if (layer.back[choice] < 0) {
+            segment_start[layer.point] = true;
+            choice = argmax(layers[l - 1].scores);
+        } else {
+            choice = (size_t)layer.back[choice];
+        }
+    }
+
+    buildRoute(result, segment_start);
+    return result;
+}
+
+void MapMatcher::buildRoute(MatchResult& result, const std::vector<bool>& segment_start) const {
+    const MatchedPoint* prev = nullptr;
+    std::vector<size_t> between;
+
+    for (size_t p = 0; p < result.points.size(); p++) {
+        const MatchedPoint& point = result.points[p];
+        if (!point.matched) {
+            continue;
+        }
+        if (!prev || segment_start[p]) {
+            if (result.route.empty() || result.route.back() != point.edge_id) {
+                result.route.push_back(point.edge_id);
+            }
+            prev = &point;
+            continue;
+        }
+
+        // Edges driven between the two points, and the distance covered
+        const Edge* edge_a = graph.getEdge(prev->edge_id);
+        double driven;
+        std::vector<size_t> legs;
+        if (prev->edge_id == point.edge_id && point.fraction >= prev->fraction) {
+            legs.push_back(point.edge_id);
+            driven = (point.fraction - prev->fraction) * edge_a->segment->distance;
+        } else if (graph.boundedEdgePath(edge_a->to, graph.getEdgeSource(point.edge_id),
+                                         options.max_route_distance_m, between)) {
+            legs.push_back(prev->edge_id);
+            driven = (1.0 - prev->fraction) * edge_a->segment->distance;
+            for (size_t edge_id : between) {
+                legs.push_back(edge_id);
+                driven += graph.getEdge(edge_id)->segment->distance;
+            }
+            legs.push_back(point.edge_id);
+            driven += point.fraction * graph.getEdge(point.edge_id)->segment->distance;
+        } else {
+            prev = &point;
+            continue;
+        }
+
+        for (size_t edge_id : legs) {
+            if (result.route.empty() || result.route.back() != edge_id) {
+                result.route.push_back(edge_id);
+            }
+        }
+
+        long long dt = point.timestamp - prev->timestamp;
+        if (dt > 0 && driven > 0.0) {
+            double speed_kmh = driven / dt * 3.6;
+            for (size_t edge_id : legs) {
+                result.traversals.push_back({edge_id, prev->timestamp, speed_kmh});
+            }
+        }
+        prev = &point;
+    }
+}
+
+std::vector<MatchResult> MapMatcher::matchAll(const std::vector<GpsTrace>& traces) const {
+    std::vector<MatchResult> results(traces.size());
+    parallelForEach(traces.size(), [&](size_t i, unsigned) {
+        results[i] = match(traces[i]);
+    }, options.threads);
+    return results;
+}
+
+MatchCacheStats MapMatcher::cacheStats() const {
+    return {cache_hits.load(), cache_misses.load(), searches.load()};
+}
+
+std::vector<GpsTrace> MapMatcher::loadTracesCSV(const std::string& filename) {
+    std::vector<GpsTrace> traces;
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open trace file " << filename << std::endl;
+        return traces;
+    }
+
+    std::unordered_map<long long, size_t> trace_of_vehicle;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] < '0' || line[0] > '9') {
+            continue;
+        }
+        long long vehicle_id;
+        TracePoint point;
+        char comma;
+        std::istringstream fields(line);
+        if (fields >> vehicle_id >> comma >> point.timestamp >> comma >> point.lat >> comma >> point.lon) {
+            auto it = trace_of_vehicle.emplace(vehicle_id, traces.size()).first;
+            if (it->second == traces.size()) {
+                traces.push_back({vehicle_id, {}});
+            }
+            traces[it->second].points.push_back(point);
+        }
+    }
+
+    for (GpsTrace& trace : traces) {
+        std::stable_sort(trace.points.begin(), trace.points.end(),
+                         [](const TracePoint& a, const TracePoint& b) { return a.timestamp < b.timestamp; });
+    }
+    return traces;
+}
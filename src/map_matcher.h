@@ -0,0 +1,118 @@
+#ifndef MAP_MATCHER_H
+#define MAP_MATCHER_H
+
+#include "graph.h"
+#include "spatial_index.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct TracePoint {
+    long long timestamp;   // unix seconds
+    double lat;
+    double lon;
+};
+
+struct GpsTrace {
+    long long vehicle_id;
+    std::vector<TracePoint> points;
+};
+
+struct MatchedPoint {
+    bool matched;          // false if no road was within the search radius
+    size_t edge_id;
+    double fraction;       // position along the edge (0 = source, 1 = target)
+    long long timestamp;
+};
+
+// Travel speed derived from two consecutive matched points, credited to
+// every edge driven between them
+struct EdgeTraversal {
+    size_t edge_id;
+    long long timestamp;
+    double speed_kmh;
+};
+
+struct MatchResult {
+    long long vehicle_id;
+    std::vector<MatchedPoint> points;
+    std::vector<size_t> route;               // driven edges in order
+    std::vector<EdgeTraversal> traversals;
+    int breaks = 0;                          // places where the HMM had to restart
+};
+
+struct MapMatchOptions {
+    double search_radius_m = 50.0;
+    size_t max_candidates = 6;
+    double gps_sigma_m = 10.0;           // emission: GPS noise standard deviation
+    double transition_beta_m = 5.0;      // transition: route vs. straight-line tolerance
+    double max_route_distance_m = 2000.0;
+    double max_speed_kmh = 200.0;        // transitions faster than this are impossible
+    size_t cache_capacity = 1 << 20;     // cached (from, to) node distances
+    unsigned threads = 0;                // 0 = all hardware threads
+};
+
+struct MatchCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t searches = 0;
+};
+
+// Hidden-Markov-Model map matcher (Newson & Krumm style).
+//
+// Hidden states are candidate edges near each GPS point; emission
+// probabilities fall off with distance from the road, transition
+// probabilities with the difference between network and straight-line
+// distance. Network distances come from bounded searches on the Graph: all
+// transitions out of one node at a step share a single search, and results
+// are kept in a sharded cache shared by all matching threads.
+class MapMatcher {
+public:
+    MapMatcher(const Graph& graph, const SpatialIndex& index, MapMatchOptions options = {});
+
+    MatchResult match(const GpsTrace& trace) const;
+
+    // Independent traces are matched in parallel
+    std::vector<MatchResult> matchAll(const std::vector<GpsTrace>& traces) const;
+
+    MatchCacheStats cacheStats() const;
+
+    // CSV: vehicle_id,timestamp,lat,lon[,...] (header line skipped; extra
+    // columns such as probe speed are ignored). Points are grouped into one
+    // trace per vehicle and sorted by time.
+    static std::vector<GpsTrace> loadTracesCSV(const std::string& filename);
+
+private:
+    static constexpr size_t kCacheShards = 64;
+
+    struct NodePairHash {
+        size_t operator()(const std::pair<long long, long long>& key) const {
+            return std::hash<long long>()(key.first * 1000003LL ^ key.second);
+        }
+    };
+
+    struct alignas(64) CacheShard {
+        std::mutex mutex;
+        std::unordered_map<std::pair<long long, long long>, double, NodePairHash> distances;
+    };
+
+    const Graph& graph;
+    const SpatialIndex& index;
+    MapMatchOptions options;
+
+    std::unique_ptr<CacheShard[]> cache;
+    mutable std::atomic<size_t> cache_hits{0};
+    mutable std::atomic<size_t> cache_misses{0};
+    mutable std::atomic<size_t> searches{0};
+
+    // Network distances from one node to many, served from cache where possible
+    std::vector<double> nodeDistances(long long source, const std::vector<long long>& targets) const;
+
+    void buildRoute(MatchResult& result, const std::vector<bool>& segment_start) const;
+};
+
+#endif
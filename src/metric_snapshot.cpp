@@ -0,0 +1,140 @@
+#include "metric_snapshot.h"
+#include <limits>
+#include <thread>
+
+namespace {
+
+// Epoch-based reclamation state shared by all metric stores.
+// Each reading thread owns one slot and announces the global epoch it observed
+// while it holds at least one ReadGuard. Slots are cache-line sized so that
+// readers on different cores never write to the same line.
+constexpr int kMaxReaderSlots = 256;
+constexpr uint64_t kIdle = std::numeric_limits<uint64_t>::max();
+
+struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch{kIdle};
+    std::atomic<bool> owned{false};
+};
+
+ReaderSlot reader_slots[kMaxReaderSlots];
+std::atomic<uint64_t> global_epoch{1};
+
+struct ThreadReader {
+    int slot = -1;
+    int depth = 0;   // nested guards on this thread share one announcement
+
+    ~ThreadReader() {
+        if (slot >= 0) {
+            reader_slots[slot].epoch.store(kIdle);
+            reader_slots[slot].owned.store(false);
+        }
+    }
+
+    void claimSlot() {
+        while (true) {
+            for (int i = 0; i < kMaxReaderSlots; i++) {
+                bool expected = false;
+                if (!reader_slots[i].owned.load(std::memory_order_relaxed) &&
+                    reader_slots[i].owned.compare_exchange_strong(expected, true)) {
+                    slot = i;
+                    return;
+                }
+            }
+            // More concurrent reader threads than slots: wait for one to exit
+            std::this_thread::yield();
+        }
+    }
+};
+
+thread_local ThreadReader thread_reader;
+
+void enterEpoch() {
+    ThreadReader& reader = thread_reader;
+    if (reader.depth++ > 0) {
+        return;
+    }
+    if (reader.slot < 0) {
+        reader.claimSlot();
+    }
+    reader_slots[reader.slot].epoch.store(global_epoch.load());
+}
+
+void exitEpoch() {
+    ThreadReader& reader = thread_reader;
+    if (--reader.depth == 0) {
+        reader_slots[reader.slot].epoch.store(kIdle);
+    }
+}
+
+uint64_t oldestActiveEpoch() {
+    uint64_t oldest = kIdle;
+    for (int i = 0; i < kMaxReaderSlots; i++) {
+        uint64_t epoch = reader_slots[i].epoch.load();
+        if (epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+}  // namespace
+
+MetricStore::ReadGuard::ReadGuard(ReadGuard&& other) noexcept : snapshot(other.snapshot) {
+    other.snapshot = nullptr;
+}
+
+MetricStore::ReadGuard::~ReadGuard() {
+    if (snapshot) {
+        exitEpoch();
+    }
+}
+
+MetricStore::MetricStore() : current(new MetricSnapshot{0, {}}), next_version(1) {}
+
+MetricStore::~MetricStore() {
+    // No readers may outlive the store, so everything can be freed directly
+    delete current.load();
+    for (const auto& entry : retired) {
+        delete entry.second;
+    }
+}
+
+MetricStore::ReadGuard MetricStore::acquire() const {
+    // The announcement must be visible before the pointer is loaded; both use
+    // sequentially consistent ordering so a writer scanning the slots after
+    // its swap either sees this reader or this reader sees the new snapshot.
+    enterEpoch();
+    return ReadGuard(current.load());
+}
+
+uint64_t MetricStore::publish(std::vector<double> crowd_multipliers) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+
+    uint64_t version = next_version++;
+    const MetricSnapshot* fresh = new MetricSnapshot{version, std::move(crowd_multipliers)};
+    const MetricSnapshot* old = current.exchange(fresh);
+
+    // Readers that announce an epoch after this increment load the new pointer
+    retired.push_back({global_epoch.fetch_add(1), old});
+    reclaim();
+
+    return version;
+}
+
+uint64_t MetricStore::version() const {
+    return acquire()->version;
+}
+
+void MetricStore::reclaim() {
+    uint64_t oldest = oldestActiveEpoch();
+
+    size_t kept = 0;
+    for (const auto& entry : retired) {
+        if (entry.first < oldest) {
+            delete entry.second;
+        } else {
+            retired[kept++] = entry;
+        }
+    }
+    retired.resize(kept);
+}
@@ -0,0 +1,71 @@
+#ifndef METRIC_SNAPSHOT_H
+#define METRIC_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Immutable per-edge metric data. A snapshot is never modified after it has
+// been published, so any number of queries can read it without locking.
+struct MetricSnapshot {
+    uint64_t version;
+    std::vector<double> crowd_multipliers;   // indexed by Edge::id
+
+    // Edges added after this snapshot was built fall back to "normal" traffic
+    double crowdMultiplier(size_t edge_id) const {
+        return edge_id < crowd_multipliers.size() ? crowd_multipliers[edge_id] : 1.0;
+    }
+};
+
+// Publishes metric snapshots through an atomic pointer (read-copy-update).
+// Readers pin the current snapshot with acquire() and keep it until the guard
+// goes out of scope; writers swap in a new snapshot and retire the old one.
+// Retired snapshots are freed with epoch-based reclamation once no reader
+// that could still see them is active. Readers never take a lock.
+class MetricStore {
+public:
+    class ReadGuard {
+    public:
+        ReadGuard(ReadGuard&& other) noexcept;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard();
+
+        const MetricSnapshot& operator*() const { return *snapshot; }
+        const MetricSnapshot* operator->() const { return snapshot; }
+        const MetricSnapshot* get() const { return snapshot; }
+
+    private:
+        friend class MetricStore;
+        explicit ReadGuard(const MetricSnapshot* snapshot) : snapshot(snapshot) {}
+
+        const MetricSnapshot* snapshot;
+    };
+
+    MetricStore();
+    ~MetricStore();
+    MetricStore(const MetricStore&) = delete;
+    MetricStore& operator=(const MetricStore&) = delete;
+
+    // Pin the current snapshot (lock-free, wait-free after a thread's first call)
+    ReadGuard acquire() const;
+
+    // Publish a new snapshot and return its version. Writers are serialized.
+    uint64_t publish(std::vector<double> crowd_multipliers);
+
+    uint64_t version() const;
+
+private:
+    std::atomic<const MetricSnapshot*> current;
+
+    std::mutex writer_mutex;
+    uint64_t next_version;
+    std::vector<std::pair<uint64_t, const MetricSnapshot*>> retired;  // (retire epoch, snapshot)
+
+    void reclaim();
+};
+
+#endif
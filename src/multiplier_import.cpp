@@ -0,0 +1,251 @@
+#include "multiplier_import.h"
+#include "parallel.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+bool readFile(const std::string& filename, std::string& contents) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open multiplier file " << filename << std::endl;
+        return false;
+    }
+    contents.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(&contents[0], contents.size());
+    return true;
+}
+
+double elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+EdgeKeyIndex::EdgeKeyIndex(const Graph& graph) : graph(graph) {
+    way_segments.reserve(graph.edgeCount());
+    for (size_t id = 0; id < graph.edgeCount(); id++) {
+        const EdgeOrigin& origin = graph.getEdgeOrigin(id);
+        if (origin.way_id == 0) {
+            continue;
+        }
+        way_segments[pack(origin.way_id, origin.segment, origin.forward)] = id;
+        way_edges[origin.way_id].push_back(id);
+    }
+}
+
+uint64_t EdgeKeyIndex::pack(long long way_id, int segment, bool forward) {
+    // OSM caps ways at 2000 nodes, so 12 bits of segment index are plenty
+    return ((uint64_t)way_id << 13) | ((uint64_t)(segment & 0xFFF) << 1) | (forward ? 1 : 0);
+}
+
+bool EdgeKeyIndex::findWaySegment(long long way_id, int segment, bool forward, size_t& edge_id) const {
+    if (segment < 0 || segment > 0xFFF) {
+        return false;
+    }
+    auto it = way_segments.find(pack(way_id, segment, forward));
+    if (it == way_segments.end()) {
+        return false;
+    }
+    edge_id = it->second;
+    return true;
+}
+
+bool EdgeKeyIndex::findNodePair(long long from, long long to, size_t& edge_id) const {
+    const auto* edges = graph.getEdges(from);
+    if (!edges) {
+        return false;
+    }
+    for (const auto& edge : *edges) {
+        if (edge.to == to) {
+            edge_id = edge.id;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<size_t> EdgeKeyIndex::edgesOfWay(long long way_id) const {
+    auto it = way_edges.find(way_id);
+    return it != way_edges.end() ? it->second : std::vector<size_t>();
+}
+
+MultiplierImporter::MultiplierImporter(Graph& graph, const EdgeKeyIndex& index,
+                                       MultiplierImportOptions options)
+    : graph(graph), index(index), options(options) {}
+
+void MultiplierImporter::noteUnmatched(WorkerResult& out, const std::string& key) const {
+    out.report.unmatched++;
+    if (out.report.unmatched_samples.size() < options.max_unmatched_samples) {
+        out.report.unmatched_samples.push_back(key);
+    }
+}
+
+void MultiplierImporter::parseCSVRange(const char* begin, const char* end, WorkerResult& out) const {
+    const char* p = begin;
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        if (*p < '0' || *p > '9') {
+            p = line_end + 1;
+            continue;
+        }
+        out.report.records++;
+
+        // Count fields to tell the two key formats apart
+        int commas = 0;
+        for (const char* c = p; c < line_end; c++) {
+            commas += (*c == ',');
+        }
+
+        char* q;
+        size_t edge_id;
+        bool found = false;
+        bool ok = false;
+        double multiplier = 0.0;
+
+        long long a = std::strtoll(p, &q, 10);
+        if (commas == 3 && *q == ',') {
+            long long segment = std::strtoll(q + 1, &q, 10);
+            if (*q == ',' && (q[1] == 'f' || q[1] == 'b') && q[2] == ',') {
+                bool forward = (q[1] == 'f');
+                multiplier = std::strtod(q + 3, &q);
+                ok = true;
+                found = index.findWaySegment(a, (int)segment, forward, edge_id);
+            }
+        } else if (commas == 2 && *q == ',') {
+            long long b = std::strtoll(q + 1, &q, 10);
+            if (*q == ',') {
+                multiplier = std::strtod(q + 1, &q);
+                ok = true;
+                found = index.findNodePair(a, b, edge_id);
+            }
+        }
+
+        if (!ok || !(multiplier > 0.0)) {
+            out.report.malformed++;
+        } else if (!found) {
+            noteUnmatched(out, std::string(p, line_end - p));
+        } else {
+            out.report.matched++;
+            out.updates.push_back({edge_id, multiplier});
+        }
+        p = line_end + 1;
+    }
+}
+
+MultiplierImportReport MultiplierImporter::importCSV(const std::string& filename) {
+    auto start = std::chrono::steady_clock::now();
+    std::string contents;
+    if (!readFile(filename, contents)) {
+        return {};
+    }
+
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    const char* data = contents.data();
+    size_t size = contents.size();
+
+    // Newline-aligned ranges, one per worker
+    std::vector<size_t> bounds(num_threads + 1, size);
+    bounds[0] = 0;
+    for (unsigned w = 1; w < num_threads; w++) {
+        size_t pos = std::max(bounds[w - 1], size * w / num_threads);
+        const char* nl = pos < size ? static_cast<const char*>(std::memchr(data + pos, '\n', size - pos)) : nullptr;
+        bounds[w] = nl ? (size_t)(nl - data) + 1 : size;
+    }
+
+    std::vector<WorkerResult> results(num_threads);
+    parallelFor(num_threads, [&](size_t begin, size_t end, unsigned) {
+        for (size_t w = begin; w < end; w++) {
+            parseCSVRange(data + bounds[w], data + bounds[w + 1], results[w]);
+        }
+    }, num_threads);
+
+    MultiplierImportReport report = finish(results);
+    report.seconds = elapsedSince(start);
+    return report;
+}
+
+MultiplierImportReport MultiplierImporter::importBinary(const std::string& filename) {
+    auto start = std::chrono::steady_clock::now();
+    std::string contents;
+    if (!readFile(filename, contents)) {
+        return {};
+    }
+
+    size_t count = contents.size() / sizeof(MultiplierRecord);
+    const char* data = contents.data();
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<WorkerResult> results(num_threads);
+
+    parallelFor(count, [&](size_t begin, size_t end, unsigned worker) {
+        WorkerResult& out = results[worker];
+        for (size_t i = begin; i < end; i++) {
+            MultiplierRecord record;
+            std::memcpy(&record, data + i * sizeof(MultiplierRecord), sizeof(record));
+            out.report.records++;
+
+            size_t edge_id;
+            bool found;
+            if (record.kind == 0) {
+                found = index.findNodePair(record.key_a, record.key_b, edge_id);
+            } else if (record.kind == 1 || record.kind == 2) {
+                found = index.findWaySegment(record.key_a, (int)record.key_b, record.kind == 1, edge_id);
+            } else {
+                out.report.malformed++;
+                continue;
+            }
+
+            if (!(record.multiplier > 0.0f)) {
+                out.report.malformed++;
+            } else if (!found) {
+                noteUnmatched(out, std::to_string(record.kind) + ":" + std::to_string(record.key_a) +
+                                   ":" + std::to_string(record.key_b));
+            } else {
+                out.report.matched++;
+                out.updates.push_back({edge_id, record.multiplier});
+            }
+        }
+    }, num_threads);
+
+    MultiplierImportReport report = finish(results);
+    report.seconds = elapsedSince(start);
+    return report;
+}
+
+MultiplierImportReport MultiplierImporter::finish(std::vector<WorkerResult>& results) {
+    std::vector<double> multipliers;
+    if (options.keep_unlisted) {
+        auto metric = graph.currentMetric();
+        multipliers = metric->crowd_multipliers;
+    }
+    multipliers.resize(graph.edgeCount(), 1.0);
+
+    // Workers hold consecutive ranges, so applying them in order keeps file order
+    MultiplierImportReport report;
+    for (auto& result : results) {
+        for (const auto& update : result.updates) {
+            multipliers[update.edge_id] = update.multiplier;
+        }
+        report.records += result.report.records;
+        report.matched += result.report.matched;
+        report.unmatched += result.report.unmatched;
+        report.malformed += result.report.malformed;
+        for (auto& sample : result.report.unmatched_samples) {
+            if (report.unmatched_samples.size() < options.max_unmatched_samples) {
+                report.unmatched_samples.push_back(std::move(sample));
+            }
+        }
+    }
+
+    if (report.matched > 0) {
+        report.version = graph.publishMetric(std::move(multipliers));
+    }
+    return report;
+}
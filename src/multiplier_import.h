@@ -0,0 +1,94 @@
+#ifndef MULTIPLIER_IMPORT_H
+#define MULTIPLIER_IMPORT_H
+
+#include "graph.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Maps stable external edge keys to dense edge ids.
+// Keys are either (way id, segment index, direction) or a directed node pair;
+// node pairs need no extra index because the adjacency list already is one.
+class EdgeKeyIndex {
+public:
+    explicit EdgeKeyIndex(const Graph& graph);
+
+    // Returns false if the key does not name an edge in this graph
+    bool findWaySegment(long long way_id, int segment, bool forward, size_t& edge_id) const;
+    bool findNodePair(long long from, long long to, size_t& edge_id) const;
+
+    // All edges of a way, both directions
+    std::vector<size_t> edgesOfWay(long long way_id) const;
+
+private:
+    const Graph& graph;
+    std::unordered_map<uint64_t, size_t> way_segments;              // packed key -> edge id
+    std::unordered_map<long long, std::vector<size_t>> way_edges;   // way id -> edge ids
+
+    static uint64_t pack(long long way_id, int segment, bool forward);
+};
+
+// Binary multiplier record (little-endian, 24 bytes).
+// kind 0: node pair key_a -> key_b; kind 1/2: way key_a, segment key_b,
+// forward/backward direction.
+#pragma pack(push, 1)
+struct MultiplierRecord {
+    int64_t key_a;
+    int64_t key_b;
+    float multiplier;
+    uint32_t kind;
+};
+#pragma pack(pop)
+
+struct MultiplierImportOptions {
+    bool keep_unlisted = false;     // start from the live snapshot instead of 1.0
+    size_t max_unmatched_samples = 20;
+    unsigned threads = 0;           // 0 = all hardware threads
+};
+
+struct MultiplierImportReport {
+    size_t records = 0;
+    size_t matched = 0;
+    size_t unmatched = 0;
+    size_t malformed = 0;
+    std::vector<std::string> unmatched_samples;   // first few unknown keys, as written
+    uint64_t version = 0;                         // published snapshot, 0 if none
+    double seconds = 0.0;
+};
+
+// Loads crowd multipliers computed elsewhere and publishes them as a new
+// metric snapshot, replacing the simulated applyLearnedPatterns values.
+//
+// CSV lines are either "way_id,segment,f|b,multiplier" or
+// "from_node,to_node,multiplier" (lines not starting with a digit are
+// skipped). Files are parsed in parallel, newline-aligned ranges per
+// thread; within a file, later lines win.
+class MultiplierImporter {
+public:
+    MultiplierImporter(Graph& graph, const EdgeKeyIndex& index, MultiplierImportOptions options = {});
+
+    MultiplierImportReport importCSV(const std::string& filename);
+    MultiplierImportReport importBinary(const std::string& filename);
+
+private:
+    struct Update {
+        size_t edge_id;
+        double multiplier;
+    };
+
+    struct WorkerResult {
+        std::vector<Update> updates;
+        MultiplierImportReport report;
+    };
+
+    Graph& graph;
+    const EdgeKeyIndex& index;
+    MultiplierImportOptions options;
+
+    void parseCSVRange(const char* begin, const char* end, WorkerResult& out) const;
+    void noteUnmatched(WorkerResult& out, const std::string& key) const;
+    MultiplierImportReport finish(std::vector<WorkerResult>& results);
+};
+
+#endif
@@ -1,26 +1,14 @@
 #include "osm_parser.h"
+#include "geo.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cmath>
 #include <vector>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
 // Calculate distance between two lat/lon points in meters
 double OSMParser::haversineDistance(double lat1, double lon1, double lat2, double lon2) {
-    const double R = 6371000.0; // Earth radius in meters
-    double dLat = (lat2 - lat1) * M_PI / 180.0;
-    double dLon = (lon2 - lon1) * M_PI / 180.0;
-    
-    double a = sin(dLat/2) * sin(dLat/2) +
-               cos(lat1 * M_PI / 180.0) * cos(lat2 * M_PI / 180.0) *
-               sin(dLon/2) * sin(dLon/2);
-    double c = 2 * atan2(sqrt(a), sqrt(1-a));
-    
-    return R * c;
+    return ::haversineDistance(lat1, lon1, lat2, lon2);
 }
 
 bool OSMParser::parseOSM(const std::string& filename, Graph& graph) {
@@ -36,7 +24,17 @@ bool OSMParser::parseOSM(const std::string& filename, Graph& graph) {
     bool inWay = false;
     bool isHighway = false;
     std::string highwayType = "unclassified";
+    bool isToll = false;
     std::vector<long long> wayNodes;
+    long long wayId = 0;
+    
+    // Turn restriction relation being read
+    bool inRelation = false;
+    bool isRestriction = false;
+    std::string restrictionType;
+    bool motorcarRestriction = false;
+    long long fromWay = 0, viaNode = 0, toWay = 0;
+    int restrictionCount = 0;
     
     int nodeCount = 0;
     int wayCount = 0;
@@ -69,7 +67,13 @@ bool OSMParser::parseOSM(const std::string& filename, Graph& graph) {
         if (line.find("<way") != std::string::npos) {
             inWay = true;
             isHighway = false;
+            wayId = 0;
+            size_t id_pos = line.find("id=\"");
+            if (id_pos != std::string::npos) {
+                sscanf(line.c_str() + id_pos, "id=\"%lld\"", &wayId);
+            }
             highwayType = "unclassified";
+            isToll = false;
             wayNodes.clear();
         }
         
@@ -85,6 +89,10 @@ bool OSMParser::parseOSM(const std::string& filename, Graph& graph) {
             }
         }
         
+        if (inWay && line.find("<tag k=\"toll\"") != std::string::npos) {
+            isToll = line.find("v=\"yes\"") != std::string::npos;
+        }
+        
         if (inWay && line.find("<nd ref=") != std::string::npos) {
             long long node_id;
             size_t ref_pos = line.find("ref=\"");
@@ -103,8 +111,8 @@ bool OSMParser::parseOSM(const std::string& filename, Graph& graph) {
                     if (node1 && node2) {
                         double dist = haversineDistance(node1->lat, node1->lon, 
                                                        node2->lat, node2->lon);
-                        graph.addEdge(wayNodes[i], wayNodes[i + 1], dist, highwayType);
-                        graph.addEdge(wayNodes[i + 1], wayNodes[i], dist, highwayType);
+                        graph.addRoad(wayNodes[i], wayNodes[i + 1], dist, highwayType,
+                                      wayId, (int)i, isToll);
                     }
                 }
                 wayCount++;
@@ -115,11 +123,69 @@ bool OSMParser::parseOSM(const std::string& filename, Graph& graph) {
             }
             inWay = false;
         }
+        
+        // Parse turn restrictions (only the common way-node-way form)
+        if (line.find("<relation") != std::string::npos) {
+            inRelation = true;
+            isRestriction = false;
+            restrictionType.clear();
+            motorcarRestriction = false;
+            fromWay = viaNode = toWay = 0;
+        }
+        
+        if (inRelation && line.find("<tag k=\"type\" v=\"restriction\"") != std::string::npos) {
+            isRestriction = true;
+        }
+        
+        // restriction=* or restriction:motorcar=*, which wins in either order;
+        // other vehicles' restrictions (hgv, bus, ...) don't apply to cars
+        bool motorcarTag = line.find("<tag k=\"restriction:motorcar\"") != std::string::npos;
+        if (inRelation && (motorcarTag || (!motorcarRestriction &&
+                                           line.find("<tag k=\"restriction\"") != std::string::npos))) {
+            size_t v_pos = line.find("v=\"");
+            if (v_pos != std::string::npos) {
+                size_t v_end = line.find("\"", v_pos + 3);
+                if (v_end != std::string::npos) {
+                    restrictionType = line.substr(v_pos + 3, v_end - v_pos - 3);
+                    motorcarRestriction = motorcarTag;
+                }
+            }
+        }
+        
+        if (inRelation && line.find("<member") != std::string::npos) {
+            long long ref = 0;
+            size_t ref_pos = line.find("ref=\"");
+            if (ref_pos != std::string::npos) {
+                sscanf(line.c_str() + ref_pos, "ref=\"%lld\"", &ref);
+            }
+            bool isWay = line.find("type=\"way\"") != std::string::npos;
+            if (isWay && line.find("role=\"from\"") != std::string::npos) {
+                fromWay = ref;
+            } else if (isWay && line.find("role=\"to\"") != std::string::npos) {
+                toWay = ref;
+            } else if (line.find("type=\"node\"") != std::string::npos &&
+                       line.find("role=\"via\"") != std::string::npos) {
+                viaNode = ref;
+            }
+        }
+        
+        if (line.find("</relation>") != std::string::npos) {
+            bool only = restrictionType.compare(0, 5, "only_") == 0;
+            bool no = restrictionType.compare(0, 3, "no_") == 0;
+            if (isRestriction && (only || no) && fromWay != 0 && viaNode != 0 && toWay != 0) {
+                graph.addTurnRestriction({fromWay, viaNode, toWay, only});
+                restrictionCount++;
+            }
+            inRelation = false;
+        }
     }
     
     file.close();
     std::cout << "\nParsing complete!" << std::endl;
     std::cout << "  Total nodes: " << nodeCount << std::endl;
     std::cout << "  Total ways: " << wayCount << std::endl;
+    if (restrictionCount > 0) {
+        std::cout << "  Turn restrictions: " << restrictionCount << std::endl;
+    }
     return true;
 }
\ No newline at end of file
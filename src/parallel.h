@@ -0,0 +1,77 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+inline unsigned hardwareThreads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Split [0, count) into one contiguous chunk per worker and run
+// fn(begin, end, worker) on each. Worker indices are dense, so callers can
+// keep per-worker state (accumulators, search workspaces) in a plain vector.
+template <typename Fn>
+void parallelFor(size_t count, Fn fn, unsigned num_threads = 0) {
+    if (num_threads == 0) {
+        num_threads = hardwareThreads();
+    }
+    num_threads = (unsigned)std::min<size_t>(num_threads, count);
+    if (num_threads <= 1) {
+        if (count > 0) {
+            fn((size_t)0, count, 0u);
+        }
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+    size_t chunk = (count + num_threads - 1) / num_threads;
+    for (unsigned w = 0; w < num_threads; w++) {
+        size_t begin = w * chunk;
+        size_t end = std::min(count, begin + chunk);
+        if (begin >= end) {
+            break;
+        }
+        workers.emplace_back([=, &fn]() { fn(begin, end, w); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Dynamically scheduled loop for items of uneven cost (routing queries,
+// traces of different lengths): workers pull fn(index, worker) one at a time.
+template <typename Fn>
+void parallelForEach(size_t count, Fn fn, unsigned num_threads = 0) {
+    if (num_threads == 0) {
+        num_threads = hardwareThreads();
+    }
+    num_threads = (unsigned)std::min<size_t>(num_threads, count);
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i, 0u);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+    for (unsigned w = 0; w < num_threads; w++) {
+        workers.emplace_back([&, w]() {
+            for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+                fn(i, w);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+#endif
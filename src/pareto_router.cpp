@@ -0,0 +1,158 @@
+#include "pareto_router.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+ParetoRouter::ParetoRouter(const Graph& graph, ParetoRouteOptions options)
+    : graph(graph), options(options) {}
+
+bool ParetoRouter::usable(const Edge& edge) const {
+    if ((options.avoided_classes >> edge.road_class) & 1) {
+        return false;
+    }
+    return graph.closedEdgeCount() == 0 || !graph.isEdgeClosed(edge.id);
+}
+
+std::vector<RouteResult> ParetoRouter::route(long long start_id, long long end_id, int hour_of_day) {
+    last_stats = ParetoStats();
+    std::vector<RouteResult> frontier;
+
+    uint32_t source, target;
+    if (!graph.getNodeIndex(start_id, source) || !graph.getNodeIndex(end_id, target)) {
+        return frontier;
+    }
+
+    auto metric = graph.currentMetric();
+    auto edgeTime = [&](const Edge& edge) { return graph.learnedTravelTime(edge, hour_of_day, *metric); };
+    auto edgeDistance = [](const Edge& edge) { return edge.segment->distance; };
+
+    // Exact cost-to-target for every node, one search per criterion
+    RoadClassFilter filter{options.avoided_classes};
+    graph.shortestPathTree(target, time_bounds, edgeTime, true, filter);
+    graph.shortestPathTree(target, distance_bounds, edgeDistance, true, filter);
+    if (!time_bounds.reached(source)) {
+        return frontier;
+    }
+
+    if (node_labels.size() < graph.nodeIndexCount()) {
+        node_labels.resize(graph.nodeIndexCount());
+    }
+    for (uint32_t node : touched_nodes) {
+        node_labels[node].clear();
+    }
+    touched_nodes.clear();
+    labels.clear();
+
+    // Queue ordered lexicographically by (time, distance) lower bounds
+    using QueueEntry = std::tuple<double, double, uint32_t>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+    // Epsilon dominance: without it, float noise between equal-length grid
+    // paths makes thousands of near-identical labels "non-dominated"
+    const double slack = 1.0 + options.epsilon;
+    auto dominates = [slack](double time_a, double distance_a, double time_b, double distance_b) {
+        return time_a <= time_b * slack && distance_a <= distance_b * slack;
+    };
+    
+    std::vector<NodeLabel> target_labels;
+    auto dominatedAtTarget = [&](double time, double distance) {
+        for (const auto& t : target_labels) {
+            if (dominates(t.time, t.distance, time, distance)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Insert a label at a node unless dominated; drops labels it dominates
+    auto insert = [&](uint32_t node, double time, double distance, uint32_t parent, size_t edge_id) {
+        auto& bag = node_labels[node];
+        for (const auto& existing : bag) {
+            if (dominates(existing.time, existing.distance, time, distance)) {
+                return;
+            }
+        }
+        double time_bound = time + time_bounds.distance(node);
+        double distance_bound = distance + distance_bounds.distance(node);
+        if (dominatedAtTarget(time_bound, distance_bound)) {
+            last_stats.pruned_by_target++;
+            return;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < bag.size(); i++) {
+            if (time <= bag[i].time && distance <= bag[i].distance) {   // strictly, so labels never cycle
+                labels[bag[i].label].dead = true;
+            } else {
+                bag[kept++] = bag[i];
+            }
+        }
+        bag.resize(kept);
+        if (bag.empty()) {
+            touched_nodes.push_back(node);
+        }
+
+        uint32_t index = (uint32_t)labels.size();
+        labels.push_back({time, distance, node, parent, edge_id, false});
+        bag.push_back({time, distance, index});
+        queue.push({time_bound, distance_bound, index});
+        last_stats.labels_created++;
+    };
+
+    insert(source, 0.0, 0.0, kNoParent, SearchWorkspace::kNoEdge);
+
+    while (!queue.empty()) {
+        uint32_t index = std::get<2>(queue.top());
+        queue.pop();
+        if (labels[index].dead) {
+            continue;
+        }
+        Label label = labels[index];
+        // Bounds may have improved since this label was queued
+        if (dominatedAtTarget(label.time + time_bounds.distance(label.node),
+                              label.distance + distance_bounds.distance(label.node))) {
+            last_stats.pruned_by_target++;
+            continue;
+        }
+        last_stats.labels_settled++;
+
+        if (label.node == target) {
+            target_labels.push_back({label.time, label.distance, index});
+            continue;
+        }
+        if (labels.size() >= options.max_labels) {
+            last_stats.complete = false;
+            break;
+        }
+
+        const auto* edges = graph.getEdgesByIndex(label.node);
+        if (!edges) {
+            continue;
+        }
+        for (const auto& edge : *edges) {
+            if (!usable(edge) || !time_bounds.reached(edge.to_index)) {
+                continue;
+            }
+            insert(edge.to_index, label.time + edgeTime(edge), label.distance + edge.segment->distance,
+                   index, edge.id);
+        }
+    }
+
+    // Settled in (time, distance) order, so target labels come out fastest first
+    for (size_t k = 0; k < target_labels.size(); k++) {
+        RouteResult result;
+        result.mode = RouteMode::LEARNED;
+        result.mode_name = "Pareto " + std::to_string(k + 1) + "/" + std::to_string(target_labels.size());
+        result.total_distance = target_labels[k].distance;
+        result.estimated_time = target_labels[k].time;
+        for (uint32_t i = target_labels[k].label; labels[i].parent != kNoParent; i = labels[i].parent) {
+            result.edge_path.push_back(labels[i].edge_id);
+        }
+        std::reverse(result.edge_path.begin(), result.edge_path.end());
+        result.path = graph.pathNodes(start_id, result.edge_path);
+        frontier.push_back(std::move(result));
+    }
+    return frontier;
+}
@@ -0,0 +1,70 @@
+#ifndef PARETO_ROUTER_H
+#define PARETO_ROUTER_H
+
+#include "graph.h"
+#include "search_workspace.h"
+#include <cstdint>
+#include <vector>
+
+struct ParetoRouteOptions {
+    uint64_t avoided_classes = 0;   // road-class mask, see Graph::avoidMask
+    size_t max_labels = 2000000;    // give up (returning the frontier so far) beyond this
+    double epsilon = 0.001;         // a label within this relative margin on both criteria counts as no better
+};
+
+struct ParetoStats {
+    size_t labels_created = 0;
+    size_t labels_settled = 0;
+    size_t pruned_by_target = 0;
+    bool complete = true;           // false if max_labels was hit
+};
+
+// Bi-criteria routing: every route that is not beaten on both travel time
+// (LEARNED metric) and distance.
+//
+// Label-setting search with one small label vector per node (time, distance
+// and a back pointer, stored contiguously). Two backward single-criterion
+// searches from the target give exact lower bounds for time and distance,
+// which order the queue A*-style and let a label be discarded as soon as a
+// target label dominates its optimistic completion.
+class ParetoRouter {
+public:
+    ParetoRouter(const Graph& graph, ParetoRouteOptions options = {});
+
+    // Frontier sorted by travel time (fastest first, shortest last)
+    std::vector<RouteResult> route(long long start_id, long long end_id, int hour_of_day);
+
+    const ParetoStats& stats() const { return last_stats; }
+
+private:
+    struct Label {
+        double time;
+        double distance;
+        uint32_t node;
+        uint32_t parent;     // label index, kNoParent at the start
+        size_t edge_id;      // edge into node
+        bool dead;           // dominated after it was queued
+    };
+
+    struct NodeLabel {
+        double time;
+        double distance;
+        uint32_t label;
+    };
+
+    static constexpr uint32_t kNoParent = UINT32_MAX;
+
+    const Graph& graph;
+    ParetoRouteOptions options;
+    ParetoStats last_stats;
+
+    // Reused across queries
+    std::vector<Label> labels;
+    std::vector<std::vector<NodeLabel>> node_labels;   // by node index
+    std::vector<uint32_t> touched_nodes;
+    SearchWorkspace time_bounds, distance_bounds;
+
+    bool usable(const Edge& edge) const;
+};
+
+#endif
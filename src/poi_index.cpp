@@ -0,0 +1,257 @@
+#include "poi_index.h"
+#include "counter_rng.h"
+#include "parallel.h"
+#include "search_workspace.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const double kInf = std::numeric_limits<double>::infinity();
+
+// Float landmark distances round; shave bounds so they stay admissible
+const double kBoundSlack = 1.0 - 1e-5;
+
+double edgeLength(const Edge& edge) {
+    return edge.segment->distance;
+}
+
+}  // namespace
+
+PoiIndex::PoiIndex(const Graph& graph, PoiIndexOptions options) : graph(graph), options(options) {
+    size_t node_count = graph.nodeIndexCount();
+    size_t L = std::max(options.landmarks, 0);
+    if (node_count == 0 || L == 0) {
+        return;
+    }
+    L = std::min(L, node_count);
+    from_landmark.assign(node_count * L, (float)kInf);
+    to_landmark.assign(node_count * L, (float)kInf);
+
+    // Farthest-point selection: each landmark is the node farthest (among
+    // reachable ones) from all landmarks chosen so far
+    SearchWorkspace workspace;
+    std::vector<double> nearest_landmark(node_count, kInf);
+    uint32_t next = (uint32_t)(counterRandom(options.seed, 0, 0) % node_count);
+    std::vector<uint32_t> chosen;
+    for (size_t l = 0; l < L; l++) {
+        chosen.push_back(next);
+        graph.shortestPathTree(next, workspace, edgeLength);
+        double farthest = -1.0;
+        for (uint32_t v = 0; v < node_count; v++) {
+            double d = workspace.distance(v);
+            from_landmark[v * L + l] = (float)d;
+            if (d < kInf) {
+                nearest_landmark[v] = std::min(nearest_landmark[v], d);
+                if (nearest_landmark[v] > farthest) {
+                    farthest = nearest_landmark[v];
+                    next = v;
+                }
+            }
+        }
+    }
+
+    // Distances to the landmarks are independent, so run them in parallel
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<SearchWorkspace> workspaces(num_threads);
+    parallelForEach(L, [&](size_t l, unsigned worker) {
+        SearchWorkspace& ws = workspaces[worker];
+        graph.shortestPathTree(chosen[l], ws, edgeLength, true);
+        for (uint32_t v = 0; v < node_count; v++) {
+            to_landmark[v * L + l] = (float)ws.distance(v);
+        }
+    }, num_threads);
+
+    for (uint32_t node : chosen) {
+        landmark_nodes.push_back(graph.getNodeId(node));
+    }
+}
+
+bool PoiIndex::insert(long long object_id, long long node) {
+    uint32_t index;
+    if (!graph.getNodeIndex(node, index)) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(objects_mutex);
+    auto it = object_slots.find(object_id);
+    if (it != object_slots.end()) {
+        objects[it->second].node = index;
+        return true;
+    }
+    object_slots.emplace(object_id, objects.size());
+    objects.push_back({object_id, index});
+    return true;
+}
+
+bool PoiIndex::remove(long long object_id) {
+    std::unique_lock<std::shared_mutex> lock(objects_mutex);
+    auto it = object_slots.find(object_id);
+    if (it == object_slots.end()) {
+        return false;
+    }
+    // Swap with the last object to keep the array dense
+    size_t slot = it->second;
+    object_slots.erase(it);
+    if (slot != objects.size() - 1) {
+        objects[slot] = objects.back();
+        object_slots[objects[slot].id] = slot;
+    }
+    objects.pop_back();
+    return true;
+}
+
+size_t PoiIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(objects_mutex);
+    return objects.size();
+}
+
+double PoiIndex::lowerBoundMeters(uint32_t from, uint32_t to) const {
+    size_t L = landmark_nodes.size();
+    double bound = 0.0;
+    const float* from_a = &from_landmark[from * L];
+    const float* from_b = &from_landmark[to * L];
+    const float* to_a = &to_landmark[from * L];
+    const float* to_b = &to_landmark[to * L];
+    for (size_t l = 0; l < L; l++) {
+        // d(L, to) <= d(L, from) + d(from, to) and d(from, L) <= d(from, to) + d(to, L)
+        if (from_a[l] < kInf && from_b[l] < kInf) {
+            bound = std::max(bound, (double)from_b[l] - from_a[l]);
+        }
+        if (to_a[l] < kInf && to_b[l] < kInf) {
+            bound = std::max(bound, (double)to_a[l] - to_b[l]);
+        }
+    }
+    return bound * kBoundSlack;
+}
+
+double PoiIndex::maxSpeed(const MetricSnapshot& metric, int hour_of_day) const {
+    std::lock_guard<std::mutex> lock(speed_mutex);
+    if (speed_version == metric.version && speed_hour == hour_of_day) {
+        return max_speed;
+    }
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<double> fastest(num_threads, 0.0);
+    parallelFor(graph.edgeCount(), [&](size_t begin, size_t end, unsigned worker) {
+        for (size_t id = begin; id < end; id++) {
+            const Edge& edge = *graph.getEdge(id);
+            double time = graph.learnedTravelTime(edge, hour_of_day, metric);
+            if (time > 0.0) {
+                fastest[worker] = std::max(fastest[worker], edge.segment->distance / time);
+            }
+        }
+    }, num_threads);
+    max_speed = *std::max_element(fastest.begin(), fastest.end());
+    speed_version = metric.version;
+    speed_hour = hour_of_day;
+    return max_speed;
+}
+
+std::vector<PoiMatch> PoiIndex::nearest(long long source_id, size_t k, RouteMode mode, int hour_of_day,
+                                        KnnStats* stats) const {
+    std::vector<PoiMatch> result;
+    uint32_t source;
+    if (k == 0 || !graph.getNodeIndex(source_id, source)) {
+        return result;
+    }
+
+    auto metric = graph.currentMetric();
+    bool by_time = (mode != RouteMode::DISTANCE);   // any time mode uses LEARNED times
+    double meters_to_cost = 1.0;
+    if (by_time) {
+        double speed = maxSpeed(*metric, hour_of_day);
+        meters_to_cost = speed > 0.0 ? 1.0 / speed : 0.0;
+    }
+    auto weight = [&](const Edge& edge) {
+        return by_time ? graph.learnedTravelTime(edge, hour_of_day, *metric) : edge.segment->distance;
+    };
+
+    // Rank every object by its lower bound
+    std::vector<std::pair<double, Object>> candidates;
+    {
+        std::shared_lock<std::shared_mutex> lock(objects_mutex);
+        candidates.reserve(objects.size());
+        for (const auto& object : objects) {
+            double bound = landmark_nodes.empty() ? 0.0 : lowerBoundMeters(source, object.node);
+            candidates.push_back({bound * meters_to_cost, object});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    static thread_local SearchWorkspace workspace;
+    const bool check_closures = graph.closedEdgeCount() > 0;
+    KnnStats local_stats;
+    std::unordered_map<uint32_t, double> exact;   // node -> cost, objects often share nodes
+
+    // A* to one node; gives up (infinity) once nothing cheaper than limit remains
+    auto exactCost = [&](uint32_t target, double limit) {
+        auto cached = exact.find(target);
+        if (cached != exact.end()) {
+            return cached->second;
+        }
+        auto heuristic = [&](uint32_t v) {
+            return landmark_nodes.empty() ? 0.0 : lowerBoundMeters(v, target) * meters_to_cost;
+        };
+        workspace.begin(graph.nodeIndexCount());
+        workspace.update(source, 0.0, SearchWorkspace::kNoEdge);
+        workspace.push(heuristic(source), source);
+        double cost = kInf;
+        while (!workspace.empty()) {
+            auto [key, current] = workspace.pop();
+            if (key >= limit) {
+                break;
+            }
+            double g = workspace.distance(current);
+            if (key > g + heuristic(current) + 1e-9) {
+                continue;   // stale entry
+            }
+            local_stats.nodes_settled++;
+            if (current == target) {
+                cost = g;
+                break;
+            }
+            const auto* edges = graph.getEdgesByIndex(current);
+            if (!edges) {
+                continue;
+            }
+            for (const auto& edge : *edges) {
+                if (check_closures && graph.isEdgeClosed(edge.id)) {
+                    continue;
+                }
+                double new_g = g + weight(edge);
+                if (new_g < workspace.distance(edge.to_index)) {
+                    workspace.update(edge.to_index, new_g, edge.id);
+                    workspace.push(new_g + heuristic(edge.to_index), edge.to_index);
+                }
+            }
+        }
+        if (cost < kInf) {
+            exact[target] = cost;   // a cut-off result is only valid for this limit
+        }
+        return cost;
+    };
+
+    for (const auto& [bound, object] : candidates) {
+        double kth = result.size() == k ? result.back().cost : kInf;
+        if (bound >= kth) {
+            break;   // no remaining object can beat the current k-th
+        }
+        local_stats.candidates_checked++;
+        double cost = exactCost(object.node, kth);
+        if (cost >= kth) {
+            continue;
+        }
+        PoiMatch match{object.id, graph.getNodeId(object.node), cost};
+        auto pos = std::upper_bound(result.begin(), result.end(), match,
+                                    [](const PoiMatch& a, const PoiMatch& b) { return a.cost < b.cost; });
+        result.insert(pos, match);
+        if (result.size() > k) {
+            result.pop_back();
+        }
+    }
+
+    if (stats) {
+        *stats = local_stats;
+    }
+    return result;
+}
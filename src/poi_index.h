@@ -0,0 +1,84 @@
+#ifndef POI_INDEX_H
+#define POI_INDEX_H
+
+#include "graph.h"
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+struct PoiIndexOptions {
+    int landmarks = 8;        // more landmarks = tighter bounds, 8 bytes per node each
+    uint64_t seed = 42;       // picks the first landmark
+    unsigned threads = 0;     // 0 = all hardware threads (preprocessing only)
+};
+
+struct PoiMatch {
+    long long object_id;
+    long long node;
+    double cost;              // meters (DISTANCE) or seconds (LEARNED)
+};
+
+struct KnnStats {
+    size_t candidates_checked = 0;   // objects whose exact cost was computed
+    size_t nodes_settled = 0;
+};
+
+// Network-distance k-nearest-neighbor queries over movable objects
+// (charging stations, available drivers).
+//
+// Objects sit on graph nodes and can be inserted, moved and removed in O(1).
+// Preprocessing picks landmarks by farthest-point sampling and stores the
+// distance to and from each of them for every node (ALT). A query ranks all
+// objects by their landmark lower bound, then confirms candidates in that
+// order with A* searches cut off at the current k-th best cost, and stops
+// as soon as the next lower bound cannot beat it. Far-away objects are never
+// searched for, which is what makes sparse targets cheap.
+//
+// Landmark distances are in meters; LEARNED queries turn them into time
+// bounds with the fastest edge speed of the current snapshot.
+class PoiIndex {
+public:
+    PoiIndex(const Graph& graph, PoiIndexOptions options = {});
+
+    // Adds the object, or moves it if it already exists; false if node is unknown
+    bool insert(long long object_id, long long node);
+    bool remove(long long object_id);
+    size_t size() const;
+
+    // Up to k objects by network cost from source, nearest first
+    std::vector<PoiMatch> nearest(long long source, size_t k, RouteMode mode = RouteMode::DISTANCE,
+                                  int hour_of_day = 12, KnnStats* stats = nullptr) const;
+
+    const std::vector<long long>& landmarkNodes() const { return landmark_nodes; }
+
+private:
+    struct Object {
+        long long id;
+        uint32_t node;
+    };
+
+    const Graph& graph;
+    PoiIndexOptions options;
+
+    // Landmark distances, node-major: [node * L + l]
+    std::vector<long long> landmark_nodes;
+    std::vector<float> from_landmark;   // d(landmark, node)
+    std::vector<float> to_landmark;     // d(node, landmark)
+
+    mutable std::shared_mutex objects_mutex;
+    std::vector<Object> objects;                         // dense, for bound scans
+    std::unordered_map<long long, size_t> object_slots;  // object id -> index in objects
+
+    // Fastest speed (m/s) of the snapshot, cached per (version, hour)
+    mutable std::mutex speed_mutex;
+    mutable uint64_t speed_version = UINT64_MAX;
+    mutable int speed_hour = -1;
+    mutable double max_speed = 0.0;
+
+    double lowerBoundMeters(uint32_t from, uint32_t to) const;
+    double maxSpeed(const MetricSnapshot& metric, int hour_of_day) const;
+};
+
+#endif
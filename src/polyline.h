@@ -0,0 +1,41 @@
+#ifndef POLYLINE_H
+#define POLYLINE_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+// Google encoded polyline: coordinates rounded to 1e-5 degrees, delta-coded
+// against the previous point, zigzagged and written as 5-bit groups offset
+// into printable ASCII ('?' to '~'). Typically 4-8 bytes per point instead
+// of ~40 in JSON. The output can contain '\', so escape it inside JSON.
+inline void appendPolylineValue(std::string& out, long long delta) {
+    uint64_t value = (uint64_t)delta << 1;
+    if (delta < 0) {
+        value = ~value;
+    }
+    while (value >= 0x20) {
+        out += (char)((0x20 | (value & 0x1F)) + 63);
+        value >>= 5;
+    }
+    out += (char)(value + 63);
+}
+
+class PolylineEncoder {
+public:
+    explicit PolylineEncoder(std::string& out) : out(out) {}
+
+    void add(double lat, double lon) {
+        long long ilat = std::llround(lat * 1e5), ilon = std::llround(lon * 1e5);
+        appendPolylineValue(out, ilat - last_lat);
+        appendPolylineValue(out, ilon - last_lon);
+        last_lat = ilat;
+        last_lon = ilon;
+    }
+
+private:
+    std::string& out;
+    long long last_lat = 0, last_lon = 0;
+};
+
+#endif
@@ -0,0 +1,345 @@
+#include "probe_ingest.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Observed/expected ratios outside this range are GPS glitches, not traffic
+constexpr double kMinRatio = 0.05;
+constexpr double kMaxRatio = 3.0;
+
+double headingDifference(double a, double b) {
+    double diff = std::fabs(a - b);
+    return diff > 180.0 ? 360.0 - diff : diff;
+}
+
+}  // namespace
+
+ProbeIngestor::ProbeIngestor(Graph& graph, const SpatialIndex& index, ProbeIngestOptions options)
+    : graph(graph), index(index), options(options) {
+    num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    size_t capacity = 64;
+    while (capacity < options.shard_cells) {
+        capacity <<= 1;
+    }
+    shards.resize(num_threads);
+    for (Shard& shard : shards) {
+        shard.cells.resize(capacity);
+    }
+
+    auto metric = graph.currentMetric();
+    base_multipliers = metric->crowd_multipliers;
+    growToGraph();
+}
+
+// Accept edges added to the graph since the last call. Only called between
+// parallel batches, so workers never see the arrays move.
+void ProbeIngestor::growToGraph() {
+    size_t edges = graph.edgeCount();
+    if (edges > edge_totals.size()) {
+        edge_totals.resize(edges);
+        base_multipliers.resize(edges, 1.0);
+    }
+}
+
+int ProbeIngestor::slotOf(long long timestamp) const {
+    long long local = timestamp + (long long)(options.utc_offset_hours * 3600.0);
+    long long seconds_of_day = ((local % 86400) + 86400) % 86400;
+    return (int)(seconds_of_day / kSecondsPerSlot);
+}
+
+bool ProbeIngestor::record(size_t edge_id, long long timestamp, double speed_kmh, Shard& shard) {
+    const Edge* edge = edge_id < edge_totals.size() ? graph.getEdge(edge_id) : nullptr;
+    if (!edge) {
+        return false;
+    }
+    int slot = slotOf(timestamp);
+    double expected = graph.getSlotSpeed(*edge, slot);
+    if (expected <= 0.0) {
+        return true;
+    }
+
+    uint64_t key = (uint64_t)edge_id * kSlotsPerDay + slot;
+    size_t mask = shard.cells.size() - 1;
+    size_t index = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (shard.cells[index].key != key && shard.cells[index].key != kEmptyCell) {
+        index = (index + 1) & mask;
+    }
+    Cell& cell = shard.cells[index];
+    if (cell.key == kEmptyCell) {
+        cell.key = key;
+        shard.touched.push_back(index);
+    }
+    cell.ratio_sum += (float)std::clamp(speed_kmh / expected, kMinRatio, kMaxRatio);
+    cell.count++;
+
+    // Keep probe sequences short: spill into the totals at 3/4 load
+    if (shard.touched.size() * 4 >= shard.cells.size() * 3) {
+        flush(shard);
+    }
+    return true;
+}
+
+// Merge a shard's cells into the totals and empty it. Workers flush only
+// their own shard; the lock orders them against each other.
+void ProbeIngestor::flush(Shard& shard) {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    for (size_t index : shard.touched) {
+        Cell& cell = shard.cells[index];
+        Accumulator& total = totals[cell.key];
+        total.ratio_sum += cell.ratio_sum;
+        total.count += cell.count;
+
+        Accumulator& edge_total = edge_totals[cell.key / kSlotsPerDay];
+        edge_total.ratio_sum += cell.ratio_sum;
+        edge_total.count += cell.count;
+        cell = Cell();
+    }
+    shard.touched.clear();
+}
+
+void ProbeIngestor::ingest(const Probe& probe, Shard& shard) {
+    shard.read++;
+    shard.latest = std::max(shard.latest, probe.timestamp);
+
+    if (probe.speed_kmh < 0.0) {
+        shard.rejected++;
+        return;
+    }
+
+    auto candidates = index.nearestEdges(probe.lat, probe.lon, options.match_radius_m);
+    if (candidates.empty()) {
+        shard.rejected++;
+        return;
+    }
+
+    if (probe.heading >= 0.0) {
+        // Pick the closest edge travelling in roughly the reported direction
+        const EdgeCandidate* best = nullptr;
+        for (const auto& candidate : candidates) {
+            double diff = headingDifference(probe.heading, index.edgeBearing(candidate.edge_id));
+            if (diff <= options.max_heading_diff) {
+                best = &candidate;
+                break;
+            }
+        }
+        if (!best) {
+            shard.rejected++;
+            return;
+        }
+        record(best->edge_id, probe.timestamp, probe.speed_kmh, shard);
+    } else {
+        // Without a heading both directions of a two-way road are equally
+        // likely; credit every edge that shares the closest geometry
+        double closest = candidates.front().distance;
+        for (const auto& candidate : candidates) {
+            if (candidate.distance > closest + 1.0) {
+                break;
+            }
+            record(candidate.edge_id, probe.timestamp, probe.speed_kmh, shard);
+        }
+    }
+    shard.matched++;
+}
+
+void ProbeIngestor::parseCSVRange(const char* begin, const char* end, Shard& shard) {
+    const char* p = begin;
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+
+        // Header or blank lines start with something other than a number
+        if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            Probe probe;
+            char* q;
+            probe.vehicle_id = std::strtoll(p, &q, 10);
+            bool ok = (*q == ',');
+            if (ok) { probe.timestamp = std::strtoll(q + 1, &q, 10); ok = (*q == ','); }
+            if (ok) { probe.lat = std::strtod(q + 1, &q); ok = (*q == ','); }
+            if (ok) { probe.lon = std::strtod(q + 1, &q); ok = (*q == ','); }
+            if (ok) { probe.speed_kmh = std::strtod(q + 1, &q); }
+            if (ok) {
+                probe.heading = (*q == ',') ? std::strtod(q + 1, &q) : -1.0;
+                ingest(probe, shard);
+            } else {
+                shard.read++;
+                shard.rejected++;
+            }
+        }
+        p = line_end + 1;
+    }
+}
+
+size_t ProbeIngestor::ingestCSV(std::istream& in) {
+    growToGraph();
+    size_t before = stats().probes_read;
+    std::string buffer;
+    std::string carry;
+
+    while (in) {
+        buffer.swap(carry);
+        carry.clear();
+        size_t filled = buffer.size();
+        buffer.resize(filled + options.chunk_bytes);
+        in.read(&buffer[filled], options.chunk_bytes);
+        buffer.resize(filled + in.gcount());
+
+        // Hold back a trailing partial line for the next chunk
+        if (in) {
+            size_t last_newline = buffer.rfind('\n');
+            if (last_newline == std::string::npos) {
+                carry.swap(buffer);
+                continue;
+            }
+            carry.assign(buffer, last_newline + 1, std::string::npos);
+            buffer.resize(last_newline + 1);
+        }
+        if (buffer.empty()) {
+            continue;
+        }
+
+        // One newline-aligned range per worker
+        const char* data = buffer.data();
+        size_t size = buffer.size();
+        std::vector<size_t> bounds(num_threads + 1, size);
+        bounds[0] = 0;
+        for (unsigned w = 1; w < num_threads; w++) {
+            size_t pos = std::max(bounds[w - 1], size * w / num_threads);
+            const char* nl = pos < size ? static_cast<const char*>(std::memchr(data + pos, '\n', size - pos)) : nullptr;
+            bounds[w] = nl ? (size_t)(nl - data) + 1 : size;
+        }
+
+        parallelFor(num_threads, [&](size_t begin, size_t end, unsigned) {
+            for (size_t w = begin; w < end; w++) {
+                parseCSVRange(data + bounds[w], data + bounds[w + 1], shards[w]);
+            }
+        }, num_threads);
+
+        maybePublish();
+    }
+
+    publish();
+    return stats().probes_read - before;
+}
+
+size_t ProbeIngestor::ingestBinary(std::istream& in) {
+    growToGraph();
+    size_t before = stats().probes_read;
+    std::vector<ProbeRecord> records(options.chunk_bytes / sizeof(ProbeRecord));
+
+    while (in) {
+        in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(ProbeRecord));
+        size_t count = in.gcount() / sizeof(ProbeRecord);
+        if (count == 0) {
+            break;
+        }
+
+        parallelFor(count, [&](size_t begin, size_t end, unsigned worker) {
+            Shard& shard = shards[worker];
+            for (size_t i = begin; i < end; i++) {
+                const ProbeRecord& r = records[i];
+                ingest({r.vehicle_id, r.timestamp, r.lat, r.lon, r.speed_kmh, r.heading}, shard);
+            }
+        }, num_threads);
+
+        maybePublish();
+    }
+
+    publish();
+    return stats().probes_read - before;
+}
+
+void ProbeIngestor::addProbes(const std::vector<Probe>& probes) {
+    growToGraph();
+    parallelFor(probes.size(), [&](size_t begin, size_t end, unsigned worker) {
+        for (size_t i = begin; i < end; i++) {
+            ingest(probes[i], shards[worker]);
+        }
+    }, num_threads);
+    maybePublish();
+}
+
+void ProbeIngestor::addObservation(size_t edge_id, long long timestamp, double speed_kmh) {
+    growToGraph();
+    // No workers run between calls, so worker 0's shard is free
+    Shard& shard = shards[0];
+    shard.read++;
+    if (record(edge_id, timestamp, speed_kmh, shard)) {
+        shard.matched++;
+        shard.latest = std::max(shard.latest, timestamp);
+    } else {
+        shard.rejected++;
+    }
+}
+
+void ProbeIngestor::maybePublish() {
+    long long latest = 0;
+    for (const auto& shard : shards) {
+        latest = std::max(latest, shard.latest);
+    }
+    if (last_publish_time == 0) {
+        last_publish_time = latest;
+    }
+    if (latest - last_publish_time >= options.publish_interval_s) {
+        publish();
+    }
+}
+
+uint64_t ProbeIngestor::publish() {
+    for (auto& shard : shards) {
+        flush(shard);
+
+        merged_stats.probes_read += shard.read;
+        merged_stats.probes_matched += shard.matched;
+        merged_stats.probes_rejected += shard.rejected;
+        last_publish_time = std::max(last_publish_time, shard.latest);
+        shard.read = shard.matched = shard.rejected = 0;
+    }
+
+    // Shrink each edge towards its prior multiplier until enough samples arrive
+    std::vector<double> multipliers = base_multipliers;
+    for (size_t id = 0; id < edge_totals.size(); id++) {
+        const Accumulator& acc = edge_totals[id];
+        if (acc.count == 0) {
+            continue;
+        }
+        double learned = (acc.ratio_sum + options.prior_weight * base_multipliers[id]) /
+                         (acc.count + options.prior_weight);
+        multipliers[id] = std::clamp(learned, options.min_multiplier, options.max_multiplier);
+    }
+
+    merged_stats.snapshots_published++;
+    return graph.publishMetric(std::move(multipliers));
+}
+
+std::vector<double> ProbeIngestor::slotRatios(size_t edge_id) const {
+    std::vector<double> ratios(kSlotsPerDay, 1.0);
+    for (int slot = 0; slot < kSlotsPerDay; slot++) {
+        auto it = totals.find((uint64_t)edge_id * kSlotsPerDay + slot);
+        if (it != totals.end() && it->second.count > 0) {
+            ratios[slot] = it->second.ratio_sum / it->second.count;
+        }
+    }
+    return ratios;
+}
+
+size_t ProbeIngestor::observationCount(size_t edge_id) const {
+    return edge_id < edge_totals.size() ? edge_totals[edge_id].count : 0;
+}
+
+ProbeIngestStats ProbeIngestor::stats() const {
+    ProbeIngestStats result = merged_stats;
+    for (const auto& shard : shards) {
+        result.probes_read += shard.read;
+        result.probes_matched += shard.matched;
+        result.probes_rejected += shard.rejected;
+    }
+    return result;
+}
@@ -0,0 +1,141 @@
+#ifndef PROBE_INGEST_H
+#define PROBE_INGEST_H
+
+#include "graph.h"
+#include "spatial_index.h"
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// One timestamped vehicle position report
+struct Probe {
+    long long vehicle_id;
+    long long timestamp;   // unix seconds (UTC)
+    double lat;
+    double lon;
+    double speed_kmh;
+    double heading;        // degrees clockwise from north, negative if unknown
+};
+
+// Fixed-size record of the binary probe format (little-endian, 32 bytes)
+#pragma pack(push, 1)
+struct ProbeRecord {
+    int64_t vehicle_id;
+    int64_t timestamp;
+    float lat;
+    float lon;
+    float speed_kmh;
+    float heading;
+};
+#pragma pack(pop)
+
+struct ProbeIngestOptions {
+    double match_radius_m = 25.0;      // probes farther than this from any road are dropped
+    double max_heading_diff = 60.0;    // degrees; rejects the opposite carriageway
+    double utc_offset_hours = -8.0;    // local time for slot assignment (Los Angeles)
+    long long publish_interval_s = 60; // probe time between snapshot publications
+    double prior_weight = 20.0;        // samples needed before data outweighs the old multiplier
+    double min_multiplier = 0.2;
+    double max_multiplier = 2.0;
+    unsigned threads = 0;              // 0 = all hardware threads
+    size_t chunk_bytes = 8 << 20;      // CSV read size per parallel batch
+    size_t shard_cells = 1 << 16;      // accumulator table entries per worker (16 bytes each)
+};
+
+struct ProbeIngestStats {
+    size_t probes_read = 0;
+    size_t probes_matched = 0;
+    size_t probes_rejected = 0;
+    size_t snapshots_published = 0;
+};
+
+// Learns crowd multipliers from a stream of GPS probes.
+//
+// Each probe is snapped to a directed edge and contributes the ratio
+// observed speed / expected speed (Graph::getTimeAdjustedSpeed) to an
+// accumulator for its (edge, time slot). Worker threads write only to their
+// own cache-line aligned shard, a fixed-size open-addressing table of
+// (edge, slot) cells, so recording a probe is a multiplicative hash, a short
+// probe and an add, with no atomics or allocation. Shards are merged into the
+// running totals when a snapshot is published, or under a lock when a
+// worker's table fills up; per-worker memory is shard_cells * 16 bytes
+// whatever the size of the graph.
+//
+// The ingestor parallelizes internally but is not thread-safe: call its
+// methods from one thread at a time.
+class ProbeIngestor {
+public:
+    ProbeIngestor(Graph& graph, const SpatialIndex& index, ProbeIngestOptions options = {});
+
+    // Stream formats. CSV columns: vehicle_id,timestamp,lat,lon,speed_kmh[,heading]
+    // (a header line is skipped). Both return the number of probes read and
+    // publish a snapshot every publish_interval_s of probe time.
+    size_t ingestCSV(std::istream& in);
+    size_t ingestBinary(std::istream& in);
+
+    // Already parsed probes, e.g. from a network feed
+    void addProbes(const std::vector<Probe>& probes);
+
+    // A travel speed already attributed to an edge (e.g. by map matching).
+    // Unknown edge ids are counted as rejected. Does not publish.
+    void addObservation(size_t edge_id, long long timestamp, double speed_kmh);
+
+    // Merge shards and publish a new metric snapshot; returns its version
+    uint64_t publish();
+
+    // Mean observed/expected ratio per time slot for one edge (1.0 where no data).
+    // Reflects data merged by the last publish().
+    std::vector<double> slotRatios(size_t edge_id) const;
+    size_t observationCount(size_t edge_id) const;
+
+    ProbeIngestStats stats() const;
+
+private:
+    struct Accumulator {
+        double ratio_sum = 0.0;
+        uint32_t count = 0;
+    };
+
+    static constexpr uint64_t kEmptyCell = ~0ULL;
+
+    struct Cell {
+        uint64_t key = kEmptyCell;   // edge id * kSlotsPerDay + slot
+        float ratio_sum = 0.0f;      // flushed at least every publish, so float is enough
+        uint32_t count = 0;
+    };
+
+    struct alignas(64) Shard {
+        std::vector<Cell> cells;       // power-of-two table, linear probing
+        std::vector<size_t> touched;   // occupied cells, for the flush
+        size_t read = 0;
+        size_t matched = 0;
+        size_t rejected = 0;
+        long long latest = 0;   // newest probe timestamp seen by this worker
+    };
+
+    Graph& graph;
+    const SpatialIndex& index;
+    ProbeIngestOptions options;
+    unsigned num_threads;
+
+    std::vector<Shard> shards;                           // one per worker
+    std::mutex totals_mutex;                             // taken by workers flushing a full shard
+    std::unordered_map<uint64_t, Accumulator> totals;    // merged history
+    std::vector<Accumulator> edge_totals;                // all slots combined, by edge id; sets the edges accepted
+    std::vector<double> base_multipliers;                // prior: snapshot at construction
+
+    ProbeIngestStats merged_stats;
+    long long last_publish_time = 0;
+
+    int slotOf(long long timestamp) const;
+    void ingest(const Probe& probe, Shard& shard);
+    void growToGraph();
+    bool record(size_t edge_id, long long timestamp, double speed_kmh, Shard& shard);
+    void flush(Shard& shard);
+    void parseCSVRange(const char* begin, const char* end, Shard& shard);
+    void maybePublish();
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "road_closures.h"
+#include "parallel.h"
+#include <algorithm>
+
+RoadClosures::RoadClosures(Graph& graph, const EdgeKeyIndex& index) : graph(graph), index(index) {}
+
+size_t RoadClosures::closeWay(long long way_id) {
+    size_t changed = 0;
+    for (size_t edge_id : index.edgesOfWay(way_id)) {
+        changed += graph.closeEdge(edge_id);
+    }
+    return changed;
+}
+
+size_t RoadClosures::reopenWay(long long way_id) {
+    size_t changed = 0;
+    for (size_t edge_id : index.edgesOfWay(way_id)) {
+        changed += graph.reopenEdge(edge_id);
+    }
+    return changed;
+}
+
+size_t RoadClosures::closeArea(const GeoPolygon& polygon) {
+    size_t changed = 0;
+    for (size_t edge_id : edgesInArea(polygon)) {
+        changed += graph.closeEdge(edge_id);
+    }
+    return changed;
+}
+
+size_t RoadClosures::reopenArea(const GeoPolygon& polygon) {
+    size_t changed = 0;
+    for (size_t edge_id : edgesInArea(polygon)) {
+        changed += graph.reopenEdge(edge_id);
+    }
+    return changed;
+}
+
+// Even-odd ray casting in the lat/lon plane; fine at city scale
+bool RoadClosures::contains(const GeoPolygon& polygon, double lat, double lon) {
+    bool inside = false;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        double lat_i = polygon[i].first, lon_i = polygon[i].second;
+        double lat_j = polygon[j].first, lon_j = polygon[j].second;
+        if ((lat_i > lat) != (lat_j > lat) &&
+            lon < (lon_j - lon_i) * (lat - lat_i) / (lat_j - lat_i) + lon_i) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+std::vector<size_t> RoadClosures::edgesInArea(const GeoPolygon& polygon) const {
+    std::vector<size_t> result;
+    if (polygon.size() < 3) {
+        return result;
+    }
+
+    // Bounding box first; most edges are rejected with four comparisons
+    double min_lat = polygon[0].first, max_lat = min_lat;
+    double min_lon = polygon[0].second, max_lon = min_lon;
+    for (const auto& vertex : polygon) {
+        min_lat = std::min(min_lat, vertex.first);
+        max_lat = std::max(max_lat, vertex.first);
+        min_lon = std::min(min_lon, vertex.second);
+        max_lon = std::max(max_lon, vertex.second);
+    }
+    auto inside = [&](double lat, double lon) {
+        return lat >= min_lat && lat <= max_lat && lon >= min_lon && lon <= max_lon &&
+               contains(polygon, lat, lon);
+    };
+
+    unsigned num_threads = hardwareThreads();
+    std::vector<std::vector<size_t>> found(num_threads);
+    parallelFor(graph.edgeCount(), [&](size_t begin, size_t end, unsigned worker) {
+        for (size_t id = begin; id < end; id++) {
+            const Node* a = graph.getNode(graph.getEdgeSource(id));
+            const Node* b = graph.getNode(graph.getEdge(id)->to);
+            if (!a || !b) {
+                continue;
+            }
+            if (inside(a->lat, a->lon) || inside(b->lat, b->lon) ||
+                inside((a->lat + b->lat) / 2.0, (a->lon + b->lon) / 2.0)) {
+                found[worker].push_back(id);
+            }
+        }
+    }, num_threads);
+
+    for (const auto& part : found) {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
@@ -0,0 +1,48 @@
+#ifndef ROAD_CLOSURES_H
+#define ROAD_CLOSURES_H
+
+#include "graph.h"
+#include "multiplier_import.h"
+#include <utility>
+#include <vector>
+
+// (lat, lon) vertices of a closed area, in order; the last vertex connects
+// back to the first
+using GeoPolygon = std::vector<std::pair<double, double>>;
+
+// Closes and reopens roads by OSM way or by area on top of the graph's
+// per-edge closure bits. Nothing is rebuilt: each edge toggles in constant
+// time and routing queries simply skip closed edges.
+//
+// The Graph search kernels (shortestPath, shortestPathTree, oneToMany) skip
+// closed edges whenever any are set, so everything built on them honors
+// closures: dijkstra, distance matrices, the stochastic router, vehicle
+// profiles, tours, the fleet simulator, traffic assignment and scenarios.
+// The pareto, turn-aware, POI and vulnerability searches run their own
+// loops and check isEdgeClosed themselves. The map matcher's
+// boundedDistances/boundedEdgePath ignore closures on purpose: a trace
+// records where the vehicle actually drove.
+class RoadClosures {
+public:
+    RoadClosures(Graph& graph, const EdgeKeyIndex& index);
+
+    // Both directions of every segment of the way; returns edges changed
+    size_t closeWay(long long way_id);
+    size_t reopenWay(long long way_id);
+
+    // Edges with either end or their midpoint inside the polygon
+    size_t closeArea(const GeoPolygon& polygon);
+    size_t reopenArea(const GeoPolygon& polygon);
+
+    void reopenAll() { graph.reopenAllEdges(); }
+
+    static bool contains(const GeoPolygon& polygon, double lat, double lon);
+
+private:
+    Graph& graph;
+    const EdgeKeyIndex& index;
+
+    std::vector<size_t> edgesInArea(const GeoPolygon& polygon) const;
+};
+
+#endif
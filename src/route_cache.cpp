@@ -0,0 +1,132 @@
+#include "route_cache.h"
+#include "counter_rng.h"
+#include <algorithm>
+
+RouteCache::RouteCache(const Graph& graph, RouteCacheOptions options) : graph(graph), options(options) {
+    size_t count = std::max<size_t>(1, options.shards);
+    shard_bytes = options.max_bytes / count;
+    for (size_t s = 0; s < count; s++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+size_t RouteCacheKeyHash::operator()(const RouteCacheKey& key) const {
+    uint64_t h = counterRandom((uint64_t)key.start, (uint64_t)key.end,
+                               ((uint64_t)key.mode << 8) | (uint64_t)(key.hour_of_day & 0xFF));
+    h ^= counterRandom(key.avoided_classes, key.metric_version, key.closure_version);
+    return (size_t)h;
+}
+
+RouteCacheKey RouteCache::key(long long start, long long end, RouteMode mode, int hour_of_day,
+                              uint64_t avoided_classes, uint64_t metric_version) const {
+    return {start, end, mode, hour_of_day, avoided_classes, metric_version, graph.closureVersion()};
+}
+
+RouteCache::Shard& RouteCache::shardFor(const RouteCacheKey& key) {
+    // High hash bits pick the shard; the map inside uses the low ones
+    return *shards[(RouteCacheKeyHash()(key) >> 48) % shards.size()];
+}
+
+size_t RouteCache::resultBytes(const RouteResult& result) {
+    return sizeof(Entry) + sizeof(RouteResult) + 4 * sizeof(void*) +   // list node, map node, control block
+           result.path.capacity() * sizeof(long long) + result.edge_path.capacity() * sizeof(size_t) +
+           result.mode_name.capacity();
+}
+
+// Versions only grow, so once a shard sees newer data nothing it holds can hit again
+void RouteCache::dropStale(Shard& shard, const RouteCacheKey& key) {
+    if (key.metric_version <= shard.metric_version && key.closure_version <= shard.closure_version) {
+        return;
+    }
+    invalidations.fetch_add(shard.lru.size(), std::memory_order_relaxed);
+    shard.lru.clear();
+    shard.map.clear();
+    shard.bytes = 0;
+    shard.metric_version = std::max(shard.metric_version, key.metric_version);
+    shard.closure_version = std::max(shard.closure_version, key.closure_version);
+}
+
+RouteCache::Result RouteCache::find(const RouteCacheKey& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    dropStale(shard, key);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->result;
+}
+
+void RouteCache::insert(const RouteCacheKey& key, Result result) {
+    size_t bytes = resultBytes(*result);
+    if (bytes > shard_bytes) {
+        return;   // would evict the whole shard for one route
+    }
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    dropStale(shard, key);
+    if (key.metric_version < shard.metric_version || key.closure_version < shard.closure_version) {
+        return;   // computed on data that has since been replaced
+    }
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;   // another thread got there first
+    }
+    shard.lru.push_front({key, std::move(result), bytes});
+    shard.map.emplace(key, shard.lru.begin());
+    shard.bytes += bytes;
+    while (shard.bytes > shard_bytes) {
+        const Entry& victim = shard.lru.back();
+        shard.bytes -= victim.bytes;
+        shard.map.erase(victim.key);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+RouteCache::Result RouteCache::route(long long start, long long end, RouteMode mode, int hour_of_day,
+                                     uint64_t avoided_classes) {
+    auto metric = graph.currentMetric();
+    return route(start, end, *metric, mode, hour_of_day, avoided_classes);
+}
+
+RouteCache::Result RouteCache::route(long long start, long long end, const MetricSnapshot& metric,
+                                     RouteMode mode, int hour_of_day, uint64_t avoided_classes) {
+    // Read the closure version before searching: a closure that lands during
+    // the search files the result under the old, never again requested, key
+    RouteCacheKey cache_key = key(start, end, mode, hour_of_day, avoided_classes, metric.version);
+    if (Result cached = find(cache_key)) {
+        return cached;
+    }
+    auto result = std::make_shared<RouteResult>(
+        graph.dijkstra(start, end, metric, mode, hour_of_day, avoided_classes));
+    insert(cache_key, result);
+    return result;
+}
+
+void RouteCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->lru.clear();
+        shard->map.clear();
+        shard->bytes = 0;
+    }
+}
+
+RouteCacheStats RouteCache::stats() const {
+    RouteCacheStats stats;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.evictions = evictions.load(std::memory_order_relaxed);
+    stats.invalidations = invalidations.load(std::memory_order_relaxed);
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.entries += shard->lru.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
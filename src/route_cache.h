@@ -0,0 +1,109 @@
+#ifndef ROUTE_CACHE_H
+#define ROUTE_CACHE_H
+
+#include "graph.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct RouteCacheOptions {
+    size_t max_bytes = 64 << 20;   // estimated heap use across all shards
+    size_t shards = 16;            // independent locks; a power of two spreads best
+};
+
+// Everything that determines a route, including the data it was computed on
+struct RouteCacheKey {
+    long long start;
+    long long end;
+    RouteMode mode;
+    int hour_of_day;
+    uint64_t avoided_classes;
+    uint64_t metric_version;
+    uint64_t closure_version;
+
+    bool operator==(const RouteCacheKey& other) const {
+        return start == other.start && end == other.end && mode == other.mode &&
+               hour_of_day == other.hour_of_day && avoided_classes == other.avoided_classes &&
+               metric_version == other.metric_version && closure_version == other.closure_version;
+    }
+};
+
+struct RouteCacheKeyHash {
+    size_t operator()(const RouteCacheKey& key) const;
+};
+
+struct RouteCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;        // dropped for the memory cap
+    uint64_t invalidations = 0;    // dropped because newer metric or closure data arrived
+    size_t entries = 0;
+    size_t bytes = 0;
+
+    double hitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0; }
+};
+
+// Sharded, concurrent LRU cache of routing results.
+//
+// Keys carry the metric snapshot version and the graph's closure version,
+// so a publish or closure change makes every older entry unreachable at
+// once; a shard drops its stale entries the first time it sees newer data.
+// Each shard has its own mutex, LRU list and share of the memory cap.
+// Results are shared immutable objects, so a hit copies a pointer, not a
+// path, and never holds the lock while the caller reads it.
+class RouteCache {
+public:
+    using Result = std::shared_ptr<const RouteResult>;
+
+    RouteCache(const Graph& graph, RouteCacheOptions options = {});
+
+    // Cached route, computing and storing it on a miss. The query pins one
+    // metric snapshot for the lookup and the search.
+    Result route(long long start, long long end, RouteMode mode, int hour_of_day,
+                 uint64_t avoided_classes = 0);
+
+    // Same against a snapshot the caller already pinned
+    Result route(long long start, long long end, const MetricSnapshot& metric, RouteMode mode,
+                 int hour_of_day, uint64_t avoided_classes = 0);
+
+    // Key for the graph's current data
+    RouteCacheKey key(long long start, long long end, RouteMode mode, int hour_of_day,
+                      uint64_t avoided_classes, uint64_t metric_version) const;
+
+    Result find(const RouteCacheKey& key);
+    void insert(const RouteCacheKey& key, Result result);
+    void clear();
+
+    RouteCacheStats stats() const;
+
+private:
+    struct Entry {
+        RouteCacheKey key;
+        Result result;
+        size_t bytes;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;      // most recent first
+        std::unordered_map<RouteCacheKey, std::list<Entry>::iterator, RouteCacheKeyHash> map;
+        size_t bytes = 0;
+        uint64_t metric_version = 0, closure_version = 0;   // newest data seen
+    };
+
+    const Graph& graph;
+    RouteCacheOptions options;
+    size_t shard_bytes;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> hits{0}, misses{0}, evictions{0}, invalidations{0};
+
+    Shard& shardFor(const RouteCacheKey& key);
+    void dropStale(Shard& shard, const RouteCacheKey& key);
+    static size_t resultBytes(const RouteResult& result);
+};
+
+#endif
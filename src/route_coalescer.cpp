@@ -0,0 +1,111 @@
+#include "route_coalescer.h"
+#include <algorithm>
+
+RouteCoalescer::RouteCoalescer(const Graph& graph, RouteCache* cache, size_t shards)
+    : graph(graph), cache(cache) {
+    for (size_t s = 0; s < std::max<size_t>(1, shards); s++) {
+        this->shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+RouteCoalescer::Result RouteCoalescer::route(long long start, long long end, const MetricSnapshot& metric,
+                                             RouteMode mode, int hour_of_day, uint64_t avoided_classes) {
+    requests.fetch_add(1, std::memory_order_relaxed);
+    RouteCacheKey key{start, end, mode, hour_of_day, avoided_classes, metric.version, graph.closureVersion()};
+    if (cache) {
+        if (Result cached = cache->find(key)) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return cached;
+        }
+    }
+
+    RouteCacheKey origin_key = key;
+    origin_key.end = 0;
+    Shard& shard = *shards[(RouteCacheKeyHash()(origin_key) >> 48) % shards.size()];
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    std::shared_ptr<Flight>& slot = shard.flights[key];
+    if (slot) {
+        shared.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        slot = std::make_shared<Flight>();
+        shard.origins[origin_key].waiting.emplace_back(key, slot);
+    }
+    std::shared_ptr<Flight> flight = slot;
+
+    // An unfinished flight is queued or in a running batch, so its origin
+    // entry exists; whoever finds the origin idle leads the next batch
+    while (!flight->done) {
+        Origin& origin = shard.origins.find(origin_key)->second;
+        if (origin.running) {
+            shard.done.wait(lock);
+        } else {
+            runBatch(shard, origin_key, origin, lock, metric);
+        }
+    }
+    if (flight->error) {
+        std::rethrow_exception(flight->error);
+    }
+    return flight->result;
+}
+
+// Route every queued destination of an origin with one search. Entered and
+// left with the shard locked; the search itself runs unlocked.
+void RouteCoalescer::runBatch(Shard& shard, const RouteCacheKey& origin_key, Origin& origin,
+                              std::unique_lock<std::mutex>& lock, const MetricSnapshot& metric) {
+    origin.running = true;
+    std::vector<std::pair<RouteCacheKey, std::shared_ptr<Flight>>> batch;
+    batch.swap(origin.waiting);
+    lock.unlock();
+
+    // Every queued key shares the origin key's versions, so the caller's
+    // snapshot is the data each of them asked for
+    std::vector<Result> results;
+    std::exception_ptr error;
+    try {
+        std::vector<long long> ends;
+        ends.reserve(batch.size());
+        for (const auto& entry : batch) {
+            ends.push_back(entry.first.end);
+        }
+        std::vector<RouteResult> routes = graph.dijkstraMany(origin_key.start, ends, metric, origin_key.mode,
+                                                             origin_key.hour_of_day, origin_key.avoided_classes);
+        for (size_t i = 0; i < batch.size(); i++) {
+            results.push_back(std::make_shared<RouteResult>(std::move(routes[i])));
+            if (cache) {
+                cache->insert(batch[i].first, results.back());
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    searches.fetch_add(1, std::memory_order_relaxed);
+    merged.fetch_add(batch.size() - 1, std::memory_order_relaxed);
+
+    lock.lock();
+    for (size_t i = 0; i < batch.size(); i++) {
+        Flight& flight = *batch[i].second;
+        if (error) {
+            flight.error = error;
+        } else {
+            flight.result = results[i];
+        }
+        flight.done = true;
+        shard.flights.erase(batch[i].first);
+    }
+    origin.running = false;
+    if (origin.waiting.empty()) {
+        shard.origins.erase(origin_key);
+    }
+    shard.done.notify_all();
+}
+
+RouteCoalescerStats RouteCoalescer::stats() const {
+    RouteCoalescerStats stats;
+    stats.requests = requests.load(std::memory_order_relaxed);
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.shared = shared.load(std::memory_order_relaxed);
+    stats.merged = merged.load(std::memory_order_relaxed);
+    stats.searches = searches.load(std::memory_order_relaxed);
+    return stats;
+}
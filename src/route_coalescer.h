@@ -0,0 +1,75 @@
+#ifndef ROUTE_COALESCER_H
+#define ROUTE_COALESCER_H
+
+#include "graph.h"
+#include "route_cache.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct RouteCoalescerStats {
+    uint64_t requests = 0;
+    uint64_t hits = 0;       // answered by the cache without waiting
+    uint64_t shared = 0;     // waited on an identical query already in flight
+    uint64_t merged = 0;     // answered by a search another destination started
+    uint64_t searches = 0;   // one-to-many searches actually run
+
+    // Cache misses answered per search run
+    double fanIn() const { return searches > 0 ? (double)(requests - hits) / searches : 0.0; }
+};
+
+// Single-flight layer in front of the routing engine.
+//
+// Identical concurrent queries (same RouteCacheKey, so same snapshot and
+// closure version) wait on one computation and share its RouteResult.
+// Queries from the same origin under the same data are queued per origin:
+// while one thread searches, later destinations pile up, and the next
+// thread to lead routes the whole queue with one dijkstraMany search. No
+// batching delay is added; batches form only when searches overlap. An
+// optional RouteCache is checked first and filled with every result.
+class RouteCoalescer {
+public:
+    using Result = RouteCache::Result;
+
+    RouteCoalescer(const Graph& graph, RouteCache* cache = nullptr, size_t shards = 16);
+
+    Result route(long long start, long long end, const MetricSnapshot& metric, RouteMode mode,
+                 int hour_of_day, uint64_t avoided_classes = 0);
+
+    RouteCoalescerStats stats() const;
+
+private:
+    struct Flight {
+        Result result;
+        std::exception_ptr error;
+        bool done = false;
+    };
+
+    struct Origin {
+        bool running = false;   // a thread is searching for an earlier batch
+        std::vector<std::pair<RouteCacheKey, std::shared_ptr<Flight>>> waiting;
+    };
+
+    // Flights and origin queues of one origin share a shard, so one lock covers both
+    struct Shard {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::unordered_map<RouteCacheKey, std::shared_ptr<Flight>, RouteCacheKeyHash> flights;
+        std::unordered_map<RouteCacheKey, Origin, RouteCacheKeyHash> origins;   // key with end = 0
+    };
+
+    const Graph& graph;
+    RouteCache* cache;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> requests{0}, hits{0}, shared{0}, merged{0}, searches{0};
+
+    void runBatch(Shard& shard, const RouteCacheKey& origin_key, Origin& origin,
+                  std::unique_lock<std::mutex>& lock, const MetricSnapshot& metric);
+};
+
+#endif
@@ -0,0 +1,999 @@
+#include "route_server.h"
+#include "parallel.h"
+#include "route_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+// ---- JSON helpers: append straight into the response body ----
+
+void appendNumber(std::string& out, double value, int precision) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.*f", precision, value);
+    out.append(buffer, length);
+}
+
+void appendInteger(std::string& out, long long value) {
+    char buffer[24];
+    int length = std::snprintf(buffer, sizeof(buffer), "%lld", value);
+    out.append(buffer, length);
+}
+
+std::string errorBody(const std::string& message) {
+    return "{\"error\":\"" + message + "\"}";
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string percentDecode(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+            out += (char)(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+            i += 2;
+        } else {
+            out += text[i] == '+' ? ' ' : text[i];
+        }
+    }
+    return out;
+}
+
+bool parseInteger(const std::string* text, long long& value) {
+    if (!text || text->empty()) {
+        return false;
+    }
+    char* end;
+    value = std::strtoll(text->c_str(), &end, 10);
+    return *end == '\0';
+}
+
+bool parseDouble(const std::string* text, double& value) {
+    if (!text || text->empty()) {
+        return false;
+    }
+    char* end;
+    value = std::strtod(text->c_str(), &end);
+    return *end == '\0' && std::isfinite(value);
+}
+
+// Optional hour of day; absent keeps the default, anything outside 0-23 is an error
+bool parseHour(const std::string* text, int& hour) {
+    long long value;
+    if (!text) {
+        return true;
+    }
+    if (!parseInteger(text, value) || value < 0 || value > 23) {
+        return false;
+    }
+    hour = (int)value;
+    return true;
+}
+
+bool parseIdList(const std::string* text, std::vector<long long>& ids) {
+    if (!text || text->empty()) {
+        return false;
+    }
+    const char* p = text->c_str();
+    while (*p) {
+        char* end;
+        long long id = std::strtoll(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        ids.push_back(id);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+bool parseMode(const std::string* text, RouteMode& mode) {
+    if (!text || *text == "learned") {
+        mode = RouteMode::LEARNED;
+    } else if (*text == "speed") {
+        mode = RouteMode::SPEED_LIMIT;
+    } else if (*text == "distance") {
+        mode = RouteMode::DISTANCE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* modeKey(RouteMode mode) {
+    switch (mode) {
+        case RouteMode::DISTANCE: return "distance";
+        case RouteMode::SPEED_LIMIT: return "speed";
+        default: return "learned";
+    }
+}
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        default: return "Internal Server Error";
+    }
+}
+
+void appendResponse(std::string& out, int status, const std::string& body, bool keep_alive,
+                    const char* content_type = "application/json") {
+    char header[256];
+    int length = std::snprintf(header, sizeof(header),
+                               "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n"
+                               "Access-Control-Allow-Origin: *\r\nContent-Length: %zu\r\n"
+                               "Connection: %s\r\n\r\n",
+                               status, statusText(status), content_type, body.size(),
+                               keep_alive ? "keep-alive" : "close");
+    out.append(header, length);
+    out += body;
+}
+
+// Parse the head of an HTTP request (up to the blank line). Returns false
+// if it is malformed.
+bool parseRequestHead(const char* data, size_t length, HttpRequest& request, size_t& content_length) {
+    const char* end = data + length;
+    const char* line_end = std::find(data, end, '\r');
+    const char* space1 = std::find(data, line_end, ' ');
+    const char* space2 = std::find(space1 + (space1 < line_end), line_end, ' ');
+    if (space1 == line_end || space2 == line_end) {
+        return false;
+    }
+    request.method.assign(data, space1);
+    std::string target(space1 + 1, space2);
+    std::string version(space2 + 1, line_end);
+    request.keep_alive = version == "HTTP/1.1";
+    content_length = 0;
+
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    request.query.clear();
+    if (question != std::string::npos) {
+        size_t pos = question + 1;
+        while (pos <= target.size()) {
+            size_t amp = target.find('&', pos);
+            if (amp == std::string::npos) {
+                amp = target.size();
+            }
+            std::string pair = target.substr(pos, amp - pos);
+            size_t eq = pair.find('=');
+            if (!pair.empty()) {
+                request.query.push_back({percentDecode(pair.substr(0, eq)),
+                                         eq == std::string::npos ? "" : percentDecode(pair.substr(eq + 1))});
+            }
+            pos = amp + 1;
+        }
+    }
+
+    // Headers: only Connection and Content-Length matter here
+    const char* p = line_end + 2;
+    while (p < end) {
+        const char* header_end = std::find(p, end, '\r');
+        const char* colon = std::find(p, header_end, ':');
+        if (colon != header_end) {
+            std::string name(p, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            const char* value = colon + 1;
+            while (value < header_end && *value == ' ') {
+                value++;
+            }
+            std::string text(value, header_end);
+            std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+            if (name == "connection") {
+                if (text == "close") {
+                    request.keep_alive = false;
+                } else if (text == "keep-alive") {
+                    request.keep_alive = true;
+                }
+            } else if (name == "content-length") {
+                content_length = std::strtoull(text.c_str(), nullptr, 10);
+            }
+        }
+        p = header_end + 2;
+    }
+    return true;
+}
+
+}  // namespace
+
+const std::string* HttpRequest::param(const std::string& name) const {
+    for (const auto& entry : query) {
+        if (entry.first == name) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+RouteServer::RouteServer(const Graph& graph, const SpatialIndex& index, RouteServerOptions options)
+    : graph(graph), index(index), options(options) {
+    if (options.cache_bytes > 0) {
+        RouteCacheOptions cache_options;
+        cache_options.max_bytes = options.cache_bytes;
+        cache = std::make_unique<RouteCache>(graph, cache_options);
+    }
+    if (options.coalesce) {
+        coalescer = std::make_unique<RouteCoalescer>(graph, cache.get());
+    }
+    if (!options.web_root.empty()) {
+        std::ifstream page(options.web_root + "/index.html", std::ios::binary);
+        if (page) {
+            std::ostringstream contents;
+            contents << page.rdbuf();
+            viewer_page = contents.str();
+        }
+    }
+}
+
+RouteCache::Result RouteServer::route(long long from, long long to, const MetricSnapshot& metric,
+                                      RouteMode mode, int hour, uint64_t avoided_classes) const {
+    if (coalescer) {
+        return coalescer->route(from, to, metric, mode, hour, avoided_classes);
+    }
+    if (cache) {
+        return cache->route(from, to, metric, mode, hour, avoided_classes);
+    }
+    return std::make_shared<RouteResult>(graph.dijkstra(from, to, metric, mode, hour, avoided_classes));
+}
+
+// Optional avoid=motorways,tolls,residential; the server-wide classes always apply
+bool RouteServer::parseAvoid(const std::string* text, uint64_t& avoided_classes) const {
+    avoided_classes = options.avoided_classes;
+    if (!text || text->empty()) {
+        return true;
+    }
+    unsigned flags = AVOID_NONE;
+    std::istringstream names(*text);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        if (name == "motorways") {
+            flags |= AVOID_MOTORWAYS;
+        } else if (name == "tolls") {
+            flags |= AVOID_TOLLS;
+        } else if (name == "residential") {
+            flags |= AVOID_RESIDENTIAL;
+        } else {
+            return false;
+        }
+    }
+    avoided_classes |= graph.avoidMask(flags);
+    return true;
+}
+
+RouteServer::~RouteServer() {
+    stop();
+}
+
+void RouteServer::pushRoute(uint64_t query, size_t index, size_t count, const RouteResult& route) {
+    std::string data = "{\"query\":";
+    appendInteger(data, (long long)query);
+    data += ",\"index\":";
+    appendInteger(data, (long long)index);
+    data += ",\"count\":";
+    appendInteger(data, (long long)count);
+    data += ",\"mode\":\"" + route.mode_name + "\",\"color\":\"" + routeColor(route.mode) + "\"";
+    data += ",\"total_distance_km\":";
+    appendNumber(data, route.total_distance / 1000.0, 3);
+    data += ",\"estimated_time_min\":";
+    appendNumber(data, route.estimated_time / 60.0, 1);
+    data += ",\"points\":";
+    appendInteger(data, (long long)route.path.size());
+    data += ",\"polyline\":\"";
+    std::string polyline;
+    appendRoutePolyline(graph, route, polyline);
+    for (char c : polyline) {
+        if (c == '\\') {
+            data += '\\';
+        }
+        data += c;
+    }
+    data += "\"}";
+
+    {
+        std::lock_guard<std::mutex> lock(feed_mutex);
+        if (query != feed_query) {
+            feed.clear();
+            feed_query = query;
+        }
+        feed_seq++;
+        std::string event = "id: " + std::to_string(feed_seq) + "\nevent: route\ndata: " + data + "\n\n";
+        feed.emplace_back(feed_seq, std::move(event));
+    }
+    wakeWorkers();
+}
+
+// ---- Endpoints ----
+
+std::string RouteServer::handle(const HttpRequest& request, int& status) const {
+    status = 200;
+    if (request.method != "GET") {
+        status = 405;
+        return errorBody("only GET is supported");
+    }
+    if (request.path == "/route") {
+        return routeEndpoint(request, status);
+    }
+    if (request.path == "/compare") {
+        return compareEndpoint(request, status);
+    }
+    if (request.path == "/matrix") {
+        return matrixEndpoint(request, status);
+    }
+    if (request.path == "/snap") {
+        return snapEndpoint(request, status);
+    }
+    if (request.path == "/stats") {
+        std::string body = "{\"requests\":";
+        appendInteger(body, (long long)requestsServed());
+        body += ",\"nodes\":";
+        appendInteger(body, (long long)graph.nodeCount());
+        body += ",\"edges\":";
+        appendInteger(body, (long long)graph.edgeCount());
+        body += ",\"metric_version\":";
+        appendInteger(body, (long long)graph.currentMetric()->version);
+        if (cache) {
+            RouteCacheStats stats = cache->stats();
+            body += ",\"cache\":{\"hits\":";
+            appendInteger(body, (long long)stats.hits);
+            body += ",\"misses\":";
+            appendInteger(body, (long long)stats.misses);
+            body += ",\"hit_rate\":";
+            appendNumber(body, stats.hitRate(), 3);
+            body += ",\"entries\":";
+            appendInteger(body, (long long)stats.entries);
+            body += ",\"bytes\":";
+            appendInteger(body, (long long)stats.bytes);
+            body += ",\"evictions\":";
+            appendInteger(body, (long long)stats.evictions);
+            body += ",\"invalidations\":";
+            appendInteger(body, (long long)stats.invalidations);
+            body += "}";
+        }
+        if (coalescer) {
+            RouteCoalescerStats stats = coalescer->stats();
+            body += ",\"coalescer\":{\"requests\":";
+            appendInteger(body, (long long)stats.requests);
+            body += ",\"shared\":";
+            appendInteger(body, (long long)stats.shared);
+            body += ",\"merged\":";
+            appendInteger(body, (long long)stats.merged);
+            body += ",\"searches\":";
+            appendInteger(body, (long long)stats.searches);
+            body += "}";
+        }
+        body += "}";
+        return body;
+    }
+    status = 404;
+    return errorBody("unknown endpoint");
+}
+
+std::string RouteServer::routeEndpoint(const HttpRequest& request, int& status) const {
+    long long from, to;
+    int hour = 17;
+    RouteMode mode;
+    uint64_t avoided_classes;
+    if (!parseInteger(request.param("from"), from) || !parseInteger(request.param("to"), to) ||
+        !parseHour(request.param("hour"), hour) ||
+        !parseMode(request.param("mode"), mode) ||
+        !parseAvoid(request.param("avoid"), avoided_classes)) {
+        status = 400;
+        return errorBody("expected from, to, optional mode=learned|speed|distance, hour=0-23 and "
+                         "avoid=motorways,tolls,residential");
+    }
+
+    auto metric = graph.currentMetric();
+    RouteCache::Result result = route(from, to, *metric, mode, hour, avoided_classes);
+    const RouteResult& route = *result;
+    if (route.path.empty()) {
+        status = 404;
+        return errorBody("no route");
+    }
+
+    std::string body;
+    body.reserve(64 + route.path.size() * 48);
+    body += "{\"mode\":\"";
+    body += modeKey(mode);
+    body += "\",\"distance_m\":";
+    appendNumber(body, route.total_distance, 1);
+    body += ",\"time_s\":";
+    appendNumber(body, route.estimated_time, 1);
+    body += ",\"nodes\":[";
+    for (size_t i = 0; i < route.path.size(); i++) {
+        if (i > 0) body += ',';
+        appendInteger(body, route.path[i]);
+    }
+    body += "],\"coords\":[";
+    for (size_t i = 0; i < route.path.size(); i++) {
+        const Node* node = graph.getNode(route.path[i]);
+        body += i > 0 ? ",[" : "[";
+        appendNumber(body, node->lat, 6);
+        body += ',';
+        appendNumber(body, node->lon, 6);
+        body += ']';
+    }
+    body += "]}";
+    return body;
+}
+
+std::string RouteServer::compareEndpoint(const HttpRequest& request, int& status) const {
+    long long from, to;
+    int hour = 17;
+    uint64_t avoided_classes;
+    if (!parseInteger(request.param("from"), from) || !parseInteger(request.param("to"), to) ||
+        !parseHour(request.param("hour"), hour) ||
+        !parseAvoid(request.param("avoid"), avoided_classes)) {
+        status = 400;
+        return errorBody("expected from, to, optional hour=0-23 and avoid=motorways,tolls,residential");
+    }
+
+    // One pinned snapshot for all three, so they are comparable
+    auto metric = graph.currentMetric();
+    std::string body = "{";
+    bool first = true;
+    for (RouteMode mode : {RouteMode::DISTANCE, RouteMode::SPEED_LIMIT, RouteMode::LEARNED}) {
+        RouteCache::Result result = route(from, to, *metric, mode, hour, avoided_classes);
+        const RouteResult& route = *result;
+        if (!first) body += ',';
+        first = false;
+        body += '"';
+        body += modeKey(mode);
+        body += "\":";
+        if (route.path.empty()) {
+            body += "null";
+            continue;
+        }
+        body += "{\"distance_m\":";
+        appendNumber(body, route.total_distance, 1);
+        body += ",\"time_s\":";
+        appendNumber(body, route.estimated_time, 1);
+        body += ",\"nodes\":";
+        appendInteger(body, (long long)route.path.size());
+        body += '}';
+    }
+    body += '}';
+    return body;
+}
+
+std::string RouteServer::matrixEndpoint(const HttpRequest& request, int& status) const {
+    std::vector<long long> sources, targets;
+    int hour = 17;
+    RouteMode mode;
+    uint64_t avoided_classes;
+    if (!parseIdList(request.param("sources"), sources) || !parseIdList(request.param("targets"), targets) ||
+        !parseHour(request.param("hour"), hour) ||
+        !parseMode(request.param("mode"), mode) ||
+        !parseAvoid(request.param("avoid"), avoided_classes)) {
+        status = 400;
+        return errorBody("expected sources=a,b,... targets=c,d,... optional mode, hour=0-23 and avoid");
+    }
+    if (sources.size() * targets.size() > options.max_matrix_cells) {
+        status = 413;
+        return errorBody("matrix too large");
+    }
+
+    // One search per source row; the workspace is reused across requests
+    static thread_local SearchWorkspace workspace;
+    auto metric = graph.currentMetric();
+    RoadClassFilter filter{avoided_classes};
+    std::vector<double> costs;
+    std::string body = "{\"mode\":\"";
+    body += modeKey(mode);
+    body += "\",\"costs\":[";
+    for (size_t s = 0; s < sources.size(); s++) {
+        graph.oneToMany(sources[s], targets, workspace,
+                        [&](const Edge& edge) { return graph.edgeWeight(edge, mode, hour, *metric); },
+                        costs, filter);
+        body += s > 0 ? ",[" : "[";
+        for (size_t t = 0; t < targets.size(); t++) {
+            if (t > 0) body += ',';
+            appendNumber(body, costs[t], 1);
+        }
+        body += ']';
+    }
+    body += "]}";
+    return body;
+}
+
+std::string RouteServer::snapEndpoint(const HttpRequest& request, int& status) const {
+    double lat, lon, radius = options.snap_radius_m;
+    if (!parseDouble(request.param("lat"), lat) || !parseDouble(request.param("lon"), lon) ||
+        (request.param("radius") && !parseDouble(request.param("radius"), radius))) {
+        status = 400;
+        return errorBody("expected lat, lon and optional radius");
+    }
+
+    std::vector<EdgeCandidate> candidates = index.nearestEdges(lat, lon, radius, 1);
+    if (candidates.empty()) {
+        status = 404;
+        return errorBody("no road within radius");
+    }
+    const EdgeCandidate& best = candidates[0];
+    long long from = graph.getEdgeSource(best.edge_id);
+    long long to = graph.getEdge(best.edge_id)->to;
+
+    std::string body = "{\"edge\":";
+    appendInteger(body, (long long)best.edge_id);
+    body += ",\"from\":";
+    appendInteger(body, from);
+    body += ",\"to\":";
+    appendInteger(body, to);
+    body += ",\"node\":";
+    appendInteger(body, best.fraction < 0.5 ? from : to);
+    body += ",\"distance_m\":";
+    appendNumber(body, best.distance, 1);
+    body += ",\"fraction\":";
+    appendNumber(body, best.fraction, 3);
+    body += '}';
+    return body;
+}
+
+#ifdef __linux__
+
+struct RouteServer::Worker {
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;    // eventfd: new feed events for this worker's subscribers
+};
+
+namespace {
+
+struct Connection {
+    std::string in;
+    std::string out;
+    size_t out_offset = 0;
+    bool close_after_write = false;
+    bool streaming = false;      // an /events subscriber; input is ignored from then on
+    uint64_t event_seq = 0;      // last feed event queued for it
+};
+
+// A viewer further behind than this is dropped; EventSource reconnects and
+// picks up the latest query's routes
+const size_t kMaxStreamBacklog = 8 << 20;
+const int kStreamPingSeconds = 15;
+
+int openListener(const std::string& address, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1 ||
+        bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+bool RouteServer::start() {
+    if (running.load()) {
+        return true;
+    }
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    bound_port = options.port;
+
+    for (unsigned w = 0; w < num_threads; w++) {
+        Worker* worker = new Worker();
+        workers.push_back(worker);
+        worker->listen_fd = openListener(options.bind_address, bound_port);
+        if (worker->listen_fd < 0) {
+            std::cerr << "Error: Could not listen on " << options.bind_address << ":" << bound_port
+                      << " (" << std::strerror(errno) << ")" << std::endl;
+            stop();
+            return false;
+        }
+        if (bound_port == 0) {
+            // The rest of the workers join the port the kernel picked
+            sockaddr_in addr{};
+            socklen_t length = sizeof(addr);
+            getsockname(worker->listen_fd, (sockaddr*)&addr, &length);
+            bound_port = ntohs(addr.sin_port);
+        }
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        for (int fd : {worker->listen_fd, worker->wake_fd}) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    running = true;
+    for (Worker* worker : workers) {
+        threads.emplace_back([this, worker]() { workerLoop(*worker); });
+    }
+    return true;
+}
+
+void RouteServer::stop() {
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    for (Worker* worker : workers) {
+        if (worker->listen_fd >= 0) {
+            close(worker->listen_fd);
+        }
+        if (worker->epoll_fd >= 0) {
+            close(worker->epoll_fd);
+        }
+        if (worker->wake_fd >= 0) {
+            close(worker->wake_fd);
+        }
+        delete worker;
+    }
+    workers.clear();
+}
+
+void RouteServer::wakeWorkers() {
+    for (Worker* worker : workers) {
+        uint64_t one = 1;
+        ssize_t written = write(worker->wake_fd, &one, sizeof(one));
+        (void)written;   // fails only when a wakeup is already pending
+    }
+}
+
+void RouteServer::workerLoop(Worker& worker) {
+    std::unordered_map<int, Connection> connections;
+    std::vector<epoll_event> events(256);
+    char buffer[16384];
+
+    auto closeConnection = [&](int fd) {
+        epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        auto it = connections.find(fd);
+        if (it != connections.end() && it->second.streaming) {
+            viewers.fetch_sub(1, std::memory_order_relaxed);
+        }
+        connections.erase(it);
+    };
+
+    // Queue the feed events a subscriber hasn't seen yet
+    auto appendEvents = [&](Connection& conn) {
+        std::lock_guard<std::mutex> lock(feed_mutex);
+        for (const auto& event : feed) {
+            if (event.first > conn.event_seq) {
+                conn.out += event.second;
+            }
+        }
+        conn.event_seq = feed_seq;
+    };
+
+    // Write what the socket takes; wait for EPOLLOUT only while output is pending
+    auto flush = [&](int fd, Connection& conn) {
+        while (conn.out_offset < conn.out.size()) {
+            ssize_t n = send(fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    epoll_event event{};
+                    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+                    event.data.fd = fd;
+                    epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, fd, &event);
+                    return true;
+                }
+                return false;
+            }
+            conn.out_offset += (size_t)n;
+        }
+        conn.out.clear();
+        conn.out_offset = 0;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, fd, &event);
+        return !conn.close_after_write;
+    };
+
+    // Answer every complete request in the input buffer, in order
+    auto process = [&](Connection& conn) {
+        size_t consumed = 0;
+        HttpRequest request;
+        while (!conn.close_after_write && !conn.streaming) {
+            size_t head_end = conn.in.find("\r\n\r\n", consumed);
+            if (head_end == std::string::npos) {
+                if (conn.in.size() - consumed > options.max_request_bytes) {
+                    appendResponse(conn.out, 413, errorBody("request too large"), false);
+                    conn.close_after_write = true;
+                }
+                break;
+            }
+            size_t content_length;
+            if (!parseRequestHead(conn.in.data() + consumed, head_end - consumed + 2, request, content_length)) {
+                appendResponse(conn.out, 400, errorBody("malformed request"), false);
+                conn.close_after_write = true;
+                break;
+            }
+            if (content_length > options.max_request_bytes) {
+                appendResponse(conn.out, 413, errorBody("request too large"), false);
+                conn.close_after_write = true;
+                break;
+            }
+            size_t request_end = head_end + 4 + content_length;
+            if (conn.in.size() < request_end) {
+                break;   // body still arriving
+            }
+            requests_served.fetch_add(1, std::memory_order_relaxed);
+            if (request.method == "GET" && request.path == "/events") {
+                // The connection becomes a one-way stream, starting with the latest query
+                conn.out += "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                            "Access-Control-Allow-Origin: *\r\nConnection: keep-alive\r\n\r\n";
+                conn.streaming = true;
+                viewers.fetch_add(1, std::memory_order_relaxed);
+                appendEvents(conn);
+                consumed = conn.in.size();
+                break;
+            }
+            if (request.method == "GET" && (request.path == "/" || request.path == "/index.html") &&
+                !viewer_page.empty()) {
+                appendResponse(conn.out, 200, viewer_page, request.keep_alive, "text/html; charset=utf-8");
+            } else {
+                int status;
+                std::string body = handle(request, status);
+                appendResponse(conn.out, status, body, request.keep_alive);
+            }
+            conn.close_after_write = !request.keep_alive;
+            consumed = request_end;
+        }
+        conn.in.erase(0, consumed);
+    };
+
+    // Push queued events (or a keep-alive comment) to every subscriber
+    auto feedSubscribers = [&](bool ping) {
+        std::vector<int> dropped;
+        for (auto& entry : connections) {
+            Connection& conn = entry.second;
+            if (!conn.streaming) {
+                continue;
+            }
+            if (ping) {
+                conn.out += ": ping\n\n";
+            } else {
+                appendEvents(conn);
+            }
+            if (conn.out.size() - conn.out_offset > kMaxStreamBacklog || !flush(entry.first, conn)) {
+                dropped.push_back(entry.first);
+            }
+        }
+        for (int fd : dropped) {
+            closeConnection(fd);
+        }
+    };
+
+    auto last_ping = std::chrono::steady_clock::now();
+    while (running.load(std::memory_order_relaxed)) {
+        int ready = epoll_wait(worker.epoll_fd, events.data(), (int)events.size(), 100);
+        if (std::chrono::steady_clock::now() - last_ping > std::chrono::seconds(kStreamPingSeconds)) {
+            last_ping = std::chrono::steady_clock::now();
+            feedSubscribers(true);
+        }
+        for (int e = 0; e < ready; e++) {
+            int fd = events[e].data.fd;
+            if (fd == worker.wake_fd) {
+                uint64_t count;
+                ssize_t drained = read(worker.wake_fd, &count, sizeof(count));
+                (void)drained;
+                feedSubscribers(false);
+                continue;
+            }
+            if (fd == worker.listen_fd) {
+                while (true) {
+                    int client = accept4(worker.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (client < 0) {
+                        break;
+                    }
+                    int one = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    epoll_event event{};
+                    event.events = EPOLLIN | EPOLLRDHUP;
+                    event.data.fd = client;
+                    epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, client, &event);
+                    connections[client];
+                }
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;
+            }
+            Connection& conn = it->second;
+            if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(fd);
+                continue;
+            }
+            if (events[e].events & EPOLLOUT) {
+                if (!flush(fd, conn)) {
+                    closeConnection(fd);
+                    continue;
+                }
+                // Pipelined requests that arrived while the socket was full
+                if (conn.out.empty() && !conn.in.empty()) {
+                    process(conn);
+                    if (!flush(fd, conn)) {
+                        closeConnection(fd);
+                        continue;
+                    }
+                }
+            }
+            if (events[e].events & (EPOLLIN | EPOLLRDHUP)) {
+                bool peer_closed = false;
+                while (true) {
+                    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                    if (n > 0) {
+                        conn.in.append(buffer, (size_t)n);
+                    } else if (n == 0) {
+                        peer_closed = true;
+                        break;
+                    } else {
+                        peer_closed = errno != EAGAIN && errno != EWOULDBLOCK;
+                        break;
+                    }
+                }
+                // Don't start new work while earlier responses are still queued
+                if (conn.streaming) {
+                    conn.in.clear();
+                } else if (conn.out.empty()) {
+                    process(conn);
+                }
+                if (!flush(fd, conn) || (peer_closed && conn.out.empty())) {
+                    closeConnection(fd);
+                }
+            }
+        }
+    }
+
+    for (auto& entry : connections) {
+        if (entry.second.streaming) {
+            viewers.fetch_sub(1, std::memory_order_relaxed);
+        }
+        close(entry.first);
+    }
+}
+
+LoadTestResult RouteServer::loadTest(int port, const std::vector<std::string>& paths,
+                                     unsigned connections, size_t requests) {
+    LoadTestResult result;
+    if (paths.empty() || connections == 0) {
+        return result;
+    }
+    std::atomic<size_t> issued{0};
+    std::vector<std::vector<double>> latencies(connections);
+    std::vector<size_t> errors(connections, 0);
+
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < connections; c++) {
+        clients.emplace_back([&, c]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((uint16_t)port);
+            inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+            if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+                errors[c]++;
+                if (fd >= 0) close(fd);
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            std::string response;
+            char buffer[16384];
+            for (size_t k = issued.fetch_add(1); k < requests; k = issued.fetch_add(1)) {
+                std::string request = "GET " + paths[k % paths.size()] + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+                auto sent = std::chrono::steady_clock::now();
+                if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+                    errors[c]++;
+                    break;
+                }
+                // Read exactly one response: head, then Content-Length bytes
+                response.clear();
+                size_t head_end = std::string::npos, total = 0;
+                bool failed = false;
+                while (head_end == std::string::npos || response.size() < total) {
+                    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                    if (n <= 0) {
+                        failed = true;
+                        break;
+                    }
+                    response.append(buffer, (size_t)n);
+                    if (head_end == std::string::npos && (head_end = response.find("\r\n\r\n")) != std::string::npos) {
+                        size_t pos = response.find("Content-Length: ");
+                        total = head_end + 4 + (pos < head_end ? std::strtoull(response.c_str() + pos + 16, nullptr, 10) : 0);
+                    }
+                }
+                if (failed) {
+                    errors[c]++;
+                    break;
+                }
+                latencies[c].push_back(std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - sent).count());
+                if (response.compare(9, 3, "200") != 0) {
+                    errors[c]++;
+                }
+            }
+            close(fd);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::vector<double> all;
+    for (unsigned c = 0; c < connections; c++) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        result.errors += errors[c];
+    }
+    result.requests = all.size();
+    result.requests_per_second = result.seconds > 0.0 ? all.size() / result.seconds : 0.0;
+    if (!all.empty()) {
+        std::sort(all.begin(), all.end());
+        result.p50_ms = all[all.size() / 2];
+        result.p99_ms = all[(size_t)(0.99 * (all.size() - 1))];
+    }
+    return result;
+}
+
+#else
+
+struct RouteServer::Worker {};
+
+bool RouteServer::start() {
+    std::cerr << "Error: The HTTP server needs Linux (epoll)" << std::endl;
+    return false;
+}
+
+void RouteServer::stop() {}
+
+void RouteServer::wakeWorkers() {}
+
+void RouteServer::workerLoop(Worker&) {}
+
+LoadTestResult RouteServer::loadTest(int, const std::vector<std::string>&, unsigned, size_t) {
+    return {};
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef ROUTE_SERVER_H
+#define ROUTE_SERVER_H
+
+#include "graph.h"
+#include "route_cache.h"
+#include "route_coalescer.h"
+#include "spatial_index.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct RouteServerOptions {
+    int port = 8080;                      // 0 = any free port (see RouteServer::port)
+    std::string bind_address = "127.0.0.1";
+    unsigned threads = 0;                 // 0 = all hardware threads
+    size_t max_request_bytes = 64 * 1024; // header plus body
+    size_t max_matrix_cells = 10000;
+    double snap_radius_m = 200.0;
+    uint64_t avoided_classes = 0;         // applied to every query, on top of its avoid=
+    size_t cache_bytes = 64 << 20;        // route cache cap; 0 disables the cache
+    bool coalesce = true;                 // share in-flight searches between identical and same-origin queries
+    std::string web_root = "web";         // viewer page served at /; empty disables it
+};
+
+// A parsed HTTP request; only what the endpoints need
+struct HttpRequest {
+    std::string method;
+    std::string path;                                    // without the query string
+    std::vector<std::pair<std::string, std::string>> query;
+    bool keep_alive = true;
+
+    const std::string* param(const std::string& name) const;
+};
+
+struct LoadTestResult {
+    size_t requests = 0;
+    size_t errors = 0;                    // non-200 responses and failed connections
+    double seconds = 0.0;
+    double requests_per_second = 0.0;
+    double p50_ms = 0.0, p99_ms = 0.0;
+};
+
+// Embedded HTTP/1.1 routing server (Linux, epoll).
+//
+// Each worker thread owns a listening socket bound with SO_REUSEPORT, its
+// own epoll instance and its connections, so the kernel spreads accepts
+// across workers and no lock is taken on the request path. Connections are
+// non-blocking and keep-alive, and pipelined requests are answered in order.
+// All workers share the one Graph read-only; each query pins the current
+// metric snapshot, so publishes never block or tear a response. /route and
+// /compare answers go through a shared RouteCache keyed by snapshot version,
+// and misses through a RouteCoalescer, so a burst of identical or
+// same-origin queries runs one search instead of one per request.
+//
+// Endpoints (GET, compact JSON):
+//   /route?from=&to=[&mode=learned|speed|distance][&hour=][&avoid=]
+//   /compare?from=&to=[&hour=][&avoid=]   all three modes
+//   /matrix?sources=a,b&targets=c,d[&mode=][&hour=][&avoid=]
+// avoid= is a comma list of motorways, tolls and residential (as --avoid).
+//   /snap?lat=&lon=[&radius=]
+//   /stats
+//   /                                     the map viewer (web_root/index.html)
+//   /events                               server-sent events feed of pushed routes
+//
+// pushRoute sends a route to every /events subscriber as soon as it is
+// computed, geometry as an encoded polyline. Only the latest query's routes
+// are kept, and a new subscriber gets those first, so a viewer that opens
+// or reconnects mid-session shows the current routes.
+class RouteServer {
+public:
+    RouteServer(const Graph& graph, const SpatialIndex& index, RouteServerOptions options = {});
+    ~RouteServer();
+
+    // Bind and start the workers; false (with a message on stderr) on failure
+    bool start();
+    void stop();
+
+    int port() const { return bound_port; }
+    uint64_t requestsServed() const { return requests_served.load(std::memory_order_relaxed); }
+    RouteCacheStats cacheStats() const { return cache ? cache->stats() : RouteCacheStats(); }
+    RouteCoalescerStats coalescerStats() const { return coalescer ? coalescer->stats() : RouteCoalescerStats(); }
+
+    // Live viewer feed: a new query id makes viewers replace what they show,
+    // then each of its `count` routes is pushed as it is computed
+    uint64_t newQuery() { return ++query_counter; }
+    void pushRoute(uint64_t query, size_t index, size_t count, const RouteResult& route);
+    size_t viewerCount() const { return viewers.load(std::memory_order_relaxed); }
+
+    // Answer one request: fills status and returns the JSON body
+    std::string handle(const HttpRequest& request, int& status) const;
+
+    // Closed-loop load generator: `connections` keep-alive clients cycle
+    // through paths until `requests` responses have arrived
+    static LoadTestResult loadTest(int port, const std::vector<std::string>& paths,
+                                   unsigned connections, size_t requests);
+
+private:
+    struct Worker;
+
+    const Graph& graph;
+    const SpatialIndex& index;
+    RouteServerOptions options;
+    std::unique_ptr<RouteCache> cache;
+    std::unique_ptr<RouteCoalescer> coalescer;
+
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> requests_served{0};
+    int bound_port = 0;
+    std::string viewer_page;
+
+    // Events of the latest pushed query, by sequence number
+    std::mutex feed_mutex;
+    std::vector<std::pair<uint64_t, std::string>> feed;
+    uint64_t feed_query = 0, feed_seq = 0;
+    std::atomic<uint64_t> query_counter{0};
+    std::atomic<size_t> viewers{0};
+
+    void workerLoop(Worker& worker);
+    void wakeWorkers();
+    RouteCache::Result route(long long from, long long to, const MetricSnapshot& metric,
+                             RouteMode mode, int hour, uint64_t avoided_classes) const;
+    bool parseAvoid(const std::string* text, uint64_t& avoided_classes) const;
+
+    std::string routeEndpoint(const HttpRequest& request, int& status) const;
+    std::string compareEndpoint(const HttpRequest& request, int& status) const;
+    std::string matrixEndpoint(const HttpRequest& request, int& status) const;
+    std::string snapEndpoint(const HttpRequest& request, int& status) const;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "route_writer.h"
+#include "polyline.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+bool parseRouteFormat(const std::string& name, RouteFormat& format) {
+    if (name == "json") {
+        format = RouteFormat::JSON;
+    } else if (name == "polyline") {
+        format = RouteFormat::POLYLINE;
+    } else if (name == "binary") {
+        format = RouteFormat::BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* routeColor(RouteMode mode) {
+    switch (mode) {
+        case RouteMode::DISTANCE: return "#FF6B6B";     // Red
+        case RouteMode::SPEED_LIMIT: return "#4ECDC4";  // Cyan
+        default: return "#95E1D3";                      // Green
+    }
+}
+
+void routeNodeIndices(const Graph& graph, const RouteResult& route, std::vector<uint32_t>& indices) {
+    indices.clear();
+    indices.reserve(route.path.size());
+    uint32_t index;
+    if (!route.path.empty() && route.edge_path.size() + 1 == route.path.size()) {
+        // Each edge starts at the path node before it
+        for (size_t edge_id : route.edge_path) {
+            indices.push_back(graph.getEdgeSourceIndex(edge_id));
+        }
+        if (graph.getNodeIndex(route.path.back(), index)) {
+            indices.push_back(index);
+        }
+        return;
+    }
+    for (long long id : route.path) {
+        if (graph.getNodeIndex(id, index)) {
+            indices.push_back(index);
+        }
+    }
+}
+
+namespace {
+
+void appendPolyline(const Graph& graph, const std::vector<uint32_t>& indices, std::string& out) {
+    out.reserve(out.size() + 8 * indices.size());
+    PolylineEncoder encoder(out);
+    for (uint32_t index : indices) {
+        encoder.add(graph.getNodeLat(index), graph.getNodeLon(index));
+    }
+}
+
+}  // namespace
+
+void appendRoutePolyline(const Graph& graph, const RouteResult& route, std::string& out) {
+    std::vector<uint32_t> indices;
+    routeNodeIndices(graph, route, indices);
+    appendPolyline(graph, indices, out);
+}
+
+// ---- BufferedWriter ----
+
+BufferedWriter::BufferedWriter(std::ostream& out, size_t capacity) : out(out), capacity(capacity) {
+    buffer.reserve(capacity);
+}
+
+void BufferedWriter::append(const char* data, size_t length) {
+    if (buffer.size() + length > capacity) {
+        flush();
+        if (length > capacity) {
+            out.write(data, (std::streamsize)length);
+            return;
+        }
+    }
+    buffer.append(data, length);
+}
+
+void BufferedWriter::appendInteger(long long value) {
+    char digits[24];
+    int length = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[sizeof(digits) - 1 - length++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[sizeof(digits) - 1 - length++] = '-';
+    }
+    append(digits + sizeof(digits) - length, (size_t)length);
+}
+
+// Scale, round once and print the integer and fraction parts; no locale,
+// no stream state
+void BufferedWriter::appendFixed(double value, int decimals) {
+    static const double kPowers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+    if (!std::isfinite(value)) {
+        append("null", 4);
+        return;
+    }
+    decimals = std::max(0, std::min(decimals, 9));
+    double scaled = std::round(std::fabs(value) * kPowers[decimals]);
+    if (scaled >= 9e18) {
+        char text[64];
+        int length = std::snprintf(text, sizeof(text), "%.*f", decimals, value);
+        append(text, (size_t)length);
+        return;
+    }
+    uint64_t units = (uint64_t)scaled;
+    uint64_t power = (uint64_t)kPowers[decimals];
+    if (value < 0 && units > 0) {
+        put('-');
+    }
+    appendInteger((long long)(units / power));
+    if (decimals > 0) {
+        char fraction[9];
+        uint64_t rest = units % power;
+        for (int d = decimals - 1; d >= 0; d--) {
+            fraction[d] = (char)('0' + rest % 10);
+            rest /= 10;
+        }
+        put('.');
+        append(fraction, (size_t)decimals);
+    }
+}
+
+void BufferedWriter::appendVarint(uint64_t value) {
+    while (value >= 0x80) {
+        put((char)(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    put((char)value);
+}
+
+void BufferedWriter::appendSignedVarint(int64_t value) {
+    appendVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void BufferedWriter::flush() {
+    if (!buffer.empty()) {
+        out.write(buffer.data(), (std::streamsize)buffer.size());
+        buffer.clear();
+    }
+}
+
+// ---- Formats ----
+
+namespace {
+
+void writeJson(const Graph& graph, const std::vector<RouteResult>& routes, BufferedWriter& writer,
+               bool polyline) {
+    std::vector<uint32_t> indices;
+    std::string encoded;
+    writer.append("{\"routes\":[\n");
+    for (size_t r = 0; r < routes.size(); r++) {
+        const RouteResult& route = routes[r];
+        writer.append("{\"mode\":\"");
+        writer.append(route.mode_name);
+        writer.append("\",\"color\":\"");
+        writer.append(routeColor(route.mode));
+        writer.append("\",\"total_distance_km\":");
+        writer.appendFixed(route.total_distance / 1000.0, 3);
+        writer.append(",\"estimated_time_min\":");
+        writer.appendFixed(route.estimated_time / 60.0, 1);
+
+        routeNodeIndices(graph, route, indices);
+        if (polyline) {
+            writer.append(",\"points\":");
+            writer.appendInteger((long long)indices.size());
+            writer.append(",\"polyline\":\"");
+            encoded.clear();
+            appendPolyline(graph, indices, encoded);
+            for (char c : encoded) {
+                if (c == '\\') {
+                    writer.put('\\');
+                }
+                writer.put(c);
+            }
+            writer.put('"');
+        } else {
+            writer.append(",\"waypoints\":[");
+            for (size_t i = 0; i < indices.size(); i++) {
+                writer.append(i == 0 ? "{\"id\":" : ",{\"id\":");
+                writer.appendInteger(graph.getNodeId(indices[i]));
+                writer.append(",\"lat\":");
+                writer.appendFixed(graph.getNodeLat(indices[i]), 7);
+                writer.append(",\"lon\":");
+                writer.appendFixed(graph.getNodeLon(indices[i]), 7);
+                writer.put('}');
+            }
+            writer.put(']');
+        }
+        writer.append(r + 1 < routes.size() ? "},\n" : "}\n");
+    }
+    writer.append("]}\n");
+}
+
+void writeBinary(const Graph& graph, const std::vector<RouteResult>& routes, BufferedWriter& writer) {
+    std::vector<uint32_t> indices;
+    writer.append("GRT1", 4);
+    writer.appendVarint(routes.size());
+    for (const RouteResult& route : routes) {
+        writer.appendVarint(route.mode == RouteMode::DISTANCE ? 0 : route.mode == RouteMode::SPEED_LIMIT ? 1 : 2);
+        writer.appendVarint((uint64_t)std::llround(std::max(0.0, route.total_distance) * 1000.0));
+        writer.appendVarint((uint64_t)std::llround(std::max(0.0, route.estimated_time) * 1000.0));
+        routeNodeIndices(graph, route, indices);
+        writer.appendVarint(indices.size());
+        long long last_id = 0, last_lat = 0, last_lon = 0;
+        for (uint32_t index : indices) {
+            long long id = graph.getNodeId(index);
+            long long lat = std::llround(graph.getNodeLat(index) * 1e7);
+            long long lon = std::llround(graph.getNodeLon(index) * 1e7);
+            writer.appendSignedVarint(id - last_id);
+            writer.appendSignedVarint(lat - last_lat);
+            writer.appendSignedVarint(lon - last_lon);
+            last_id = id;
+            last_lat = lat;
+            last_lon = lon;
+        }
+    }
+}
+
+}  // namespace
+
+void writeRoutes(const Graph& graph, const std::vector<RouteResult>& routes, std::ostream& out,
+                 RouteFormat format) {
+    BufferedWriter writer(out);
+    if (format == RouteFormat::BINARY) {
+        writeBinary(graph, routes, writer);
+    } else {
+        writeJson(graph, routes, writer, format == RouteFormat::POLYLINE);
+    }
+}
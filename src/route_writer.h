@@ -0,0 +1,67 @@
+#ifndef ROUTE_WRITER_H
+#define ROUTE_WRITER_H
+
+#include "graph.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class RouteFormat {
+    JSON,        // compact routes.json: waypoints with id, lat, lon
+    POLYLINE,    // routes.json with a Google encoded polyline per route instead of waypoints
+    BINARY       // varint delta-coded (see writeRoutes)
+};
+
+bool parseRouteFormat(const std::string& name, RouteFormat& format);
+
+// Viewer color of a routing mode
+const char* routeColor(RouteMode mode);
+
+// Dense node indices along a route. Read off its edges, so only the last
+// node costs a hash lookup; falls back to per-node lookups if the route
+// carries no edge path.
+void routeNodeIndices(const Graph& graph, const RouteResult& route, std::vector<uint32_t>& indices);
+
+// Encoded polyline of a route, appended to out
+void appendRoutePolyline(const Graph& graph, const RouteResult& route, std::string& out);
+
+// Output buffer that formats numbers in place and hands the stream whole
+// blocks, instead of one formatted insertion (and precision change) per value
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::ostream& out, size_t capacity = 1 << 16);
+    ~BufferedWriter() { flush(); }
+
+    void put(char c) {
+        if (buffer.size() == capacity) {
+            flush();
+        }
+        buffer += c;
+    }
+    void append(const char* data, size_t length);
+    void append(const std::string& text) { append(text.data(), text.size()); }
+    void appendInteger(long long value);
+    void appendFixed(double value, int decimals);   // up to 9 decimals; null if not finite
+    void appendVarint(uint64_t value);              // LEB128
+    void appendSignedVarint(int64_t value);         // zigzag, then LEB128
+
+    void flush();
+
+private:
+    std::ostream& out;
+    size_t capacity;
+    std::string buffer;
+};
+
+// Write routes in the given format. BINARY layout, all integers varints
+// (signed ones zigzagged):
+//   "GRT1" route_count
+//   per route: mode (0 distance, 1 speed limit, 2 learned)
+//              distance_mm time_ms point_count
+//              per point: delta node id, delta lat, delta lon (1e-7 degrees)
+// Deltas restart at zero for each route.
+void writeRoutes(const Graph& graph, const std::vector<RouteResult>& routes, std::ostream& out,
+                 RouteFormat format);
+
+#endif
@@ -0,0 +1,189 @@
+#include "scenario_runner.h"
+#include "parallel.h"
+#include "search_workspace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+const double kInf = std::numeric_limits<double>::infinity();
+
+enum EdgeChange : uint8_t { UNCHANGED, SLOWER, FASTER };
+
+// Trips sharing an origin share its trees
+struct OriginGroup {
+    long long origin;
+    uint32_t origin_index;
+    std::vector<size_t> pairs;     // indices into the OD list
+};
+
+// Per-worker scratch space, reused across origins
+struct WorkerState {
+    SearchWorkspace base;
+    SearchWorkspace scenario;
+    std::vector<long long> pending;
+    std::vector<size_t> pending_pairs;
+    std::vector<double> costs;
+    size_t reused = 0;
+};
+
+}  // namespace
+
+ScenarioRunner::ScenarioRunner(const Graph& graph, ScenarioOptions options)
+    : graph(graph), options(options) {}
+
+ScenarioReport ScenarioRunner::evaluate(const Scenario& scenario,
+                                        const std::vector<std::pair<long long, long long>>& od_pairs) const {
+    auto started = std::chrono::steady_clock::now();
+    ScenarioReport report;
+    report.od_pairs = od_pairs.size();
+    report.deltas.assign(od_pairs.size(), std::nan(""));
+
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    size_t edge_count = graph.edgeCount();
+
+    auto base_metric = graph.currentMetric();
+    MetricSnapshot replacement{0, scenario.crowd_multipliers};
+    const MetricSnapshot& scenario_metric = scenario.crowd_multipliers.empty() ? *base_metric : replacement;
+
+    std::vector<uint8_t> closed(edge_count, 0);
+    for (size_t edge_id : scenario.closed_edges) {
+        if (edge_id < edge_count) {
+            closed[edge_id] = 1;
+        }
+    }
+
+    auto base_weight = [&](const Edge& edge) {
+        return graph.learnedTravelTime(edge, options.hour_of_day, *base_metric);
+    };
+    auto scenario_weight = [&](const Edge& edge) {
+        return closed[edge.id] ? kInf : graph.learnedTravelTime(edge, options.hour_of_day, scenario_metric);
+    };
+
+    // Classify every edge once
+    std::vector<uint8_t> change(edge_count, UNCHANGED);
+    parallelFor(edge_count, [&](size_t begin, size_t end, unsigned) {
+        for (size_t id = begin; id < end; id++) {
+            const Edge& edge = *graph.getEdge(id);
+            double before = base_weight(edge), after = scenario_weight(edge);
+            change[id] = after > before ? SLOWER : after < before ? FASTER : UNCHANGED;
+        }
+    }, num_threads);
+    std::vector<size_t> faster;
+    for (size_t id = 0; id < edge_count; id++) {
+        report.changed_edges += change[id] != UNCHANGED;
+        if (change[id] == FASTER) {
+            faster.push_back(id);
+        }
+    }
+
+    std::vector<OriginGroup> groups;
+    {
+        std::unordered_map<long long, size_t> origin_slot;
+        for (size_t k = 0; k < od_pairs.size(); k++) {
+            uint32_t origin_index, destination_index;
+            if (!graph.getNodeIndex(od_pairs[k].first, origin_index) ||
+                !graph.getNodeIndex(od_pairs[k].second, destination_index)) {
+                continue;
+            }
+            auto it = origin_slot.emplace(od_pairs[k].first, groups.size()).first;
+            if (it->second == groups.size()) {
+                groups.push_back({od_pairs[k].first, origin_index, {}});
+            }
+            groups[it->second].pairs.push_back(k);
+        }
+    }
+
+    std::vector<WorkerState> workers(num_threads);
+    parallelForEach(groups.size(), [&](size_t g, unsigned worker) {
+        const OriginGroup& group = groups[g];
+        WorkerState& state = workers[worker];
+        SearchWorkspace& tree = state.base;
+        graph.shortestPathTree(group.origin_index, tree, base_weight);
+
+        // Base distances are still exact if no cheaper edge opens a shortcut
+        bool potentials_hold = true;
+        for (size_t edge_id : faster) {
+            uint32_t from = graph.getEdgeSourceIndex(edge_id);
+            const Edge& edge = *graph.getEdge(edge_id);
+            if (tree.reached(from) &&
+                tree.distance(from) + scenario_weight(edge) < tree.distance(edge.to_index)) {
+                potentials_hold = false;
+                break;
+            }
+        }
+
+        state.pending.clear();
+        state.pending_pairs.clear();
+        for (size_t k : group.pairs) {
+            uint32_t target;
+            graph.getNodeIndex(od_pairs[k].second, target);
+            if (!tree.reached(target)) {
+                continue;
+            }
+            bool reusable = potentials_hold;
+            for (uint32_t node = target; reusable && node != group.origin_index;) {
+                size_t edge_id = tree.parentEdge(node);
+                reusable = change[edge_id] != SLOWER;
+                node = graph.getEdgeSourceIndex(edge_id);
+            }
+            if (reusable) {
+                report.deltas[k] = 0.0;
+                state.reused++;
+            } else {
+                state.pending.push_back(od_pairs[k].second);
+                state.pending_pairs.push_back(k);
+            }
+        }
+        if (state.pending.empty()) {
+            return;
+        }
+
+        // The base tree is overwritten by the next search, so read it first
+        std::vector<double> base_costs(state.pending.size());
+        for (size_t i = 0; i < state.pending.size(); i++) {
+            uint32_t target;
+            graph.getNodeIndex(state.pending[i], target);
+            base_costs[i] = tree.distance(target);
+        }
+        graph.oneToMany(group.origin, state.pending, state.scenario, scenario_weight, state.costs);
+        for (size_t i = 0; i < state.pending.size(); i++) {
+            report.deltas[state.pending_pairs[i]] = state.costs[i] - base_costs[i];
+        }
+    }, num_threads);
+
+    for (const auto& state : workers) {
+        report.reused += state.reused;
+    }
+
+    std::vector<double> finite;
+    double sum = 0.0;
+    for (double delta : report.deltas) {
+        if (std::isnan(delta)) {
+            continue;
+        }
+        report.routed++;
+        if (delta == kInf) {
+            report.disconnected++;
+            continue;
+        }
+        report.affected += std::fabs(delta) > 1e-6;
+        finite.push_back(delta);
+        sum += delta;
+    }
+    if (!finite.empty()) {
+        std::sort(finite.begin(), finite.end());
+        auto percentile = [&](double p) { return finite[(size_t)(p * (finite.size() - 1))]; };
+        report.mean_delta_s = sum / finite.size();
+        report.p50_delta_s = percentile(0.5);
+        report.p90_delta_s = percentile(0.9);
+        report.p99_delta_s = percentile(0.99);
+        report.min_delta_s = finite.front();
+        report.max_delta_s = finite.back();
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
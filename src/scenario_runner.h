@@ -0,0 +1,56 @@
+#ifndef SCENARIO_RUNNER_H
+#define SCENARIO_RUNNER_H
+
+#include "graph.h"
+#include <utility>
+#include <vector>
+
+// A planned change, evaluated against the graph's live metric and closures
+struct Scenario {
+    std::vector<double> crowd_multipliers;   // replacement snapshot; empty = keep the live one
+    std::vector<size_t> closed_edges;        // closed in addition to the live closures
+};
+
+struct ScenarioOptions {
+    int hour_of_day = 17;
+    unsigned threads = 0;          // 0 = all hardware threads
+};
+
+struct ScenarioReport {
+    std::vector<double> deltas;    // per OD pair: scenario minus base time (s); NaN if unroutable in the base
+    size_t od_pairs = 0;
+    size_t routed = 0;             // routable in the base
+    size_t disconnected = 0;       // routable in the base, not in the scenario
+    size_t affected = 0;           // routable in both with a different time
+    size_t reused = 0;             // answered from the base tree without searching
+    size_t changed_edges = 0;
+    double mean_delta_s = 0.0;     // over pairs routable in both
+    double p50_delta_s = 0.0, p90_delta_s = 0.0, p99_delta_s = 0.0;
+    double max_delta_s = 0.0, min_delta_s = 0.0;
+    double seconds = 0.0;
+};
+
+// Batch what-if evaluation: how a closure or traffic change shifts travel
+// times over a sample of trips.
+//
+// Trips are grouped by origin and each origin gets one base tree. Base
+// distances stay exact in the scenario as long as no edge that got cheaper
+// offers a shortcut (d(u) + w'(u,v) >= d(v)); a destination whose tree path
+// also avoids every edge that got slower or closed then keeps its base time
+// without a search. Only the remaining destinations are searched under the
+// scenario weights, with one early-stopping search per origin. Origins run
+// in parallel with per-worker workspaces; nothing is published, so live
+// queries are unaffected.
+class ScenarioRunner {
+public:
+    ScenarioRunner(const Graph& graph, ScenarioOptions options = {});
+
+    ScenarioReport evaluate(const Scenario& scenario,
+                            const std::vector<std::pair<long long, long long>>& od_pairs) const;
+
+private:
+    const Graph& graph;
+    ScenarioOptions options;
+};
+
+#endif
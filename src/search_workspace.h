@@ -0,0 +1,83 @@
+#ifndef SEARCH_WORKSPACE_H
+#define SEARCH_WORKSPACE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Reusable per-thread scratch space for shortest-path searches over dense
+// node indices. Arrays are sized once per graph and invalidated in O(1) by
+// bumping a generation stamp, so a query touches only the nodes it visits
+// and never allocates after warm-up.
+class SearchWorkspace {
+public:
+    static constexpr size_t kNoEdge = std::numeric_limits<size_t>::max();
+
+    // Prepare for a new search on a graph with node_count nodes
+    void begin(size_t node_count) {
+        if (distances.size() < node_count) {
+            distances.resize(node_count);
+            parent_edges.resize(node_count);
+            stamps.resize(node_count, 0);
+            marks.resize(node_count, 0);
+        }
+        if (++generation == 0) {
+            // Stamp counter wrapped: clear once every 4 billion searches
+            std::fill(stamps.begin(), stamps.end(), 0);
+            std::fill(marks.begin(), marks.end(), 0);
+            generation = 1;
+        }
+        heap.clear();
+    }
+
+    bool reached(uint32_t node) const { return stamps[node] == generation; }
+
+    double distance(uint32_t node) const {
+        return reached(node) ? distances[node] : std::numeric_limits<double>::infinity();
+    }
+
+    size_t parentEdge(uint32_t node) const { return reached(node) ? parent_edges[node] : kNoEdge; }
+
+    void update(uint32_t node, double distance, size_t parent_edge) {
+        distances[node] = distance;
+        parent_edges[node] = parent_edge;
+        stamps[node] = generation;
+    }
+
+    // Per-search node flags (e.g. "is a target"), cleared by begin()
+    void mark(uint32_t node) { marks[node] = generation; }
+    void unmark(uint32_t node) { marks[node] = 0; }
+    bool marked(uint32_t node) const { return marks[node] == generation; }
+
+    // Min-heap of (distance, node) with lazy deletion
+    void push(double distance, uint32_t node) {
+        heap.push_back({distance, node});
+        std::push_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+    }
+
+    std::pair<double, uint32_t> top() const { return heap.front(); }
+
+    std::pair<double, uint32_t> pop() {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+        HeapEntry top = heap.back();
+        heap.pop_back();
+        return top;
+    }
+
+    bool empty() const { return heap.empty(); }
+
+private:
+    using HeapEntry = std::pair<double, uint32_t>;
+
+    std::vector<double> distances;
+    std::vector<size_t> parent_edges;
+    std::vector<uint32_t> stamps;
+    std::vector<uint32_t> marks;
+    uint32_t generation = 0;
+    std::vector<HeapEntry> heap;
+};
+
+#endif
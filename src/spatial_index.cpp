@@ -0,0 +1,158 @@
+#include "spatial_index.h"
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+
+// Keep the grid bounded on very large extracts; cells grow instead
+constexpr double kMaxCells = 16.0 * 1024 * 1024;
+
+}  // namespace
+
+SpatialIndex::SpatialIndex(const Graph& graph, double cell_size_m) : cell_size(cell_size_m) {
+    size_t edge_count = graph.edgeCount();
+    if (edge_count == 0) {
+        cell_offsets.assign(1, 0);
+        return;
+    }
+
+    // Bounding box over all edge endpoints
+    double max_lat = -90.0, max_lon = -180.0;
+    min_lat = 90.0;
+    min_lon = 180.0;
+    for (size_t id = 0; id < edge_count; id++) {
+        const Edge* edge = graph.getEdge(id);
+        const Node* a = graph.getNode(graph.getEdgeSource(id));
+        const Node* b = graph.getNode(edge->to);
+        for (const Node* n : {a, b}) {
+            min_lat = std::min(min_lat, n->lat);
+            max_lat = std::max(max_lat, n->lat);
+            min_lon = std::min(min_lon, n->lon);
+            max_lon = std::max(max_lon, n->lon);
+        }
+    }
+
+    // Equirectangular projection around the box center is accurate to well
+    // under a meter at city scale, which is all snapping needs
+    const double R = 6371000.0;
+    double center_lat = (min_lat + max_lat) / 2.0;
+    meters_per_deg_lat = R * M_PI / 180.0;
+    meters_per_deg_lon = meters_per_deg_lat * std::cos(center_lat * M_PI / 180.0);
+
+    double width = (max_lon - min_lon) * meters_per_deg_lon;
+    double height = (max_lat - min_lat) * meters_per_deg_lat;
+    if ((width / cell_size) * (height / cell_size) > kMaxCells) {
+        cell_size = std::sqrt(width * height / kMaxCells);
+    }
+    cols = std::max(1, (int)(width / cell_size) + 1);
+    rows = std::max(1, (int)(height / cell_size) + 1);
+
+    segments.resize(edge_count);
+    for (size_t id = 0; id < edge_count; id++) {
+        const Edge* edge = graph.getEdge(id);
+        const Node* a = graph.getNode(graph.getEdgeSource(id));
+        const Node* b = graph.getNode(edge->to);
+        Segment& seg = segments[id];
+        project(a->lat, a->lon, seg.x1, seg.y1);
+        project(b->lat, b->lon, seg.x2, seg.y2);
+    }
+
+    // Two passes (count, then fill) to build the CSR cell lists
+    cell_offsets.assign((size_t)rows * cols + 1, 0);
+    auto forEachCell = [&](const Segment& seg, auto&& visit) {
+        int c0 = cellCol(std::min(seg.x1, seg.x2)), c1 = cellCol(std::max(seg.x1, seg.x2));
+        int r0 = cellRow(std::min(seg.y1, seg.y2)), r1 = cellRow(std::max(seg.y1, seg.y2));
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                visit((size_t)r * cols + c);
+            }
+        }
+    };
+    for (const auto& seg : segments) {
+        forEachCell(seg, [&](size_t cell) { cell_offsets[cell + 1]++; });
+    }
+    for (size_t i = 1; i < cell_offsets.size(); i++) {
+        cell_offsets[i] += cell_offsets[i - 1];
+    }
+    cell_edges.resize(cell_offsets.back());
+    std::vector<size_t> fill(cell_offsets.begin(), cell_offsets.end() - 1);
+    for (size_t id = 0; id < segments.size(); id++) {
+        forEachCell(segments[id], [&](size_t cell) { cell_edges[fill[cell]++] = id; });
+    }
+}
+
+void SpatialIndex::project(double lat, double lon, double& x, double& y) const {
+    x = (lon - min_lon) * meters_per_deg_lon;
+    y = (lat - min_lat) * meters_per_deg_lat;
+}
+
+int SpatialIndex::cellCol(double x) const {
+    return std::clamp((int)std::floor(x / cell_size), 0, cols - 1);
+}
+
+int SpatialIndex::cellRow(double y) const {
+    return std::clamp((int)std::floor(y / cell_size), 0, rows - 1);
+}
+
+std::vector<EdgeCandidate> SpatialIndex::nearestEdges(double lat, double lon, double radius_m,
+                                                      size_t max_results) const {
+    std::vector<EdgeCandidate> result;
+    if (segments.empty()) {
+        return result;
+    }
+
+    double px, py;
+    project(lat, lon, px, py);
+
+    int c0 = cellCol(px - radius_m), c1 = cellCol(px + radius_m);
+    int r0 = cellRow(py - radius_m), r1 = cellRow(py + radius_m);
+
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            size_t cell = (size_t)r * cols + c;
+            for (size_t i = cell_offsets[cell]; i < cell_offsets[cell + 1]; i++) {
+                size_t id = cell_edges[i];
+                const Segment& seg = segments[id];
+
+                double dx = seg.x2 - seg.x1, dy = seg.y2 - seg.y1;
+                double len2 = dx * dx + dy * dy;
+                double t = len2 > 0.0 ? ((px - seg.x1) * dx + (py - seg.y1) * dy) / len2 : 0.0;
+                t = std::clamp(t, 0.0, 1.0);
+                double ex = seg.x1 + t * dx - px, ey = seg.y1 + t * dy - py;
+                double dist = std::sqrt(ex * ex + ey * ey);
+
+                if (dist <= radius_m) {
+                    result.push_back({id, dist, t});
+                }
+            }
+        }
+    }
+
+    // Segments spanning several cells are reported once per cell
+    std::sort(result.begin(), result.end(), [](const EdgeCandidate& a, const EdgeCandidate& b) {
+        return a.edge_id < b.edge_id;
+    });
+    result.erase(std::unique(result.begin(), result.end(),
+                             [](const EdgeCandidate& a, const EdgeCandidate& b) {
+                                 return a.edge_id == b.edge_id;
+                             }),
+                 result.end());
+
+    std::sort(result.begin(), result.end(), [](const EdgeCandidate& a, const EdgeCandidate& b) {
+        return a.distance < b.distance;
+    });
+    if (result.size() > max_results) {
+        result.resize(max_results);
+    }
+    return result;
+}
+
+double SpatialIndex::edgeBearing(size_t edge_id) const {
+    const Segment& seg = segments[edge_id];
+    double bearing = std::atan2(seg.x2 - seg.x1, seg.y2 - seg.y1) * 180.0 / M_PI;
+    return bearing < 0.0 ? bearing + 360.0 : bearing;
+}
@@ -0,0 +1,49 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "graph.h"
+#include <vector>
+
+// A directed edge near a query point
+struct EdgeCandidate {
+    size_t edge_id;
+    double distance;   // meters from the query point to the segment
+    double fraction;   // position of the closest point along the edge (0 = source, 1 = target)
+};
+
+// Uniform grid over edge segments for snapping GPS points to the road network.
+// Cells are stored CSR-style (offsets + flat edge list) so a lookup touches a
+// handful of contiguous arrays. Build once after the graph is loaded.
+class SpatialIndex {
+public:
+    explicit SpatialIndex(const Graph& graph, double cell_size_m = 100.0);
+
+    // Edges within radius_m of (lat, lon), closest first, at most max_results
+    std::vector<EdgeCandidate> nearestEdges(double lat, double lon, double radius_m,
+                                            size_t max_results = 8) const;
+
+    // Initial compass bearing of an edge in degrees (0 = north, clockwise)
+    double edgeBearing(size_t edge_id) const;
+
+    size_t edgeCount() const { return segments.size(); }
+
+private:
+    struct Segment {
+        double x1, y1, x2, y2;   // local planar coordinates in meters
+    };
+
+    double min_lat = 0.0, min_lon = 0.0;
+    double meters_per_deg_lat = 0.0, meters_per_deg_lon = 0.0;
+    double cell_size;
+    int cols = 0, rows = 0;
+
+    std::vector<Segment> segments;        // indexed by edge id
+    std::vector<size_t> cell_offsets;     // rows * cols + 1 entries
+    std::vector<size_t> cell_edges;
+
+    void project(double lat, double lon, double& x, double& y) const;
+    int cellCol(double x) const;
+    int cellRow(double y) const;
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include "speed_profile.h"
+#include "probe_ingest.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SPEED_PROFILE_MMAP 1
+#endif
+
+namespace {
+
+const char kMagic[8] = {'G', 'P', 'S', 'P', 'R', 'O', 'F', '2'};
+
+// Shapes are compared, and deviations stored, after rounding to 1/32 octave
+// per slot
+constexpr double kShapeSteps = 32.0;
+constexpr double kScaleSteps = 32.0;
+
+uint8_t quantizeScale(double scale) {
+    double code = 127.0 + std::round(std::log2(std::max(scale, 1e-6)) * kScaleSteps);
+    return (uint8_t)std::clamp(code, 0.0, 255.0);
+}
+
+int8_t quantizeStep(double ratio) {
+    double step = std::round(std::log2(std::max(ratio, 1e-6)) * kShapeSteps);
+    return (int8_t)std::clamp(step, -127.0, 127.0);
+}
+
+}  // namespace
+
+float SpeedProfileStore::scale_table[256];
+float SpeedProfileStore::deviation_table[256];
+
+namespace {
+
+struct TableInit {
+    TableInit(float* scales, float* deviations) {
+        for (int code = 0; code < 256; code++) {
+            scales[code] = (float)std::exp2((code - 127) / kScaleSteps);
+            deviations[code] = (float)std::exp2((int8_t)code / kShapeSteps);
+        }
+    }
+};
+
+}  // namespace
+
+// Collects per-edge factor curves: deduplicates the shapes of their base
+// curves and stores what the shape cannot express as per-slot deviations
+class SpeedProfileStore::Builder {
+public:
+    explicit Builder(SpeedProfileStore& store) : store(store) {
+        // Shape 0 is flat, the fallback once the dictionary is full
+        addShape(std::string(kSlotsPerDay, '\0'));
+        store.owned_deviations.assign(kSlotsPerDay, 0);
+    }
+
+    // base picks the shared shape and scale; factors is the curve to
+    // reproduce, within 1/32 octave and +-127 steps of the shape
+    void add(const std::vector<double>& base, const std::vector<double>& factors) {
+        // Median as scale keeps plain rush-hour curves (mostly 1.0) exact
+        std::vector<double> sorted(base);
+        std::sort(sorted.begin(), sorted.end());
+        double median = (sorted[kSlotsPerDay / 2 - 1] + sorted[kSlotsPerDay / 2]) / 2.0;
+        uint8_t scale_code = quantizeScale(median);
+        double scale = scale_table[scale_code];
+
+        std::string key(kSlotsPerDay, '\0');
+        for (int slot = 0; slot < kSlotsPerDay; slot++) {
+            key[slot] = (char)quantizeStep(base[slot] / scale);
+        }
+
+        uint16_t shape = 0;
+        auto it = dictionary.find(key);
+        if (it != dictionary.end()) {
+            shape = it->second;
+        } else if (dictionary.size() < 65535) {
+            shape = addShape(key);
+        }
+
+        const float* curve = &store.owned_shapes[(size_t)shape * kSlotsPerDay];
+        uint8_t row[kSlotsPerDay];
+        bool exact = true;
+        for (int slot = 0; slot < kSlotsPerDay; slot++) {
+            row[slot] = (uint8_t)quantizeStep(factors[slot] / (curve[slot] * scale));
+            exact = exact && row[slot] == 0;
+        }
+        uint32_t deviation = 0;
+        if (!exact) {
+            deviation = (uint32_t)(store.owned_deviations.size() / kSlotsPerDay);
+            store.owned_deviations.insert(store.owned_deviations.end(), row, row + kSlotsPerDay);
+        }
+        store.owned_entries.push_back({shape, scale_code, 0, deviation});
+    }
+
+    void add(const std::vector<double>& factors) { add(factors, factors); }
+
+    void finish() {
+        store.shapes = store.owned_shapes.data();
+        store.entries = store.owned_entries.data();
+        store.deviations = store.owned_deviations.data();
+        store.shape_count = store.owned_shapes.size() / kSlotsPerDay;
+        store.edge_count = store.owned_entries.size();
+        store.deviation_count = store.owned_deviations.size() / kSlotsPerDay;
+    }
+
+private:
+    SpeedProfileStore& store;
+    std::unordered_map<std::string, uint16_t> dictionary;
+
+    uint16_t addShape(const std::string& key) {
+        uint16_t shape = (uint16_t)dictionary.size();
+        dictionary.emplace(key, shape);
+        for (int slot = 0; slot < kSlotsPerDay; slot++) {
+            store.owned_shapes.push_back((float)std::exp2((int8_t)key[slot] / kShapeSteps));
+        }
+        return shape;
+    }
+};
+
+SpeedProfileStore::SpeedProfileStore() {
+    static TableInit init(scale_table, deviation_table);
+}
+
+SpeedProfileStore::~SpeedProfileStore() {
+    release();
+}
+
+SpeedProfileStore::SpeedProfileStore(SpeedProfileStore&& other) noexcept {
+    *this = std::move(other);
+}
+
+SpeedProfileStore& SpeedProfileStore::operator=(SpeedProfileStore&& other) noexcept {
+    if (this != &other) {
+        release();
+        // Moving a vector keeps its buffer, so the view pointers stay valid
+        owned_shapes = std::move(other.owned_shapes);
+        owned_entries = std::move(other.owned_entries);
+        owned_deviations = std::move(other.owned_deviations);
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+        shapes = other.shapes;
+        entries = other.entries;
+        deviations = other.deviations;
+        shape_count = other.shape_count;
+        edge_count = other.edge_count;
+        deviation_count = other.deviation_count;
+
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+        other.shapes = nullptr;
+        other.entries = nullptr;
+        other.deviations = nullptr;
+        other.shape_count = other.edge_count = other.deviation_count = 0;
+    }
+    return *this;
+}
+
+void SpeedProfileStore::release() {
+#ifdef SPEED_PROFILE_MMAP
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+}
+
+size_t SpeedProfileStore::memoryBytes() const {
+    return shape_count * kSlotsPerDay * sizeof(float) + edge_count * sizeof(EdgeEntry) +
+           deviation_count * kSlotsPerDay;
+}
+
+SpeedProfileStore SpeedProfileStore::fromRushHourModel(const Graph& graph) {
+    SpeedProfileStore store;
+    Builder builder(store);
+    std::vector<double> factors(kSlotsPerDay);
+
+    for (size_t id = 0; id < graph.edgeCount(); id++) {
+        const Edge* edge = graph.getEdge(id);
+        for (int slot = 0; slot < kSlotsPerDay; slot++) {
+            factors[slot] = graph.getRushHourSpeed(*edge, slot * 24 / kSlotsPerDay) / edge->segment->speed_limit;
+        }
+        builder.add(factors);
+    }
+    builder.finish();
+    return store;
+}
+
+SpeedProfileStore SpeedProfileStore::fromProbes(const Graph& graph, const ProbeIngestor& ingestor,
+                                                size_t min_observations) {
+    SpeedProfileStore store;
+    Builder builder(store);
+    std::vector<double> base(kSlotsPerDay), factors(kSlotsPerDay);
+
+    for (size_t id = 0; id < graph.edgeCount(); id++) {
+        const Edge* edge = graph.getEdge(id);
+        for (int slot = 0; slot < kSlotsPerDay; slot++) {
+            base[slot] = graph.getRushHourSpeed(*edge, slot * 24 / kSlotsPerDay) / edge->segment->speed_limit;
+        }
+        // Ratios were measured against the expected speed, so they compose;
+        // the rush-hour curve stays the shared shape and the ratios become
+        // the edge's deviations
+        factors = base;
+        if (ingestor.observationCount(id) >= min_observations) {
+            std::vector<double> ratios = ingestor.slotRatios(id);
+            for (int slot = 0; slot < kSlotsPerDay; slot++) {
+                factors[slot] *= ratios[slot];
+            }
+        }
+        builder.add(base, factors);
+    }
+    builder.finish();
+    return store;
+}
+
+bool SpeedProfileStore::save(const std::string& filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not create profile file " << filename << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.slots = kSlotsPerDay;
+    header.shape_count = (uint32_t)shape_count;
+    header.edge_count = edge_count;
+    header.deviation_count = deviation_count;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(shapes), shape_count * kSlotsPerDay * sizeof(float));
+    file.write(reinterpret_cast<const char*>(entries), edge_count * sizeof(EdgeEntry));
+    file.write(reinterpret_cast<const char*>(deviations), deviation_count * kSlotsPerDay);
+    return (bool)file;
+}
+
+std::unique_ptr<SpeedProfileStore> SpeedProfileStore::load(const std::string& filename) {
+    std::unique_ptr<SpeedProfileStore> store(new SpeedProfileStore());
+
+#ifdef SPEED_PROFILE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Could not open profile file " << filename << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FileHeader)) {
+        close(fd);
+        std::cerr << "Error: Invalid profile file " << filename << std::endl;
+        return nullptr;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: Could not map profile file " << filename << std::endl;
+        return nullptr;
+    }
+    store->mapping = mapped;
+    store->mapping_size = st.st_size;
+    const char* data = static_cast<const char*>(mapped);
+    size_t size = st.st_size;
+#else
+    // No mmap: read the file into the owned buffers instead
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open profile file " << filename << std::endl;
+        return nullptr;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const char* data = buffer.data();
+    size_t size = buffer.size();
+#endif
+
+    FileHeader header;
+    if (size < sizeof(header)) {
+        std::cerr << "Error: Invalid profile file " << filename << std::endl;
+        return nullptr;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    // Counts come from the file: bound each section by what is left before
+    // multiplying, so a corrupt header can't wrap the size check
+    size_t rest = size - sizeof(header);
+    bool valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.slots == kSlotsPerDay &&
+                 header.shape_count > 0 && header.deviation_count > 0 &&
+                 header.shape_count <= rest / (kSlotsPerDay * sizeof(float));
+    size_t shape_bytes = valid ? (size_t)header.shape_count * kSlotsPerDay * sizeof(float) : 0;
+    valid = valid && header.edge_count <= (rest - shape_bytes) / sizeof(EdgeEntry);
+    size_t entry_bytes = valid ? header.edge_count * sizeof(EdgeEntry) : 0;
+    valid = valid && header.deviation_count <= (rest - shape_bytes - entry_bytes) / kSlotsPerDay;
+    if (!valid) {
+        std::cerr << "Error: Invalid profile file " << filename << std::endl;
+        return nullptr;
+    }
+
+    // factor() indexes with these unchecked on the routing path
+    const EdgeEntry* file_entries = reinterpret_cast<const EdgeEntry*>(data + sizeof(header) + shape_bytes);
+    for (size_t id = 0; id < header.edge_count; id++) {
+        EdgeEntry entry;
+        std::memcpy(&entry, &file_entries[id], sizeof(entry));
+        if (entry.shape >= header.shape_count || entry.deviation >= header.deviation_count) {
+            std::cerr << "Error: Invalid profile file " << filename << " (edge " << id << ")" << std::endl;
+            return nullptr;
+        }
+    }
+
+    const char* shape_data = data + sizeof(header);
+    const char* entry_data = shape_data + shape_bytes;
+    const char* deviation_data = entry_data + entry_bytes;
+#ifdef SPEED_PROFILE_MMAP
+    store->shapes = reinterpret_cast<const float*>(shape_data);
+    store->entries = reinterpret_cast<const EdgeEntry*>(entry_data);
+    store->deviations = reinterpret_cast<const uint8_t*>(deviation_data);
+#else
+    store->owned_shapes.resize(header.shape_count * kSlotsPerDay);
+    store->owned_entries.resize(header.edge_count);
+    store->owned_deviations.resize(header.deviation_count * kSlotsPerDay);
+    std::memcpy(store->owned_shapes.data(), shape_data, shape_bytes);
+    std::memcpy(store->owned_entries.data(), entry_data, entry_bytes);
+    std::memcpy(store->owned_deviations.data(), deviation_data, store->owned_deviations.size());
+    store->shapes = store->owned_shapes.data();
+    store->entries = store->owned_entries.data();
+    store->deviations = store->owned_deviations.data();
+#endif
+    store->shape_count = header.shape_count;
+    store->edge_count = header.edge_count;
+    store->deviation_count = header.deviation_count;
+    return store;
+}
@@ -0,0 +1,104 @@
+#ifndef SPEED_PROFILE_H
+#define SPEED_PROFILE_H
+
+#include "graph.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ProbeIngestor;
+
+// Historical speed profiles: for every edge and fifteen-minute slot, the
+// fraction of the speed limit that traffic actually achieves.
+//
+// Profiles are stored as a shape times a scale times a per-slot deviation.
+// Shapes (96 floats) are deduplicated into a shared dictionary, so all edges
+// following the same daily pattern (e.g. every motorway under the rush-hour
+// model) share one; shape 0 is always flat. Each edge keeps a 16-bit shape
+// index, an 8-bit log-quantized scale (~2% resolution) and the index of a
+// row of 96 int8 deviations (1/32 octave steps, about +-16x). Row 0 is all
+// zeros and shared by every edge that matches its shape exactly, so only
+// edges with learned corrections pay the 96 bytes.
+//
+// A lookup is three array reads and two multiplies. Saved stores are read
+// back with mmap, so large networks load instantly and share pages across
+// processes.
+class SpeedProfileStore {
+public:
+    SpeedProfileStore();
+    ~SpeedProfileStore();
+    SpeedProfileStore(SpeedProfileStore&&) noexcept;
+    SpeedProfileStore& operator=(SpeedProfileStore&&) noexcept;
+
+    // The hardcoded rush-hour model from Graph, one shape per road type
+    static SpeedProfileStore fromRushHourModel(const Graph& graph);
+
+    // Rush-hour model corrected by learned per-slot ratios for every edge
+    // with at least min_observations probes
+    static SpeedProfileStore fromProbes(const Graph& graph, const ProbeIngestor& ingestor,
+                                        size_t min_observations = 50);
+
+    bool save(const std::string& filename) const;
+    static std::unique_ptr<SpeedProfileStore> load(const std::string& filename);
+
+    float factor(size_t edge_id, int slot) const {
+        const EdgeEntry& entry = entries[edge_id];
+        return shapes[(size_t)entry.shape * kSlotsPerDay + slot] * scale_table[entry.scale] *
+               deviation_table[deviations[(size_t)entry.deviation * kSlotsPerDay + slot]];
+    }
+
+    // Over the hour starting at first_slot: the speed that gives the mean
+    // travel time of its slots (harmonic mean), so no slot is skipped
+    float hourFactor(size_t edge_id, int first_slot) const {
+        constexpr int kSlotsPerHour = kSlotsPerDay / 24;
+        float pace = 0.0f;
+        for (int slot = first_slot; slot < first_slot + kSlotsPerHour; slot++) {
+            pace += 1.0f / factor(edge_id, slot);
+        }
+        return kSlotsPerHour / pace;
+    }
+
+    size_t edgeCount() const { return edge_count; }
+    size_t shapeCount() const { return shape_count; }
+    size_t deviationCount() const { return deviation_count > 0 ? deviation_count - 1 : 0; }   // edges with own corrections
+    size_t memoryBytes() const;
+
+private:
+    struct EdgeEntry {
+        uint16_t shape;
+        uint8_t scale;     // 127 = 1.0, one step = 1/32 octave
+        uint8_t reserved;
+        uint32_t deviation;   // row in the deviation table, 0 = none
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t slots;
+        uint32_t shape_count;
+        uint64_t edge_count;
+        uint64_t deviation_count;
+    };
+
+    // Either owned buffers (built in memory) or a read-only file mapping
+    std::vector<float> owned_shapes;
+    std::vector<EdgeEntry> owned_entries;
+    std::vector<uint8_t> owned_deviations;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+
+    const float* shapes = nullptr;
+    const EdgeEntry* entries = nullptr;
+    const uint8_t* deviations = nullptr;   // int8 steps stored as uint8 table indices
+    size_t shape_count = 0;
+    size_t edge_count = 0;
+    size_t deviation_count = 0;
+
+    static float scale_table[256];
+    static float deviation_table[256];
+
+    class Builder;
+    void release();
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "stochastic_router.h"
+#include "counter_rng.h"
+#include "geo.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+StochasticRouter::StochasticRouter(const Graph& graph, StochasticRouteOptions options)
+    : graph(graph), options(options) {
+    edge_sigma.resize(graph.edgeCount());
+    for (size_t id = 0; id < edge_sigma.size(); id++) {
+        edge_sigma[id] = roadTypeSigma(graph.getEdge(id)->segment->road_type);
+    }
+}
+
+double StochasticRouter::roadTypeSigma(const std::string& road_type) {
+    if (road_type == "motorway" || road_type == "motorway_link") return 0.35;
+    if (road_type == "trunk" || road_type == "trunk_link") return 0.30;
+    if (road_type == "primary") return 0.25;
+    if (road_type == "secondary") return 0.20;
+    if (road_type == "tertiary") return 0.16;
+    if (road_type == "residential" || road_type == "living_street") return 0.10;
+    return 0.15;
+}
+
+double StochasticRouter::sampleFactor(int sample, size_t edge_id) const {
+    // Box-Muller on the two 32-bit halves of one counter-based draw
+    uint64_t bits = counterRandom(options.seed, (uint64_t)sample, edge_id);
+    double u1 = ((bits >> 32) + 1.0) * (1.0 / 4294967297.0);
+    double u2 = (bits & 0xFFFFFFFF) * (1.0 / 4294967296.0);
+    double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+    double sigma = edge_sigma[edge_id];
+    return std::exp(sigma * z - 0.5 * sigma * sigma);
+}
+
+StochasticResult StochasticRouter::route(long long start_id, long long end_id, int hour_of_day) const {
+    StochasticResult result;
+    result.percentile = options.percentile;
+    result.samples = std::max(options.samples, 1);
+    const int samples = result.samples;
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+
+    // Mean edge times for this hour, computed once and shared by every sample
+    std::vector<double> mean_time(graph.edgeCount());
+    {
+        auto metric = graph.currentMetric();
+        parallelFor(mean_time.size(), [&](size_t begin, size_t end, unsigned) {
+            for (size_t id = begin; id < end; id++) {
+                mean_time[id] = graph.learnedTravelTime(*graph.getEdge(id), hour_of_day, *metric);
+            }
+        }, num_threads);
+    }
+
+    // Route the mean metric (index samples) and every sample; one workspace per worker
+    std::vector<SearchWorkspace> workspaces(num_threads);
+    std::vector<std::vector<size_t>> sample_paths(samples + 1);
+    RoadClassFilter filter{options.avoided_classes};
+    parallelForEach(samples + 1, [&](size_t s, unsigned worker) {
+        if ((int)s == samples) {
+            graph.shortestPath(start_id, end_id, workspaces[worker], [&](const Edge& edge) {
+                return mean_time[edge.id];
+            }, sample_paths[s], filter);
+            return;
+        }
+        graph.shortestPath(start_id, end_id, workspaces[worker], [&](const Edge& edge) {
+            return mean_time[edge.id] * sampleFactor((int)s, edge.id);
+        }, sample_paths[s], filter);
+    }, num_threads);
+
+    if (sample_paths[samples].empty()) {
+        return result;   // unreachable (or start == end)
+    }
+
+    // Distinct routes become candidates
+    std::map<std::vector<size_t>, size_t> candidate_of;
+    std::vector<const std::vector<size_t>*> candidate_paths;
+    std::vector<int> optimal_counts;
+    for (int s = samples; s >= 0; s--) {   // mean route first
+        const auto& path = sample_paths[s];
+        if (path.empty()) {
+            continue;
+        }
+        auto inserted = candidate_of.emplace(path, candidate_paths.size());
+        if (inserted.second) {
+            candidate_paths.push_back(&path);
+            optimal_counts.push_back(0);
+        }
+        if (s < samples) {
+            optimal_counts[inserted.first->second]++;
+        }
+    }
+    size_t candidate_count = candidate_paths.size();
+
+    // Score every candidate under every sample
+    std::vector<double> times(candidate_count * samples);
+    parallelFor(candidate_count * samples, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; i++) {
+            int sample = (int)(i % samples);
+            double total = 0.0;
+            for (size_t edge_id : *candidate_paths[i / samples]) {
+                total += mean_time[edge_id] * sampleFactor(sample, edge_id);
+            }
+            times[i] = total;
+        }
+    }, num_threads);
+
+    size_t rank = (size_t)std::ceil(options.percentile * samples);
+    rank = std::min(std::max<size_t>(rank, 1), (size_t)samples) - 1;
+
+    for (size_t c = 0; c < candidate_count; c++) {
+        ReliableRoute candidate;
+        const std::vector<size_t>& path = *candidate_paths[c];
+        RouteResult& route = candidate.route;
+        route.mode = RouteMode::LEARNED;
+        route.mode_name = "Reliable (stochastic)";
+        route.edge_path = path;
+        route.path = graph.pathNodes(start_id, path);
+        route.total_distance = 0.0;
+        route.estimated_time = 0.0;
+        for (size_t edge_id : path) {
+            route.total_distance += graph.getEdge(edge_id)->segment->distance;
+            route.estimated_time += mean_time[edge_id];
+        }
+
+        std::vector<double> sorted(times.begin() + c * samples, times.begin() + (c + 1) * samples);
+        double sum = 0.0;
+        for (double t : sorted) {
+            sum += t;
+        }
+        candidate.mean_time_s = sum / samples;
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        candidate.percentile_time_s = sorted[rank];
+        candidate.times_optimal = optimal_counts[c];
+        result.candidates.push_back(std::move(candidate));
+    }
+
+    std::sort(result.candidates.begin(), result.candidates.end(),
+              [](const ReliableRoute& a, const ReliableRoute& b) {
+                  if (a.percentile_time_s != b.percentile_time_s) {
+                      return a.percentile_time_s < b.percentile_time_s;
+                  }
+                  return a.mean_time_s < b.mean_time_s;
+              });
+    result.most_reliable = 0;
+    return result;
+}
@@ -0,0 +1,62 @@
+#ifndef STOCHASTIC_ROUTER_H
+#define STOCHASTIC_ROUTER_H
+
+#include "graph.h"
+#include <cstdint>
+#include <vector>
+
+struct StochasticRouteOptions {
+    int samples = 64;             // metric realizations routed per query
+    double percentile = 0.95;     // arrive on time with this probability
+    uint64_t seed = 42;
+    uint64_t avoided_classes = 0; // road-class mask, see Graph::avoidMask
+    unsigned threads = 0;         // 0 = all hardware threads
+};
+
+// A candidate route with its travel-time distribution over the samples
+struct ReliableRoute {
+    RouteResult route;            // estimated_time is the mean-metric ETA
+    double mean_time_s;
+    double percentile_time_s;
+    int times_optimal;            // samples in which this route was the fastest
+};
+
+struct StochasticResult {
+    std::vector<ReliableRoute> candidates;   // sorted by percentile ETA
+    int most_reliable = -1;                  // index into candidates, -1 if unreachable
+    double percentile = 0.0;
+    int samples = 0;
+};
+
+// Reliability-aware routing.
+//
+// The crowd multiplier gives each edge's mean speed; the router treats edge
+// travel time as lognormal around that mean, with a spread that depends on
+// road class (motorways are fast but incident-prone, residential streets
+// are slow but predictable). Each query routes many sampled metrics in
+// parallel, keeps every distinct route that was optimal in some sample, and
+// scores all candidates against all samples, so percentiles compare routes
+// on the same realizations of traffic.
+//
+// Sampled edge times are counter-based (seed, sample, edge), so they are
+// computed on demand during the search instead of materialized per sample,
+// and results do not depend on the thread count.
+class StochasticRouter {
+public:
+    StochasticRouter(const Graph& graph, StochasticRouteOptions options = {});
+
+    StochasticResult route(long long start_id, long long end_id, int hour_of_day) const;
+
+    // Spread (sigma of log travel time) assumed for a road class
+    static double roadTypeSigma(const std::string& road_type);
+
+private:
+    const Graph& graph;
+    StochasticRouteOptions options;
+    std::vector<double> edge_sigma;   // by edge id
+
+    // Mean-one lognormal factor of an edge's travel time in one sample
+    double sampleFactor(int sample, size_t edge_id) const;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include "tour_optimizer.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+namespace {
+
+// Stands in for an unreachable leg so costs stay comparable
+const double kUnreachableCost = 1e7;
+
+double elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Schedule state after finishing the stop at some position
+struct ScheduleState {
+    double clock;      // departure time from the stop
+    double travel;
+    double lateness;
+};
+
+}  // namespace
+
+TourOptimizer::TourOptimizer(const Graph& graph, TourOptions options) : graph(graph), options(options) {}
+
+std::vector<double> TourOptimizer::buildMatrix(const std::vector<TourStop>& stops,
+                                               const MetricSnapshot& metric) const {
+    size_t n = stops.size();
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<long long> nodes(n);
+    for (size_t i = 0; i < n; i++) {
+        nodes[i] = stops[i].node;
+    }
+
+    std::vector<double> matrix(n * n);
+    std::vector<SearchWorkspace> workspaces(num_threads);
+    std::vector<std::vector<double>> rows(num_threads);
+    RoadClassFilter filter{options.avoided_classes};
+    parallelForEach(n, [&](size_t i, unsigned worker) {
+        graph.oneToMany(nodes[i], nodes, workspaces[worker], [&](const Edge& edge) {
+            return graph.learnedTravelTime(edge, options.hour_of_day, metric);
+        }, rows[worker], filter);
+        std::copy(rows[worker].begin(), rows[worker].end(), matrix.begin() + i * n);
+    }, num_threads);
+    return matrix;
+}
+
+double TourOptimizer::evaluate(const std::vector<size_t>& order, const std::vector<TourStop>& stops,
+                               const std::vector<double>& matrix, TourResult* schedule) const {
+    size_t n = stops.size();
+    double clock = stops[order[0]].service_s;
+    double travel = 0.0, lateness = 0.0;
+    if (schedule) {
+        schedule->arrival_s.assign(1, 0.0);
+    }
+    for (size_t k = 1; k < order.size(); k++) {
+        double leg = std::min(matrix[order[k - 1] * n + order[k]], kUnreachableCost);
+        const TourStop& stop = stops[order[k]];
+        travel += leg;
+        clock = std::max(clock + leg, stop.window_open_s);
+        lateness += std::max(0.0, clock - stop.window_close_s);
+        if (schedule) {
+            schedule->arrival_s.push_back(clock);
+        }
+        clock += stop.service_s;
+    }
+    if (options.return_to_start && order.size() > 1) {
+        double leg = std::min(matrix[order.back() * n + order[0]], kUnreachableCost);
+        travel += leg;
+        clock += leg;
+    }
+    if (schedule) {
+        schedule->travel_time_s = travel;
+        schedule->lateness_s = lateness;
+        schedule->finish_s = clock;
+    }
+    return travel + options.lateness_penalty * lateness;
+}
+
+void TourOptimizer::applyMove(const std::vector<size_t>& order, const Move& move, std::vector<size_t>& out) {
+    out = order;
+    if (move.type == 0) {
+        std::reverse(out.begin() + move.i, out.begin() + move.j + 1);
+        return;
+    }
+    // Move [i, i + length) to just after position j
+    int end = move.i + move.length;
+    if (move.j < move.i) {
+        std::rotate(out.begin() + move.j + 1, out.begin() + move.i, out.begin() + end);
+    } else {
+        std::rotate(out.begin() + move.i, out.begin() + end, out.begin() + move.j + 1);
+    }
+}
+
+TourResult TourOptimizer::optimize(const std::vector<TourStop>& stops) const {
+    TourResult result;
+    size_t n = stops.size();
+    if (n == 0) {
+        return result;
+    }
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    auto metric = graph.currentMetric();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> matrix = buildMatrix(stops, *metric);
+    result.matrix_seconds = elapsedSince(start);
+    start = std::chrono::steady_clock::now();
+
+    // Neighbor lists: the closest stops in either direction
+    size_t k = std::min<size_t>(std::max(options.neighbors, 1), n - 1);
+    std::vector<std::vector<size_t>> neighbors(n);
+    parallelFor(n, [&](size_t begin, size_t end, unsigned) {
+        std::vector<size_t> candidates;
+        for (size_t a = begin; a < end; a++) {
+            candidates.resize(n);
+            std::iota(candidates.begin(), candidates.end(), 0);
+            candidates.erase(candidates.begin() + a);
+            auto closeness = [&](size_t b) { return std::min(matrix[a * n + b], matrix[b * n + a]); };
+            std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end(),
+                              [&](size_t x, size_t y) { return closeness(x) < closeness(y); });
+            neighbors[a].assign(candidates.begin(), candidates.begin() + k);
+        }
+    }, num_threads);
+
+    // Nearest-neighbor construction from the departure stop
+    std::vector<size_t> order{0};
+    std::vector<bool> visited(n, false);
+    visited[0] = true;
+    for (size_t step = 1; step < n; step++) {
+        size_t from = order.back(), best = n;
+        for (size_t b = 0; b < n; b++) {
+            if (!visited[b] && (best == n || matrix[from * n + b] < matrix[from * n + best])) {
+                best = b;
+            }
+        }
+        visited[best] = true;
+        order.push_back(best);
+    }
+
+    // Best-improvement local search; moves are scored in parallel from a
+    // shared prefix schedule so each evaluation only replays the changed tail
+    double current_cost = evaluate(order, stops, matrix);
+    std::vector<size_t> position(n);
+    std::vector<ScheduleState> prefix(n);
+    std::vector<std::vector<size_t>> buffers(num_threads);
+    std::vector<Move> best_moves(num_threads);
+
+    auto scoreTail = [&](const std::vector<size_t>& candidate, size_t first_changed, double bound) {
+        ScheduleState state = prefix[first_changed - 1];
+        double penalty = options.lateness_penalty;
+        for (size_t p = first_changed; p < n; p++) {
+            double leg = std::min(matrix[candidate[p - 1] * n + candidate[p]], kUnreachableCost);
+            const TourStop& stop = stops[candidate[p]];
+            state.travel += leg;
+            state.clock = std::max(state.clock + leg, stop.window_open_s);
+            state.lateness += std::max(0.0, state.clock - stop.window_close_s);
+            if (state.travel + penalty * state.lateness >= bound) {
+                return bound;   // can only get worse
+            }
+            state.clock += stop.service_s;
+        }
+        if (options.return_to_start) {
+            state.travel += std::min(matrix[candidate[n - 1] * n + candidate[0]], kUnreachableCost);
+        }
+        return state.travel + penalty * state.lateness;
+    };
+
+    while (n > 3 && result.moves_applied < options.max_moves) {
+        ScheduleState state{stops[order[0]].service_s, 0.0, 0.0};
+        prefix[0] = state;
+        position[order[0]] = 0;
+        for (size_t p = 1; p < n; p++) {
+            double leg = std::min(matrix[order[p - 1] * n + order[p]], kUnreachableCost);
+            state.travel += leg;
+            state.clock = std::max(state.clock + leg, stops[order[p]].window_open_s);
+            state.lateness += std::max(0.0, state.clock - stops[order[p]].window_close_s);
+            state.clock += stops[order[p]].service_s;
+            prefix[p] = state;
+            position[order[p]] = p;
+        }
+
+        parallelFor(n, [&](size_t begin, size_t end, unsigned worker) {
+            std::vector<size_t>& candidate = buffers[worker];
+            Move& best = best_moves[worker];
+            best = {-1, 0, 0, 0, current_cost};
+            auto consider = [&](const Move& move, size_t first_changed) {
+                applyMove(order, move, candidate);
+                double cost = scoreTail(candidate, first_changed, best.cost);
+                if (cost < best.cost - 1e-9) {
+                    best = move;
+                    best.cost = cost;
+                }
+            };
+
+            for (size_t p = begin; p < end; p++) {
+                size_t a = order[p];
+                for (size_t b : neighbors[a]) {
+                    int q = (int)position[b];
+                    // 2-opt: make a -> b adjacent by reversing (p, q]
+                    if (q > (int)p + 1) {
+                        consider({0, (int)p + 1, q, 0, 0.0}, p + 1);
+                    }
+                    // Relocate / Or-opt: move the segment starting at a to just after b
+                    if (p == 0) {
+                        continue;
+                    }
+                    for (int length = 1; length <= 3 && p + length <= n; length++) {
+                        if (q >= (int)p - 1 && q < (int)p + length) {
+                            continue;
+                        }
+                        size_t first_changed = std::min<size_t>(p, q + 1);
+                        consider({1, (int)p, q, length, 0.0}, first_changed);
+                    }
+                }
+            }
+        }, num_threads);
+
+        Move best{-1, 0, 0, 0, current_cost};
+        for (const auto& move : best_moves) {
+            if (move.type >= 0 && move.cost < best.cost) {
+                best = move;
+            }
+        }
+        if (best.type < 0) {
+            break;
+        }
+        std::vector<size_t> next;
+        applyMove(order, best, next);
+        order.swap(next);
+        current_cost = best.cost;
+        result.moves_applied++;
+    }
+    result.optimize_seconds = elapsedSince(start);
+
+    result.order = order;
+    evaluate(order, stops, matrix, &result);
+
+    // Route each leg of the final order and stitch them together
+    std::vector<size_t> legs(order.begin(), order.end());
+    if (options.return_to_start && n > 1) {
+        legs.push_back(order[0]);
+    }
+    size_t leg_count = legs.size() > 0 ? legs.size() - 1 : 0;
+    std::vector<std::vector<size_t>> leg_paths(leg_count);
+    std::vector<bool> leg_found(leg_count, false);
+    std::vector<SearchWorkspace> workspaces(num_threads);
+    RoadClassFilter filter{options.avoided_classes};
+    parallelForEach(leg_count, [&](size_t l, unsigned worker) {
+        double cost = graph.shortestPath(stops[legs[l]].node, stops[legs[l + 1]].node, workspaces[worker],
+                                         [&](const Edge& edge) {
+            return graph.learnedTravelTime(edge, options.hour_of_day, *metric);
+        }, leg_paths[l], filter);
+        leg_found[l] = cost < std::numeric_limits<double>::infinity();
+    }, num_threads);
+
+    RouteResult& route = result.route;
+    route.mode = RouteMode::LEARNED;
+    route.mode_name = "Multi-stop tour";
+    route.total_distance = 0.0;
+    route.estimated_time = result.finish_s;
+    result.feasible = true;
+    for (size_t l = 0; l < leg_count; l++) {
+        result.feasible = result.feasible && leg_found[l];
+        route.edge_path.insert(route.edge_path.end(), leg_paths[l].begin(), leg_paths[l].end());
+    }
+    for (size_t edge_id : route.edge_path) {
+        route.total_distance += graph.getEdge(edge_id)->segment->distance;
+    }
+    route.path = graph.pathNodes(stops[order[0]].node, route.edge_path);
+    return result;
+}
@@ -0,0 +1,73 @@
+#ifndef TOUR_OPTIMIZER_H
+#define TOUR_OPTIMIZER_H
+
+#include "graph.h"
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// A stop to visit. Times are seconds after departure from the first stop.
+struct TourStop {
+    long long node;
+    double service_s = 0.0;                                         // time spent at the stop
+    double window_open_s = 0.0;                                     // arriving earlier means waiting
+    double window_close_s = std::numeric_limits<double>::infinity(); // arriving later is penalized
+};
+
+struct TourOptions {
+    int hour_of_day = 12;
+    bool return_to_start = false;
+    int neighbors = 10;              // candidate moves only towards each stop's nearest stops
+    double lateness_penalty = 10.0;  // cost per second of arriving after a window closes
+    int max_moves = 100000;
+    uint64_t avoided_classes = 0;    // road-class mask, see Graph::avoidMask
+    unsigned threads = 0;            // 0 = all hardware threads
+};
+
+struct TourResult {
+    std::vector<size_t> order;       // indices into the stops, starting with 0
+    std::vector<double> arrival_s;   // per position in order
+    double travel_time_s = 0.0;
+    double lateness_s = 0.0;
+    double finish_s = 0.0;           // end of the tour, including waits and service
+    RouteResult route;               // all legs stitched together
+    int moves_applied = 0;
+    double matrix_seconds = 0.0;
+    double optimize_seconds = 0.0;
+    bool feasible = false;           // every stop reachable
+};
+
+// Multi-stop route optimization (asymmetric TSP with time windows).
+//
+// 1. Travel-time matrix: one one-to-many search per stop, in parallel.
+// 2. Construction: nearest neighbor from the first stop.
+// 3. Local search: 2-opt, Or-opt (segments of 2-3 stops) and relocate,
+//    restricted to each stop's nearest neighbors. Every round evaluates all
+//    candidate moves in parallel and applies the best one.
+// 4. Each leg of the final order is routed and stitched into one RouteResult.
+//
+// Cost is travel time plus a penalty per second of lateness; the first stop
+// is the fixed departure point.
+class TourOptimizer {
+public:
+    TourOptimizer(const Graph& graph, TourOptions options = {});
+
+    TourResult optimize(const std::vector<TourStop>& stops) const;
+
+private:
+    struct Move {
+        int type;       // 0 = 2-opt, 1 = move segment
+        int i, j, length;
+        double cost;
+    };
+
+    const Graph& graph;
+    TourOptions options;
+
+    std::vector<double> buildMatrix(const std::vector<TourStop>& stops, const MetricSnapshot& metric) const;
+    double evaluate(const std::vector<size_t>& order, const std::vector<TourStop>& stops,
+                    const std::vector<double>& matrix, TourResult* schedule = nullptr) const;
+    static void applyMove(const std::vector<size_t>& order, const Move& move, std::vector<size_t>& out);
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "traffic_assignment.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+TrafficAssignment::TrafficAssignment(const Graph& graph, AssignmentOptions options)
+    : graph(graph), options(options) {}
+
+double TrafficAssignment::roadTypeCapacity(const std::string& road_type) {
+    if (road_type == "motorway") return 4000.0;
+    if (road_type == "trunk") return 3000.0;
+    if (road_type == "motorway_link" || road_type == "trunk_link") return 1500.0;
+    if (road_type == "primary" || road_type == "primary_link") return 1800.0;
+    if (road_type == "secondary") return 1200.0;
+    if (road_type == "tertiary") return 900.0;
+    if (road_type == "residential") return 500.0;
+    if (road_type == "living_street") return 200.0;
+    return 600.0;
+}
+
+void TrafficAssignment::loadAllOrNothing(const std::vector<OriginDemand>& demand,
+                                         const std::vector<double>& times, std::vector<double>& flows,
+                                         double& unassigned) const {
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<std::vector<double>> partial(num_threads, std::vector<double>(flows.size(), 0.0));
+    std::vector<std::vector<double>> costs(num_threads);
+    std::vector<double> lost(num_threads, 0.0);
+    std::vector<SearchWorkspace> workspaces(num_threads);
+
+    parallelForEach(demand.size(), [&](size_t o, unsigned worker) {
+        const OriginDemand& origin = demand[o];
+        SearchWorkspace& workspace = workspaces[worker];
+        std::vector<double>& acc = partial[worker];
+        graph.oneToMany(origin.origin, origin.destinations, workspace,
+                        [&](const Edge& edge) { return times[edge.id]; }, costs[worker]);
+
+        // The search leaves its shortest-path tree in the workspace
+        for (size_t d = 0; d < origin.destinations.size(); d++) {
+            uint32_t destination = origin.destination_indices[d];
+            if (!workspace.reached(destination)) {
+                lost[worker] += origin.volumes[d];
+                continue;
+            }
+            for (uint32_t node = destination; node != origin.origin_index;) {
+                size_t edge_id = workspace.parentEdge(node);
+                acc[edge_id] += origin.volumes[d];
+                node = graph.getEdgeSourceIndex(edge_id);
+            }
+        }
+    }, num_threads);
+
+    parallelFor(flows.size(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t id = begin; id < end; id++) {
+            double sum = 0.0;
+            for (unsigned w = 0; w < num_threads; w++) {
+                sum += partial[w][id];
+            }
+            flows[id] = sum;
+        }
+    }, num_threads);
+
+    unassigned = 0.0;
+    for (double v : lost) {
+        unassigned += v;
+    }
+}
+
+AssignmentResult TrafficAssignment::assign(const std::vector<OdDemand>& demand) const {
+    AssignmentResult result;
+    size_t edge_count = graph.edgeCount();
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+
+    // Group demand by origin
+    std::vector<OriginDemand> grouped;
+    {
+        std::unordered_map<long long, size_t> origin_slot;
+        for (const auto& od : demand) {
+            uint32_t origin_index, destination_index;
+            if (od.vehicles_per_hour <= 0.0 || od.origin == od.destination ||
+                !graph.getNodeIndex(od.origin, origin_index) ||
+                !graph.getNodeIndex(od.destination, destination_index)) {
+                result.unassigned_demand += std::max(od.vehicles_per_hour, 0.0);
+                continue;
+            }
+            auto it = origin_slot.emplace(od.origin, grouped.size()).first;
+            if (it->second == grouped.size()) {
+                grouped.push_back({od.origin, origin_index, {}, {}, {}});
+            }
+            OriginDemand& origin = grouped[it->second];
+            origin.destinations.push_back(od.destination);
+            origin.destination_indices.push_back(destination_index);
+            origin.volumes.push_back(od.vehicles_per_hour);
+        }
+    }
+    double rejected = result.unassigned_demand;
+
+    // Free-flow times and capacities (the hour's speed model, before crowd data)
+    std::vector<double> free_flow(edge_count), capacity(edge_count);
+    {
+        MetricSnapshot neutral{0, {}};
+        parallelFor(edge_count, [&](size_t begin, size_t end, unsigned) {
+            for (size_t id = begin; id < end; id++) {
+                const Edge& edge = *graph.getEdge(id);
+                free_flow[id] = graph.learnedTravelTime(edge, options.hour_of_day, neutral);
+                capacity[id] = roadTypeCapacity(edge.segment->road_type) * options.capacity_scale;
+            }
+        }, num_threads);
+    }
+
+    auto linkTime = [&](size_t id, double flow) {
+        return free_flow[id] * (1.0 + options.bpr_alpha * std::pow(flow / capacity[id], options.bpr_beta));
+    };
+
+    std::vector<double>& flows = result.flows;
+    std::vector<double>& times = result.travel_times;
+    flows.assign(edge_count, 0.0);
+    times = free_flow;
+    std::vector<double> target(edge_count, 0.0);
+    double unassigned = 0.0;
+
+    loadAllOrNothing(grouped, times, flows, unassigned);
+
+    for (int iteration = 0; iteration < options.max_iterations; iteration++) {
+        parallelFor(edge_count, [&](size_t begin, size_t end, unsigned) {
+            for (size_t id = begin; id < end; id++) {
+                times[id] = linkTime(id, flows[id]);
+            }
+        }, num_threads);
+
+        loadAllOrNothing(grouped, times, target, unassigned);
+
+        // Relative gap: how much shorter the all-or-nothing paths are than the current ones
+        double current_cost = 0.0, best_cost = 0.0;
+        for (size_t id = 0; id < edge_count; id++) {
+            current_cost += flows[id] * times[id];
+            best_cost += target[id] * times[id];
+        }
+        double gap = current_cost > 0.0 ? (current_cost - best_cost) / current_cost : 0.0;
+
+        AssignmentIteration stats{iteration, gap, 0.0, current_cost / 3600.0};
+        if (gap < options.gap_tolerance) {
+            result.iterations.push_back(stats);
+            result.converged = true;
+            break;
+        }
+
+        // Line search: the objective's derivative along the direction is
+        // monotone in the step, so bisect for its zero
+        auto derivative = [&](double step) {
+            double sum = 0.0;
+            for (size_t id = 0; id < edge_count; id++) {
+                double direction = target[id] - flows[id];
+                if (direction != 0.0) {
+                    sum += direction * linkTime(id, flows[id] + step * direction);
+                }
+            }
+            return sum;
+        };
+        double low = 0.0, high = 1.0;
+        if (derivative(1.0) <= 0.0) {
+            low = 1.0;
+        } else {
+            for (int b = 0; b < 30; b++) {
+                double mid = 0.5 * (low + high);
+                (derivative(mid) > 0.0 ? high : low) = mid;
+            }
+        }
+        stats.step = low;
+        for (size_t id = 0; id < edge_count; id++) {
+            flows[id] += low * (target[id] - flows[id]);
+        }
+        result.iterations.push_back(stats);
+    }
+
+    result.multipliers.resize(edge_count);
+    for (size_t id = 0; id < edge_count; id++) {
+        times[id] = linkTime(id, flows[id]);
+        result.multipliers[id] = std::max(free_flow[id] / times[id], options.min_multiplier);
+    }
+    result.unassigned_demand = rejected + unassigned;
+    return result;
+}
+
+std::vector<OdDemand> TrafficAssignment::loadDemandCSV(const std::string& filename) {
+    std::vector<OdDemand> demand;
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open demand file " << filename << std::endl;
+        return demand;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] < '0' || line[0] > '9') {
+            continue;
+        }
+        OdDemand od;
+        char comma;
+        std::istringstream fields(line);
+        if (fields >> od.origin >> comma >> od.destination >> comma >> od.vehicles_per_hour) {
+            demand.push_back(od);
+        }
+    }
+    return demand;
+}
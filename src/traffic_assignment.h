@@ -0,0 +1,81 @@
+#ifndef TRAFFIC_ASSIGNMENT_H
+#define TRAFFIC_ASSIGNMENT_H
+
+#include "graph.h"
+#include <string>
+#include <vector>
+
+// Vehicles per hour wanting to travel from origin to destination
+struct OdDemand {
+    long long origin;
+    long long destination;
+    double vehicles_per_hour;
+};
+
+struct AssignmentOptions {
+    int hour_of_day = 17;
+    int max_iterations = 30;
+    double gap_tolerance = 1e-2;   // stop when the relative gap falls below this
+    double bpr_alpha = 0.15;       // volume-delay: t = t0 * (1 + alpha * (v / c)^beta)
+    double bpr_beta = 4.0;
+    double capacity_scale = 1.0;   // scales the per-road-type capacities
+    double min_multiplier = 0.05;
+    unsigned threads = 0;          // 0 = all hardware threads
+};
+
+struct AssignmentIteration {
+    int iteration;
+    double relative_gap;
+    double step;                   // Frank-Wolfe step size
+    double total_vehicle_hours;
+};
+
+struct AssignmentResult {
+    std::vector<double> flows;          // vehicles per hour, by edge id
+    std::vector<double> travel_times;   // seconds at equilibrium, by edge id
+    std::vector<double> multipliers;    // equivalent crowd multipliers (free-flow time / loaded time)
+    std::vector<AssignmentIteration> iterations;
+    bool converged = false;
+    double unassigned_demand = 0.0;     // vehicles per hour with no path
+};
+
+// Static user-equilibrium traffic assignment by the Frank-Wolfe algorithm.
+//
+// Each iteration loads all demand all-or-nothing onto shortest paths under
+// the current link times, then moves flows towards that load by the step
+// that minimizes the Beckmann objective (bisection on its derivative).
+// Link times follow the BPR volume-delay function with capacities by road
+// type. Demand is grouped by origin and each origin's one-to-all tree is
+// built on its own worker with a thread-local flow accumulator, merged after
+// the load; each search stops once the origin's destinations are settled.
+// The result can be published as a metric snapshot.
+class TrafficAssignment {
+public:
+    TrafficAssignment(const Graph& graph, AssignmentOptions options = {});
+
+    AssignmentResult assign(const std::vector<OdDemand>& demand) const;
+
+    // CSV: origin,destination,vehicles_per_hour (header line skipped)
+    static std::vector<OdDemand> loadDemandCSV(const std::string& filename);
+
+    // Lane-hour capacity assumed for a road type (vehicles per hour)
+    static double roadTypeCapacity(const std::string& road_type);
+
+private:
+    const Graph& graph;
+    AssignmentOptions options;
+
+    // Demand leaving one origin
+    struct OriginDemand {
+        long long origin;
+        uint32_t origin_index;
+        std::vector<long long> destinations;
+        std::vector<uint32_t> destination_indices;
+        std::vector<double> volumes;
+    };
+
+    void loadAllOrNothing(const std::vector<OriginDemand>& demand, const std::vector<double>& times,
+                          std::vector<double>& flows, double& unassigned) const;
+};
+
+#endif
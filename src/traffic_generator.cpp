@@ -0,0 +1,111 @@
+#include "traffic_generator.h"
+#include "counter_rng.h"
+#include "geo.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Independent random streams per generator component
+enum Stream : uint64_t { CLUSTER_STREAM = 1, CORRIDOR_STREAM, NOISE_STREAM };
+
+double smoothstep(double t) {
+    return t * t * (3.0 - 2.0 * t);
+}
+
+}  // namespace
+
+TrafficGenerator::TrafficGenerator(Graph& graph, TrafficGeneratorOptions options)
+    : graph(graph), options(options) {
+    size_t edge_count = graph.edgeCount();
+    if (edge_count == 0) {
+        return;
+    }
+
+    // Local projection anchored at the first edge's source node
+    const Node* anchor = graph.getNode(graph.getEdgeSource(0));
+    origin_lat = anchor->lat;
+    origin_lon = anchor->lon;
+    meters_per_deg_lat = 6371000.0 * M_PI / 180.0;
+    meters_per_deg_lon = meters_per_deg_lat * std::cos(origin_lat * M_PI / 180.0);
+
+    // Hot spots sit on randomly drawn edges, so they always land on the network
+    for (int c = 0; c < options.clusters; c++) {
+        size_t edge_id = counterRandom(options.seed, CLUSTER_STREAM, c) % edge_count;
+        cluster_centers.push_back(edgeMidpoint(edge_id));
+    }
+
+    // Corridors: draw edges until enough distinct major ways are found
+    for (uint64_t draw = 0; (int)corridor_ways.size() < options.corridors && draw < 64 * edge_count; draw++) {
+        size_t edge_id = counterRandom(options.seed, CORRIDOR_STREAM, draw) % edge_count;
+        const std::string& type = graph.getEdge(edge_id)->segment->road_type;
+        long long way = graph.getEdgeOrigin(edge_id).way_id;
+        if (way != 0 && (type == "motorway" || type == "trunk" || type == "primary") &&
+            std::find(corridor_ways.begin(), corridor_ways.end(), way) == corridor_ways.end()) {
+            corridor_ways.push_back(way);
+        }
+        if (draw > 100000 && corridor_ways.empty()) {
+            break;   // no major roads in this extract
+        }
+    }
+}
+
+TrafficGenerator::Point TrafficGenerator::edgeMidpoint(size_t edge_id) const {
+    const Node* a = graph.getNode(graph.getEdgeSource(edge_id));
+    const Node* b = graph.getNode(graph.getEdge(edge_id)->to);
+    double lat = (a->lat + b->lat) / 2.0;
+    double lon = (a->lon + b->lon) / 2.0;
+    return {(lon - origin_lon) * meters_per_deg_lon, (lat - origin_lat) * meters_per_deg_lat};
+}
+
+// Bilinear value noise in [-1, 1]; lattice corners are counter-based randoms
+double TrafficGenerator::valueNoise(double x, double y) const {
+    double gx = x / options.noise_scale_m, gy = y / options.noise_scale_m;
+    double fx = std::floor(gx), fy = std::floor(gy);
+    long long ix = (long long)fx, iy = (long long)fy;
+
+    auto corner = [&](long long cx, long long cy) {
+        uint64_t cell = ((uint64_t)cx << 32) ^ (uint64_t)(cy & 0xFFFFFFFF);
+        return counterUniform(options.seed, NOISE_STREAM, cell) * 2.0 - 1.0;
+    };
+
+    double tx = smoothstep(gx - fx), ty = smoothstep(gy - fy);
+    double top = corner(ix, iy) * (1 - tx) + corner(ix + 1, iy) * tx;
+    double bottom = corner(ix, iy + 1) * (1 - tx) + corner(ix + 1, iy + 1) * tx;
+    return top * (1 - ty) + bottom * ty;
+}
+
+std::vector<double> TrafficGenerator::generate() const {
+    std::vector<double> multipliers(graph.edgeCount(), 1.0);
+    const double two_sigma_sq = 2.0 * options.cluster_radius_m * options.cluster_radius_m;
+
+    parallelFor(multipliers.size(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t id = begin; id < end; id++) {
+            Point p = edgeMidpoint(id);
+
+            // Overlapping hot spots combine like independent slowdowns
+            double free_flow = 1.0;
+            for (const Point& center : cluster_centers) {
+                double dx = p.x - center.x, dy = p.y - center.y;
+                free_flow *= 1.0 - std::exp(-(dx * dx + dy * dy) / two_sigma_sq);
+            }
+            double congestion = 1.0 - free_flow;
+
+            long long way = graph.getEdgeOrigin(id).way_id;
+            if (way != 0 && std::find(corridor_ways.begin(), corridor_ways.end(), way) != corridor_ways.end()) {
+                congestion = std::max(congestion, 0.8);
+            }
+
+            double multiplier = (1.0 - options.intensity * congestion) *
+                                std::exp(options.noise * valueNoise(p.x, p.y));
+            multipliers[id] = std::clamp(multiplier, options.min_multiplier, options.max_multiplier);
+        }
+    }, options.threads);
+
+    return multipliers;
+}
+
+uint64_t TrafficGenerator::apply() {
+    return graph.publishMetric(generate());
+}
@@ -0,0 +1,57 @@
+#ifndef TRAFFIC_GENERATOR_H
+#define TRAFFIC_GENERATOR_H
+
+#include "graph.h"
+#include <cstdint>
+#include <vector>
+
+struct TrafficGeneratorOptions {
+    uint64_t seed = 42;
+    double intensity = 0.5;           // 0 = free flow, 1 = gridlock at congestion centers
+    int clusters = 8;                 // circular congestion hot spots
+    double cluster_radius_m = 1500.0; // Gaussian falloff radius of a hot spot
+    int corridors = 4;                // whole major roads (motorway/trunk/primary ways) jammed end to end
+    double noise = 0.15;              // strength of the smooth background variation
+    double noise_scale_m = 800.0;     // spatial wavelength of that variation
+    double min_multiplier = 0.2;
+    double max_multiplier = 1.5;
+    unsigned threads = 0;             // 0 = all hardware threads
+};
+
+// Deterministic, spatially correlated synthetic traffic.
+//
+// Congestion comes from three sources: Gaussian hot spots centered on
+// random points of the network, corridors that slow a whole major road,
+// and smooth value noise on a lattice. Neighboring edges therefore see
+// similar traffic, like real queues do. All randomness is counter-based
+// (keyed by seed and cluster/corridor/lattice index), so the same seed
+// gives bit-identical multipliers for any thread count and graph size, and
+// edges are generated in parallel without coordination.
+class TrafficGenerator {
+public:
+    TrafficGenerator(Graph& graph, TrafficGeneratorOptions options = {});
+
+    std::vector<double> generate() const;
+
+    // Generate and publish on the graph as a new metric snapshot; returns its version
+    uint64_t apply();
+
+private:
+    struct Point {
+        double x, y;   // local planar meters
+    };
+
+    Graph& graph;
+    TrafficGeneratorOptions options;
+
+    double origin_lat = 0.0, origin_lon = 0.0;
+    double meters_per_deg_lat = 0.0, meters_per_deg_lon = 0.0;
+
+    std::vector<Point> cluster_centers;
+    std::vector<long long> corridor_ways;
+
+    Point edgeMidpoint(size_t edge_id) const;
+    double valueNoise(double x, double y) const;
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "trip_fitting.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+// One observed trip as a sparse row of the least-squares system
+struct TripRow {
+    bool routed = false;
+    double observed = 0.0;
+    double predicted = 0.0;
+    std::vector<std::pair<int, double>> entries;   // (parameter, seconds at scale 1)
+};
+
+}  // namespace
+
+TripFitter::TripFitter(Graph& graph, TripFitOptions options) : graph(graph), options(options) {
+    edge_param.resize(graph.edgeCount());
+    if (options.per_road_class) {
+        std::unordered_map<std::string, int> classes;
+        for (size_t id = 0; id < graph.edgeCount(); id++) {
+            auto it = classes.emplace(graph.getEdge(id)->segment->road_type, (int)classes.size()).first;
+            edge_param[id] = it->second;
+        }
+        param_count = classes.size();
+    } else {
+        for (size_t id = 0; id < graph.edgeCount(); id++) {
+            edge_param[id] = (int)id;
+        }
+        param_count = graph.edgeCount();
+    }
+}
+
+TripFitReport TripFitter::fit(const std::vector<Trip>& trips) {
+    TripFitReport report;
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+
+    // Prior: the scales implied by the snapshot we start from
+    std::vector<double> prior(param_count, 0.0);
+    {
+        auto metric = graph.currentMetric();
+        std::vector<int> members(param_count, 0);
+        for (size_t id = 0; id < edge_param.size(); id++) {
+            prior[edge_param[id]] += 1.0 / metric->crowdMultiplier(id);
+            members[edge_param[id]]++;
+        }
+        for (size_t p = 0; p < param_count; p++) {
+            prior[p] = members[p] > 0 ? prior[p] / members[p] : 1.0;
+        }
+    }
+    std::vector<double> x = prior;
+    const double x_min = 1.0 / options.max_multiplier;
+    const double x_max = 1.0 / options.min_multiplier;
+
+    std::vector<TripRow> rows(trips.size());
+    double previous_rmse = 0.0;
+
+    // The best snapshot evaluated so far, republished if a round makes things worse
+    double best_rmse = std::numeric_limits<double>::infinity();
+    std::vector<double> best_multipliers;
+
+    // CG scratch: A^T v is accumulated in per-worker buffers and summed afterwards
+    std::vector<std::vector<double>> partial(num_threads, std::vector<double>(param_count));
+
+    // One extra pass evaluates the last solution; it routes and checks but doesn't solve
+    for (int iteration = 0; iteration <= options.max_iterations; iteration++) {
+        // 1. Route every trip with the current multipliers
+        auto metric = graph.currentMetric();
+        parallelForEach(trips.size(), [&](size_t i, unsigned) {
+            const Trip& trip = trips[i];
+            TripRow& row = rows[i];
+            RouteResult route = graph.dijkstra(trip.origin, trip.destination, *metric,
+                                               RouteMode::LEARNED, trip.hour_of_day);
+            row.routed = !route.edge_path.empty() && trip.duration_s > 0.0;
+            row.observed = trip.duration_s;
+            row.predicted = route.estimated_time;
+            row.entries.clear();
+            if (!row.routed) {
+                return;
+            }
+            for (size_t edge_id : route.edge_path) {
+                const Edge& edge = *graph.getEdge(edge_id);
+                double speed = graph.getTimeAdjustedSpeed(edge, trip.hour_of_day) * 1000.0 / 3600.0;
+                row.entries.push_back({edge_param[edge_id], edge.segment->distance / speed});
+            }
+            // Merge repeated parameters so each row is a proper sparse vector
+            std::sort(row.entries.begin(), row.entries.end());
+            size_t kept = 0;
+            for (size_t k = 0; k < row.entries.size(); k++) {
+                if (kept > 0 && row.entries[kept - 1].first == row.entries[k].first) {
+                    row.entries[kept - 1].second += row.entries[k].second;
+                } else {
+                    row.entries[kept++] = row.entries[k];
+                }
+            }
+            row.entries.resize(kept);
+        }, num_threads);
+
+        TripFitIteration stats{iteration, 0, 0, 0.0, 0.0, 0.0};
+        double squared_error = 0.0, pct_error = 0.0;
+        for (const auto& row : rows) {
+            if (!row.routed) {
+                stats.unroutable++;
+                continue;
+            }
+            stats.routed++;
+            double error = row.predicted - row.observed;
+            squared_error += error * error;
+            pct_error += std::fabs(error) / row.observed;
+        }
+        if (stats.routed == 0) {
+            report.iterations.push_back(stats);
+            break;
+        }
+        stats.rmse_s = std::sqrt(squared_error / stats.routed);
+        stats.mean_abs_pct_error = pct_error / stats.routed;
+
+        if (stats.rmse_s < best_rmse) {
+            best_rmse = stats.rmse_s;
+            best_multipliers = metric->crowd_multipliers;
+            best_multipliers.resize(edge_param.size(), 1.0);
+        }
+        if (iteration > 0) {
+            double improvement = previous_rmse - stats.rmse_s;
+            if (improvement < 0.0) {
+                report.iterations.push_back(stats);
+                report.version = graph.publishMetric(best_multipliers);
+                report.regressed = true;
+                std::cout << "  Round " << iteration + 1 << ": RMSE rose to " << std::fixed << std::setprecision(1)
+                          << stats.rmse_s << " s, keeping the best fit (" << best_rmse << " s)\n";
+                break;
+            }
+            if (improvement < options.tolerance * previous_rmse) {
+                report.iterations.push_back(stats);
+                report.converged = true;
+                break;
+            }
+        }
+        previous_rmse = stats.rmse_s;
+        if (iteration == options.max_iterations) {
+            break;
+        }
+
+        // 2. Solve (A^T A + lambda I) x = A^T y + lambda x_prior by conjugate gradients
+        auto applyNormal = [&](const std::vector<double>& v, std::vector<double>& out, double lambda) {
+            parallelFor(rows.size(), [&](size_t begin, size_t end, unsigned worker) {
+                std::vector<double>& acc = partial[worker];
+                std::fill(acc.begin(), acc.end(), 0.0);
+                for (size_t i = begin; i < end; i++) {
+                    if (!rows[i].routed) {
+                        continue;
+                    }
+                    double dot = 0.0;
+                    for (const auto& entry : rows[i].entries) {
+                        dot += entry.second * v[entry.first];
+                    }
+                    for (const auto& entry : rows[i].entries) {
+                        acc[entry.first] += entry.second * dot;
+                    }
+                }
+            }, num_threads);
+            for (size_t p = 0; p < param_count; p++) {
+                double sum = lambda * v[p];
+                for (unsigned w = 0; w < num_threads; w++) {
+                    sum += partial[w][p];
+                }
+                out[p] = sum;
+            }
+        };
+
+        // Scale the regularization to the data so it means the same for any trip count
+        double diagonal = 0.0;
+        size_t used = 0;
+        {
+            std::vector<double> column_norms(param_count, 0.0);
+            for (const auto& row : rows) {
+                for (const auto& entry : row.entries) {
+                    column_norms[entry.first] += entry.second * entry.second;
+                }
+            }
+            for (double norm : column_norms) {
+                if (norm > 0.0) {
+                    diagonal += norm;
+                    used++;
+                }
+            }
+        }
+        double lambda = options.regularization * (used > 0 ? diagonal / used : 1.0);
+
+        std::vector<double> rhs(param_count, 0.0);
+        for (const auto& row : rows) {
+            if (!row.routed) {
+                continue;
+            }
+            for (const auto& entry : row.entries) {
+                rhs[entry.first] += entry.second * row.observed;
+            }
+        }
+        for (size_t p = 0; p < param_count; p++) {
+            rhs[p] += lambda * prior[p];
+        }
+
+        std::vector<double> solution = x, residual(param_count), direction(param_count), product(param_count);
+        applyNormal(solution, product, lambda);
+        for (size_t p = 0; p < param_count; p++) {
+            residual[p] = rhs[p] - product[p];
+        }
+        direction = residual;
+        double rr = 0.0;
+        for (double r : residual) {
+            rr += r * r;
+        }
+        double initial_rr = rr;
+
+        for (int step = 0; step < options.solver_iterations && rr > 1e-12 * initial_rr; step++) {
+            applyNormal(direction, product, lambda);
+            double dAd = 0.0;
+            for (size_t p = 0; p < param_count; p++) {
+                dAd += direction[p] * product[p];
+            }
+            if (dAd <= 0.0) {
+                break;
+            }
+            double alpha = rr / dAd;
+            double new_rr = 0.0;
+            for (size_t p = 0; p < param_count; p++) {
+                solution[p] += alpha * direction[p];
+                residual[p] -= alpha * product[p];
+                new_rr += residual[p] * residual[p];
+            }
+            double beta = new_rr / rr;
+            for (size_t p = 0; p < param_count; p++) {
+                direction[p] = residual[p] + beta * direction[p];
+            }
+            rr = new_rr;
+        }
+
+        // 3. Publish the clamped solution as multipliers
+        for (size_t p = 0; p < param_count; p++) {
+            double clamped = std::clamp(solution[p], x_min, x_max);
+            stats.max_multiplier_change = std::max(stats.max_multiplier_change,
+                                                   std::fabs(1.0 / clamped - 1.0 / x[p]));
+            x[p] = clamped;
+        }
+        std::vector<double> multipliers(edge_param.size());
+        for (size_t id = 0; id < edge_param.size(); id++) {
+            multipliers[id] = 1.0 / x[edge_param[id]];
+        }
+        report.version = graph.publishMetric(std::move(multipliers));
+        report.iterations.push_back(stats);
+
+        std::cout << "  Round " << iteration + 1 << ": RMSE " << std::fixed << std::setprecision(1)
+                  << stats.rmse_s << " s, MAPE " << std::setprecision(1)
+                  << stats.mean_abs_pct_error * 100.0 << "%, max change "
+                  << std::setprecision(3) << stats.max_multiplier_change << "\n";
+    }
+
+    return report;
+}
+
+std::vector<Trip> TripFitter::loadTripsCSV(const std::string& filename) {
+    std::vector<Trip> trips;
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open trip file " << filename << std::endl;
+        return trips;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] < '0' || line[0] > '9') {
+            continue;
+        }
+        Trip trip;
+        char comma;
+        std::istringstream fields(line);
+        if (fields >> trip.origin >> comma >> trip.destination >> comma >> trip.hour_of_day >> comma
+                   >> trip.duration_s) {
+            trips.push_back(trip);
+        }
+    }
+    return trips;
+}
@@ -0,0 +1,71 @@
+#ifndef TRIP_FITTING_H
+#define TRIP_FITTING_H
+
+#include "graph.h"
+#include <string>
+#include <vector>
+
+// A completed trip: where it went, when, and how long it took
+struct Trip {
+    long long origin;
+    long long destination;
+    int hour_of_day;
+    double duration_s;
+};
+
+struct TripFitOptions {
+    bool per_road_class = false;   // one multiplier per road type instead of per edge
+    int max_iterations = 10;       // routing / solve rounds
+    int solver_iterations = 50;    // conjugate-gradient steps per round
+    double regularization = 0.1;   // pull towards the prior, relative to the data term
+    double tolerance = 1e-3;       // stop when RMSE improves by less than this fraction
+    double min_multiplier = 0.2;
+    double max_multiplier = 2.0;
+    unsigned threads = 0;          // 0 = all hardware threads
+};
+
+struct TripFitIteration {
+    int iteration;
+    size_t routed;
+    size_t unroutable;
+    double rmse_s;                 // predicted vs. observed trip time, before this round's update
+    double mean_abs_pct_error;
+    double max_multiplier_change;
+};
+
+struct TripFitReport {
+    std::vector<TripFitIteration> iterations;
+    bool converged = false;        // RMSE stopped improving (by less than the tolerance)
+    bool regressed = false;        // a round made RMSE worse; the best earlier fit was republished
+    uint64_t version = 0;          // published metric snapshot
+};
+
+// Fits crowd multipliers so routed trip times reproduce observed durations
+// (inverse routing).
+//
+// Each round routes every trip in parallel with the current snapshot
+// (LEARNED mode), then solves a sparse regularized least-squares problem
+// for per-parameter travel-time scales x = 1 / multiplier:
+//
+//     min  sum_i (duration_i - sum_e t0_e(hour_i) * x_p(e))^2 + lambda * |x - x_prior|^2
+//
+// where t0_e is the edge's time before crowd data. The solution is published
+// as a new metric snapshot and the next round reroutes with it.
+class TripFitter {
+public:
+    TripFitter(Graph& graph, TripFitOptions options = {});
+
+    TripFitReport fit(const std::vector<Trip>& trips);
+
+    // CSV: origin,destination,hour_of_day,duration_s (header line skipped)
+    static std::vector<Trip> loadTripsCSV(const std::string& filename);
+
+private:
+    Graph& graph;
+    TripFitOptions options;
+
+    std::vector<int> edge_param;   // edge id -> parameter index
+    size_t param_count = 0;
+};
+
+#endif
@@ -0,0 +1,255 @@
+#include "turn_router.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+const double kInf = std::numeric_limits<double>::infinity();
+
+}  // namespace
+
+TurnRouter::TurnRouter(const Graph& graph, TurnCostOptions options) : graph(graph), options(options) {
+    size_t edge_count = graph.edgeCount();
+    bearings.resize(edge_count);
+    restricted_from.assign(edge_count, 0);
+    for (size_t id = 0; id < edge_count; id++) {
+        const Node* a = graph.getNode(graph.getEdgeSource(id));
+        const Node* b = graph.getNode(graph.getEdge(id)->to);
+        double dy = b->lat - a->lat;
+        double dx = (b->lon - a->lon) * std::cos(a->lat * M_PI / 180.0);
+        bearings[id] = (float)(std::atan2(dx, dy) * 180.0 / M_PI);
+    }
+
+    // Resolve restrictions to edge pairs at the via node
+    const auto& restrictions = graph.getTurnRestrictions();
+    if (restrictions.empty()) {
+        return;
+    }
+    std::unordered_map<long long, std::vector<size_t>> way_edges;
+    for (const auto& restriction : restrictions) {
+        way_edges[restriction.from_way];
+        way_edges[restriction.to_way];
+    }
+    for (size_t id = 0; id < edge_count; id++) {
+        auto it = way_edges.find(graph.getEdgeOrigin(id).way_id);
+        if (it != way_edges.end()) {
+            it->second.push_back(id);
+        }
+    }
+
+    for (const auto& restriction : restrictions) {
+        uint32_t via;
+        if (!graph.getNodeIndex(restriction.via_node, via)) {
+            unresolved++;
+            continue;
+        }
+        std::vector<size_t> from_edges, to_edges;
+        for (size_t id : way_edges[restriction.from_way]) {
+            if (graph.getEdge(id)->to_index == via) {
+                from_edges.push_back(id);
+            }
+        }
+        for (size_t id : way_edges[restriction.to_way]) {
+            if (graph.getEdgeSourceIndex(id) == via) {
+                to_edges.push_back(id);
+            }
+        }
+        if (from_edges.empty() || to_edges.empty()) {
+            unresolved++;
+            continue;
+        }
+
+        for (size_t from : from_edges) {
+            if (restriction.only) {
+                for (const auto& exit : *graph.getEdgesByIndex(via)) {
+                    if (std::find(to_edges.begin(), to_edges.end(), exit.id) == to_edges.end()) {
+                        banned.insert(turnKey(from, exit.id));
+                    }
+                }
+            } else {
+                for (size_t to : to_edges) {
+                    banned.insert(turnKey(from, to));
+                }
+            }
+            restricted_from[from] = 1;
+        }
+    }
+}
+
+TurnClass TurnRouter::classify(size_t from_edge, const Edge& to) const {
+    if (to.to_index == graph.getEdgeSourceIndex(from_edge)) {
+        return TurnClass::U_TURN;
+    }
+    double angle = bearings[to.id] - bearings[from_edge];
+    if (angle > 180.0) {
+        angle -= 360.0;
+    } else if (angle <= -180.0) {
+        angle += 360.0;
+    }
+    double magnitude = std::fabs(angle);
+    if (magnitude < 20.0) {
+        return TurnClass::STRAIGHT;
+    }
+    if (magnitude > 170.0) {
+        return TurnClass::U_TURN;
+    }
+    bool right = angle > 0.0;   // bearings grow clockwise
+    if (magnitude < 60.0) {
+        return right ? TurnClass::SLIGHT_RIGHT : TurnClass::SLIGHT_LEFT;
+    }
+    if (magnitude < 120.0) {
+        return right ? TurnClass::RIGHT : TurnClass::LEFT;
+    }
+    return right ? TurnClass::SHARP_RIGHT : TurnClass::SHARP_LEFT;
+}
+
+// Exits at the head of from_edge other than straight back
+size_t TurnRouter::exitCount(size_t from_edge) const {
+    uint32_t via = graph.getEdge(from_edge)->to_index;
+    uint32_t back = graph.getEdgeSourceIndex(from_edge);
+    const auto* edges = graph.getEdgesByIndex(via);
+    if (!edges) {
+        return 0;
+    }
+    size_t exits = 0;
+    for (const auto& edge : *edges) {
+        exits += edge.to_index != back;
+    }
+    return exits;
+}
+
+double TurnRouter::turnPenalty(size_t from_edge, uint32_t from_node, const Edge& to, size_t exits) const {
+    if (restricted_from[from_edge] && banned.count(turnKey(from_edge, to.id))) {
+        return kInf;
+    }
+    TurnClass turn = to.to_index == from_node ? TurnClass::U_TURN : classify(from_edge, to);
+    if (turn == TurnClass::U_TURN) {
+        return (exits == 0 || options.allow_u_turns) ? options.u_turn_s : kInf;
+    }
+    if (exits <= 1) {
+        return 0.0;   // the road just bends
+    }
+    if (options.left_hand_traffic) {
+        switch (turn) {
+            case TurnClass::SLIGHT_RIGHT: turn = TurnClass::SLIGHT_LEFT; break;
+            case TurnClass::RIGHT: turn = TurnClass::LEFT; break;
+            case TurnClass::SHARP_RIGHT: turn = TurnClass::SHARP_LEFT; break;
+            case TurnClass::SLIGHT_LEFT: turn = TurnClass::SLIGHT_RIGHT; break;
+            case TurnClass::LEFT: turn = TurnClass::RIGHT; break;
+            case TurnClass::SHARP_LEFT: turn = TurnClass::SHARP_RIGHT; break;
+            default: break;
+        }
+    }
+    switch (turn) {
+        case TurnClass::SLIGHT_RIGHT:
+        case TurnClass::SLIGHT_LEFT: return options.slight_s;
+        case TurnClass::RIGHT: return options.right_s;
+        case TurnClass::SHARP_RIGHT: return options.sharp_right_s;
+        case TurnClass::LEFT: return options.left_s;
+        case TurnClass::SHARP_LEFT: return options.sharp_left_s;
+        default: return 0.0;
+    }
+}
+
+double TurnRouter::turnCost(size_t from_edge, const Edge& to) const {
+    return turnPenalty(from_edge, graph.getEdgeSourceIndex(from_edge), to, exitCount(from_edge));
+}
+
+TurnRouteResult TurnRouter::route(long long start_id, long long end_id, SearchWorkspace& workspace,
+                                  const MetricSnapshot& metric, RouteMode mode, int hour_of_day,
+                                  uint64_t avoided_classes) const {
+    TurnRouteResult result;
+    result.cost = kInf;
+    uint32_t source, target;
+    if (!graph.getNodeIndex(start_id, source) || !graph.getNodeIndex(end_id, target)) {
+        return result;
+    }
+    if (source == target) {
+        result.cost = 0.0;
+        result.path.push_back(start_id);
+        return result;
+    }
+
+    // Distance routing honors restrictions but adds no seconds
+    const double penalty_scale = mode == RouteMode::DISTANCE ? 0.0 : 1.0;
+    const bool check_closures = graph.closedEdgeCount() > 0;
+    auto usable = [&](const Edge& edge) {
+        return !((avoided_classes >> edge.road_class) & 1) && !(check_closures && graph.isEdgeClosed(edge.id));
+    };
+
+    // States are edge ids; a state's parent is the edge driven before it
+    workspace.begin(graph.edgeCount());
+    const auto* first = graph.getEdgesByIndex(source);
+    if (!first) {
+        return result;
+    }
+    for (const auto& edge : *first) {
+        if (usable(edge)) {
+            double cost = graph.edgeWeight(edge, mode, hour_of_day, metric);
+            if (cost < workspace.distance(edge.id)) {
+                workspace.update(edge.id, cost, SearchWorkspace::kNoEdge);
+                workspace.push(cost, edge.id);
+            }
+        }
+    }
+
+    size_t last = SearchWorkspace::kNoEdge;
+    while (!workspace.empty()) {
+        auto [current_dist, state] = workspace.pop();
+        if (current_dist > workspace.distance(state)) {
+            continue;
+        }
+        result.settled++;
+        const Edge& in = *graph.getEdge(state);
+        if (in.to_index == target) {
+            last = state;
+            break;
+        }
+        const auto* edges = graph.getEdgesByIndex(in.to_index);
+        if (!edges) {
+            continue;
+        }
+        uint32_t from_node = graph.getEdgeSourceIndex(state);
+        size_t exits = 0;
+        for (const auto& edge : *edges) {
+            exits += edge.to_index != from_node;
+        }
+        for (const auto& edge : *edges) {
+            if (!usable(edge)) {
+                continue;
+            }
+            double turn = turnPenalty(state, from_node, edge, exits);
+            if (turn == kInf) {
+                continue;
+            }
+            double new_dist = current_dist + graph.edgeWeight(edge, mode, hour_of_day, metric) + penalty_scale * turn;
+            if (new_dist < workspace.distance(edge.id)) {
+                workspace.update(edge.id, new_dist, state);
+                workspace.push(new_dist, edge.id);
+            }
+        }
+    }
+    if (last == SearchWorkspace::kNoEdge) {
+        return result;
+    }
+
+    for (size_t edge_id = last; edge_id != SearchWorkspace::kNoEdge; edge_id = workspace.parentEdge(edge_id)) {
+        result.edge_path.push_back(edge_id);
+    }
+    std::reverse(result.edge_path.begin(), result.edge_path.end());
+    result.path = graph.pathNodes(start_id, result.edge_path);
+    result.cost = workspace.distance(last);
+    for (size_t i = 1; i < result.edge_path.size(); i++) {
+        double turn = penalty_scale * turnCost(result.edge_path[i - 1], *graph.getEdge(result.edge_path[i]));
+        result.turn_penalty_s += turn;
+        result.turns += turn > 0.0;
+    }
+    return result;
+}
+
+size_t TurnRouter::memoryBytes() const {
+    return bearings.capacity() * sizeof(float) + restricted_from.capacity() +
+           banned.size() * (sizeof(uint64_t) + 2 * sizeof(void*)) + banned.bucket_count() * sizeof(void*);
+}
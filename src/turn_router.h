@@ -0,0 +1,83 @@
+#ifndef TURN_ROUTER_H
+#define TURN_ROUTER_H
+
+#include "graph.h"
+#include <unordered_set>
+#include <vector>
+
+// Turns by the angle between the incoming and outgoing road
+enum class TurnClass : uint8_t {
+    STRAIGHT,       // under 20 degrees
+    SLIGHT_RIGHT,   // under 60
+    RIGHT,          // under 120
+    SHARP_RIGHT,
+    SLIGHT_LEFT,
+    LEFT,
+    SHARP_LEFT,
+    U_TURN          // back onto the road just driven, or over 170 degrees
+};
+
+struct TurnCostOptions {
+    // Seconds added per turn (right-hand traffic: lefts cross oncoming traffic)
+    double slight_s = 1.0;
+    double right_s = 4.0;
+    double sharp_right_s = 8.0;
+    double left_s = 10.0;
+    double sharp_left_s = 15.0;
+    double u_turn_s = 40.0;
+    bool allow_u_turns = false;       // dead ends always allow one
+    bool left_hand_traffic = false;   // mirror left and right costs
+};
+
+struct TurnRouteResult {
+    std::vector<long long> path;
+    std::vector<size_t> edge_path;
+    double cost = 0.0;                // mode weight plus turn penalties; infinity if unreachable
+    double turn_penalty_s = 0.0;      // share of cost that comes from turns
+    size_t turns = 0;                 // penalized turns on the route
+    size_t settled = 0;               // search states (edges) settled
+};
+
+// Turn-aware routing on edge-based states without an expanded graph.
+//
+// A search state is "arrived at the end of edge e", so the state space is
+// the edge ids the graph already has; transitions are generated on the fly
+// from the head node's adjacency list. A turn's cost comes from the bearing
+// change between the two edges (one float per edge, cached) and is waived
+// where the road merely bends with no other exit. Restriction relations are
+// resolved once to forbidden (from edge, to edge) pairs with a per-edge flag,
+// so edges with no restriction never touch the hash set. Memory beyond the
+// plain graph is a few bytes per edge instead of one expanded edge per turn.
+class TurnRouter {
+public:
+    TurnRouter(const Graph& graph, TurnCostOptions options = {});
+
+    TurnRouteResult route(long long start_id, long long end_id, SearchWorkspace& workspace,
+                          const MetricSnapshot& metric, RouteMode mode, int hour_of_day,
+                          uint64_t avoided_classes = 0) const;
+
+    TurnClass classify(size_t from_edge, const Edge& to) const;
+
+    // Penalty in seconds for turning from from_edge onto to; infinity if forbidden
+    double turnCost(size_t from_edge, const Edge& to) const;
+
+    size_t restrictedTurns() const { return banned.size(); }
+    size_t unresolvedRestrictions() const { return unresolved; }
+    size_t memoryBytes() const;
+
+private:
+    const Graph& graph;
+    TurnCostOptions options;
+
+    std::vector<float> bearings;              // by edge id, degrees clockwise from north
+    std::vector<uint8_t> restricted_from;     // by edge id: any banned turn starts here
+    std::unordered_set<uint64_t> banned;      // (from edge << 32) | to edge
+    size_t unresolved = 0;
+
+    double turnPenalty(size_t from_edge, uint32_t from_node, const Edge& to, size_t exits) const;
+    size_t exitCount(size_t from_edge) const;
+
+    static uint64_t turnKey(size_t from_edge, size_t to_edge) { return ((uint64_t)from_edge << 32) | to_edge; }
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "vehicle_profile.h"
+#include "parallel.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+double VehicleProfile::speedFor(const std::string& road_type) const {
+    auto it = speeds_kmh.find(road_type);
+    return it != speeds_kmh.end() ? it->second : default_speed_kmh;
+}
+
+// Same speeds as Graph::defaultSpeedLimit, so the car profile matches SPEED_LIMIT
+// routing, except that footways, paths, cycleways, pedestrian streets and steps
+// are closed to it (0) where defaultSpeedLimit gives them the 50 km/h fallback
+VehicleProfile VehicleProfile::car() {
+    VehicleProfile profile;
+    profile.name = "car";
+    profile.default_speed_kmh = 50.0;
+    profile.speeds_kmh = {
+        {"motorway", 100.0}, {"motorway_link", 100.0}, {"trunk", 80.0}, {"trunk_link", 80.0},
+        {"primary", 65.0}, {"primary_link", 65.0}, {"secondary", 55.0}, {"tertiary", 40.0},
+        {"residential", 40.0}, {"living_street", 20.0},
+        {"footway", 0.0}, {"path", 0.0}, {"cycleway", 0.0}, {"pedestrian", 0.0}, {"steps", 0.0},
+    };
+    return profile;
+}
+
+VehicleProfile VehicleProfile::truck() {
+    VehicleProfile profile;
+    profile.name = "truck";
+    profile.default_speed_kmh = 40.0;
+    profile.speeds_kmh = {
+        {"motorway", 80.0}, {"motorway_link", 60.0}, {"trunk", 70.0}, {"trunk_link", 60.0},
+        {"primary", 60.0}, {"primary_link", 50.0}, {"secondary", 50.0}, {"tertiary", 40.0},
+        {"residential", 25.0}, {"living_street", 0.0}, {"service", 15.0},
+        {"footway", 0.0}, {"path", 0.0}, {"cycleway", 0.0}, {"pedestrian", 0.0}, {"steps", 0.0},
+    };
+    return profile;
+}
+
+VehicleProfile VehicleProfile::bike() {
+    VehicleProfile profile;
+    profile.name = "bike";
+    profile.default_speed_kmh = 15.0;
+    profile.follows_traffic = false;
+    profile.speeds_kmh = {
+        {"motorway", 0.0}, {"motorway_link", 0.0}, {"trunk", 0.0}, {"trunk_link", 0.0},
+        {"primary", 18.0}, {"secondary", 18.0}, {"tertiary", 18.0}, {"residential", 16.0},
+        {"living_street", 15.0}, {"cycleway", 20.0}, {"path", 12.0}, {"footway", 8.0},
+        {"pedestrian", 8.0}, {"steps", 2.0},
+    };
+    return profile;
+}
+
+bool VehicleProfile::load(const std::string& filename, VehicleProfile& profile) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open profile file " << filename << std::endl;
+        return false;
+    }
+
+    profile = VehicleProfile();
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key)) {
+            continue;
+        }
+
+        bool ok = true;
+        if (key == "name") {
+            ok = (bool)(fields >> profile.name);
+        } else if (key == "default") {
+            ok = (bool)(fields >> profile.default_speed_kmh);
+        } else if (key == "traffic") {
+            std::string value;
+            ok = (bool)(fields >> value);
+            profile.follows_traffic = (value == "yes");
+        } else if (key == "speed") {
+            std::string road_type;
+            double speed;
+            ok = (bool)(fields >> road_type >> speed);
+            if (ok) {
+                profile.speeds_kmh[road_type] = speed;
+            }
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::cerr << "Error: " << filename << ":" << line_number << ": bad profile line" << std::endl;
+            return false;
+        }
+    }
+    return !profile.name.empty();
+}
+
+VehicleProfiles::VehicleProfiles(const Graph& graph) : graph(graph) {}
+
+size_t VehicleProfiles::add(const VehicleProfile& profile) {
+    // Resolve the table once per road class, then it's one lookup per edge
+    std::vector<double> class_speeds(graph.roadClassCount());
+    for (size_t c = 0; c < class_speeds.size(); c++) {
+        class_speeds[c] = profile.speedFor(graph.roadClassType((uint8_t)c));
+    }
+
+    Compiled entry{profile, std::vector<float>(graph.edgeCount())};
+    parallelFor(graph.edgeCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t id = begin; id < end; id++) {
+            const Edge& edge = *graph.getEdge(id);
+            double speed = edge.road_class == kSharedRoadClass ? profile.speedFor(edge.segment->road_type)
+                                                               : class_speeds[edge.road_class];
+            entry.free_flow_seconds[id] = speed > 0.0
+                ? (float)(edge.segment->distance / (speed * 1000.0 / 3600.0))
+                : std::numeric_limits<float>::infinity();
+        }
+    });
+
+    size_t index;
+    if (find(profile.name, index)) {
+        compiled[index] = std::move(entry);
+        return index;
+    }
+    compiled.push_back(std::move(entry));
+    return compiled.size() - 1;
+}
+
+bool VehicleProfiles::find(const std::string& name, size_t& index) const {
+    for (size_t i = 0; i < compiled.size(); i++) {
+        if (compiled[i].profile.name == name) {
+            index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+double VehicleProfiles::edgeTime(size_t index, const Edge& edge, int hour_of_day,
+                                 const MetricSnapshot& metric) const {
+    const Compiled& entry = compiled[index];
+    double free_flow = entry.free_flow_seconds[edge.id];
+    if (!entry.profile.follows_traffic || free_flow == std::numeric_limits<double>::infinity()) {
+        return free_flow;
+    }
+    return std::max(free_flow, graph.learnedTravelTime(edge, hour_of_day, metric));
+}
+
+RouteResult VehicleProfiles::route(size_t index, long long start_id, long long end_id, int hour_of_day,
+                                   uint64_t avoided_classes) const {
+    RouteResult result;
+    result.mode = RouteMode::LEARNED;
+    result.mode_name = "Vehicle: " + compiled[index].profile.name;
+    result.total_distance = 0.0;
+    result.estimated_time = 0.0;
+
+    auto metric = graph.currentMetric();
+    auto weight = [&](const Edge& edge) { return edgeTime(index, edge, hour_of_day, *metric); };
+
+    static thread_local SearchWorkspace workspace;
+    double cost = avoided_classes == 0
+        ? graph.shortestPath(start_id, end_id, workspace, weight, result.edge_path)
+        : graph.shortestPath(start_id, end_id, workspace, weight, result.edge_path,
+                             RoadClassFilter{avoided_classes});
+    if (cost == std::numeric_limits<double>::infinity()) {
+        return result;
+    }
+
+    result.path = graph.pathNodes(start_id, result.edge_path);
+    result.estimated_time = cost;
+    for (size_t edge_id : result.edge_path) {
+        result.total_distance += graph.getEdge(edge_id)->segment->distance;
+    }
+    return result;
+}
+
+size_t VehicleProfiles::memoryBytes() const {
+    size_t bytes = 0;
+    for (const auto& entry : compiled) {
+        bytes += entry.free_flow_seconds.size() * sizeof(float);
+    }
+    return bytes;
+}
@@ -0,0 +1,63 @@
+#ifndef VEHICLE_PROFILE_H
+#define VEHICLE_PROFILE_H
+
+#include "graph.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Declarative description of how a vehicle uses the road network:
+// a free-flow speed per road type, where 0 means no access.
+struct VehicleProfile {
+    std::string name;
+    std::unordered_map<std::string, double> speeds_kmh;   // road_type -> speed, 0 = no access
+    double default_speed_kmh = 50.0;                      // road types not listed
+    bool follows_traffic = true;   // slowed by congestion (cars, trucks) or not (bikes)
+
+    double speedFor(const std::string& road_type) const;
+
+    static VehicleProfile car();
+    static VehicleProfile truck();
+    static VehicleProfile bike();
+
+    // Text format, one setting per line ('#' starts a comment):
+    //   name truck
+    //   default 40
+    //   traffic yes|no
+    //   speed motorway 80
+    static bool load(const std::string& filename, VehicleProfile& profile);
+};
+
+// Profiles compiled against one graph. The topology is shared; each profile
+// adds only its own free-flow time per edge (4 bytes per edge), so any number
+// of them can be loaded side by side and picked per query.
+class VehicleProfiles {
+public:
+    explicit VehicleProfiles(const Graph& graph);
+
+    // Compiles the profile; returns its index (replaces a profile of the same name)
+    size_t add(const VehicleProfile& profile);
+    bool find(const std::string& name, size_t& index) const;
+    size_t count() const { return compiled.size(); }
+    const VehicleProfile& profile(size_t index) const { return compiled[index].profile; }
+
+    // Edge travel time for a profile; infinity where it has no access.
+    // Vehicles that follow traffic never go faster than the cars around them.
+    double edgeTime(size_t index, const Edge& edge, int hour_of_day, const MetricSnapshot& metric) const;
+
+    RouteResult route(size_t index, long long start_id, long long end_id, int hour_of_day,
+                      uint64_t avoided_classes = 0) const;
+
+    size_t memoryBytes() const;
+
+private:
+    struct Compiled {
+        VehicleProfile profile;
+        std::vector<float> free_flow_seconds;   // by edge id
+    };
+
+    const Graph& graph;
+    std::vector<Compiled> compiled;
+};
+
+#endif
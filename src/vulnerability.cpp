@@ -0,0 +1,226 @@
+#include "vulnerability.h"
+#include "parallel.h"
+#include "search_workspace.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+const double kInf = std::numeric_limits<double>::infinity();
+
+// An edge x -> y between two branches of the tree. It enters the region cut
+// off by route edge i for every i in (branch[x], branch[y]].
+struct Crossing {
+    double key;        // d(x) + w + h(y): the shortest route a detour through it can give
+    double distance;   // d(x) + w
+    size_t edge_id;
+    uint32_t y;
+    int from, to;      // branch[x], branch[y]
+};
+
+// Per-worker scratch space, reused across trips
+struct WorkerState {
+    SearchWorkspace tree;                 // full tree from the trip origin
+    SearchWorkspace to_target;            // backward tree to the trip target, h(v)
+    SearchWorkspace detour;               // restricted re-search
+    std::vector<int> branch;              // by node: index of the last route edge on its tree path, -1 if none
+    std::vector<uint32_t> order;          // tree walk stack
+    std::vector<Crossing> crossings;      // sorted by key
+    std::unordered_map<size_t, EdgeImpact> impacts;
+    size_t routed = 0;
+    size_t settled = 0;
+};
+
+}  // namespace
+
+VulnerabilityAnalyzer::VulnerabilityAnalyzer(const Graph& graph, VulnerabilityOptions options)
+    : graph(graph), options(options) {}
+
+VulnerabilityReport VulnerabilityAnalyzer::analyze(
+        const std::vector<std::pair<long long, long long>>& od_pairs) const {
+    auto started = std::chrono::steady_clock::now();
+    VulnerabilityReport report;
+    report.od_pairs = od_pairs.size();
+
+    unsigned num_threads = options.threads > 0 ? options.threads : hardwareThreads();
+    std::vector<WorkerState> workers(num_threads);
+    size_t node_count = graph.nodeIndexCount();
+    const bool check_closures = graph.closedEdgeCount() > 0;
+
+    auto metric = graph.currentMetric();
+    auto weight = [&](const Edge& edge) { return graph.learnedTravelTime(edge, options.hour_of_day, *metric); };
+
+    parallelForEach(od_pairs.size(), [&](size_t k, unsigned worker) {
+        WorkerState& state = workers[worker];
+        uint32_t source, target;
+        if (!graph.getNodeIndex(od_pairs[k].first, source) || !graph.getNodeIndex(od_pairs[k].second, target) ||
+            source == target) {
+            return;
+        }
+
+        SearchWorkspace& tree = state.tree;
+        graph.shortestPathTree(source, tree, weight);
+        if (!tree.reached(target)) {
+            return;
+        }
+        state.routed++;
+        double base_cost = tree.distance(target);
+        SearchWorkspace& to_target = state.to_target;
+        graph.shortestPathTree(target, to_target, weight, true);
+
+        // Route edges, from the origin outwards
+        std::vector<size_t> route;
+        for (uint32_t node = target; node != source; node = graph.getEdgeSourceIndex(route.back())) {
+            route.push_back(tree.parentEdge(node));
+        }
+        std::reverse(route.begin(), route.end());
+
+        // Label every reached node with the deepest route edge above it in
+        // the tree, walking up only until an already labeled ancestor
+        std::unordered_map<size_t, int> route_position;
+        for (size_t i = 0; i < route.size(); i++) {
+            route_position[route[i]] = (int)i;
+        }
+        const int kUnlabeled = -2;
+        state.branch.assign(node_count, kUnlabeled);
+        state.branch[source] = -1;
+        for (uint32_t v = 0; v < node_count; v++) {
+            if (!tree.reached(v) || state.branch[v] != kUnlabeled) {
+                continue;
+            }
+            state.order.clear();
+            for (uint32_t u = v; state.branch[u] == kUnlabeled;
+                 u = graph.getEdgeSourceIndex(tree.parentEdge(u))) {
+                state.order.push_back(u);
+            }
+            for (auto it = state.order.rbegin(); it != state.order.rend(); ++it) {
+                size_t parent_edge = tree.parentEdge(*it);
+                auto on_route = route_position.find(parent_edge);
+                state.branch[*it] = on_route != route_position.end()
+                    ? on_route->second
+                    : state.branch[graph.getEdgeSourceIndex(parent_edge)];
+            }
+        }
+
+        // Closing route edge i cuts off every node with branch >= i. Only
+        // edges climbing to a deeper branch can enter such a region; collect
+        // them once per trip, shortest possible detour first
+        std::vector<Crossing>& crossings = state.crossings;
+        crossings.clear();
+        for (uint32_t y = 0; y < node_count; y++) {
+            if (!tree.reached(y) || state.branch[y] < 0) {
+                continue;
+            }
+            for (size_t edge_id : graph.getIncomingEdges(y)) {
+                uint32_t x = graph.getEdgeSourceIndex(edge_id);
+                if (!tree.reached(x) || state.branch[x] >= state.branch[y] || !to_target.reached(y) ||
+                    (check_closures && graph.isEdgeClosed(edge_id))) {
+                    continue;
+                }
+                double d = tree.distance(x) + weight(*graph.getEdge(edge_id));
+                crossings.push_back({d + to_target.distance(y), d, edge_id, y, state.branch[x], state.branch[y]});
+            }
+        }
+        std::sort(crossings.begin(), crossings.end(),
+                  [](const Crossing& a, const Crossing& b) { return a.key < b.key; });
+
+        // Replacement path for each route edge: A* inside the region, guided
+        // by the distance h to the target in the intact graph, which closing
+        // an edge can only lengthen. Crossings are fed in by key alongside
+        // the heap and the search stops when the target settles, so nodes
+        // and crossings that can't beat the replacement are never touched.
+        for (int i = 0; i < (int)route.size(); i++) {
+            SearchWorkspace& detour = state.detour;
+            detour.begin(node_count);
+            size_t next = 0;
+            for (;;) {
+                while (next < crossings.size() &&
+                       (crossings[next].from >= i || crossings[next].to < i || crossings[next].edge_id == route[i])) {
+                    next++;
+                }
+                double crossing_key = next < crossings.size() ? crossings[next].key : kInf;
+                double heap_key = detour.empty() ? kInf : detour.top().first;
+                if (crossing_key == kInf && heap_key == kInf) {
+                    break;
+                }
+                if (crossing_key <= heap_key) {
+                    const Crossing& crossing = crossings[next++];
+                    if (crossing.distance < detour.distance(crossing.y)) {
+                        detour.update(crossing.y, crossing.distance, crossing.edge_id);
+                        detour.push(crossing.key, crossing.y);
+                    }
+                    continue;
+                }
+
+                auto [key, current] = detour.pop();
+                double current_dist = detour.distance(current);
+                if (key > current_dist + to_target.distance(current)) {
+                    continue;
+                }
+                state.settled++;
+                if (current == target) {
+                    break;
+                }
+                const auto* edges = graph.getEdgesByIndex(current);
+                if (!edges) {
+                    continue;
+                }
+                for (const auto& edge : *edges) {
+                    if (state.branch[edge.to_index] < i || !to_target.reached(edge.to_index) ||
+                        (check_closures && graph.isEdgeClosed(edge.id))) {
+                        continue;
+                    }
+                    double d = current_dist + weight(edge);
+                    if (d < detour.distance(edge.to_index)) {
+                        detour.update(edge.to_index, d, edge.id);
+                        detour.push(d + to_target.distance(edge.to_index), edge.to_index);
+                    }
+                }
+            }
+
+            EdgeImpact& impact = state.impacts[route[i]];
+            impact.edge_id = route[i];
+            impact.routes_affected++;
+            double replacement = detour.distance(target);
+            if (replacement == kInf) {
+                impact.disconnected++;
+            } else {
+                double delay = replacement - base_cost;
+                impact.total_delay_s += delay;
+                impact.max_delay_s = std::max(impact.max_delay_s, delay);
+            }
+        }
+    }, num_threads);
+
+    std::unordered_map<size_t, EdgeImpact> merged;
+    for (auto& state : workers) {
+        report.routed += state.routed;
+        report.nodes_researched += state.settled;
+        for (const auto& [edge_id, impact] : state.impacts) {
+            EdgeImpact& total = merged[edge_id];
+            total.edge_id = edge_id;
+            total.routes_affected += impact.routes_affected;
+            total.disconnected += impact.disconnected;
+            total.total_delay_s += impact.total_delay_s;
+            total.max_delay_s = std::max(total.max_delay_s, impact.max_delay_s);
+        }
+    }
+    for (const auto& entry : merged) {
+        report.ranked.push_back(entry.second);
+    }
+    // Disconnections outrank any delay, then total delay
+    std::sort(report.ranked.begin(), report.ranked.end(), [](const EdgeImpact& a, const EdgeImpact& b) {
+        if (a.disconnected != b.disconnected) {
+            return a.disconnected > b.disconnected;
+        }
+        if (a.total_delay_s != b.total_delay_s) {
+            return a.total_delay_s > b.total_delay_s;
+        }
+        return a.edge_id < b.edge_id;
+    });
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
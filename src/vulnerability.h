@@ -0,0 +1,52 @@
+#ifndef VULNERABILITY_H
+#define VULNERABILITY_H
+
+#include "graph.h"
+#include <utility>
+#include <vector>
+
+struct VulnerabilityOptions {
+    int hour_of_day = 17;
+    unsigned threads = 0;          // 0 = all hardware threads
+};
+
+struct EdgeImpact {
+    size_t edge_id;
+    size_t routes_affected = 0;    // sampled routes that use the edge
+    size_t disconnected = 0;       // of those, routes with no alternative at all
+    double total_delay_s = 0.0;    // summed detour cost over routes that still connect
+    double max_delay_s = 0.0;
+};
+
+struct VulnerabilityReport {
+    std::vector<EdgeImpact> ranked;   // most damaging closure first
+    size_t od_pairs = 0;
+    size_t routed = 0;
+    size_t nodes_researched = 0;      // nodes settled by the incremental searches
+    double seconds = 0.0;
+};
+
+// Ranks road segments by how much closing them would slow a sample of trips.
+//
+// Every edge on every sampled route is a candidate. Instead of re-routing
+// each (edge, trip) pair from scratch, one shortest-path tree is built per
+// trip. Closing a route edge only invalidates the subtree hanging below it;
+// every other node keeps its distance. The replacement path is found by a
+// search restricted to that subtree, seeded from edges that enter it from
+// the unaffected part. A backward tree from the trip target guides that
+// search (A*) and orders the entering edges, so it stops as soon as the
+// target settles without scanning the rest of the subtree. Trips are
+// processed in parallel with per-worker workspaces and impact tables merged
+// at the end.
+class VulnerabilityAnalyzer {
+public:
+    VulnerabilityAnalyzer(const Graph& graph, VulnerabilityOptions options = {});
+
+    VulnerabilityReport analyze(const std::vector<std::pair<long long, long long>>& od_pairs) const;
+
+private:
+    const Graph& graph;
+    VulnerabilityOptions options;
+};
+
+#endif